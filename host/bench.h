@@ -0,0 +1,85 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+#pragma once
+
+// C/C++ language includes
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <chrono>
+
+// Minimal benchmark harness for the host (native) build.  Each benchmark
+// registers itself with BENCH(name) and is run by host/main.cpp.  Inputs are
+// generated from a fixed seed so that numbers are comparable commit to commit.
+
+struct BenchCase
+{
+    const char *name;
+    void (*fn)();
+    BenchCase *next;
+
+    BenchCase(const char *n, void (*f)());
+};
+
+#define BENCH(name)                                      \
+    static void bench_##name();                          \
+    static BenchCase bench_case_##name(#name, bench_##name); \
+    static void bench_##name()
+
+// Deterministic input generator (xorshift64*), seeded identically on every run.
+struct BenchRandom
+{
+    uint64_t state;
+
+    explicit BenchRandom(uint64_t seed = 0x5EC0DE2ULL) : state(seed) {}
+
+    uint64_t next()
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1DULL;
+    }
+    uint32_t next32() { return (uint32_t)(next() >> 32); }
+};
+
+// Report a failed self check (printf style).  Benchmarks verify their inputs and
+// outputs before timing anything; the runner exits non-zero if any check failed.
+void bench_fail(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+int bench_fail_count(void);
+
+// Stop the optimizer from discarding results that are otherwise unused.
+template <typename T>
+inline void bench_keep(const T &value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+// Time `iterations` calls of fn(i) and report throughput on stderr.  Returns
+// nanoseconds per operation so callers can print comparisons.
+template <typename F>
+double bench_run(const char *label, uint64_t iterations, F &&fn)
+{
+    // short warm up so caches and branch predictors settle
+    for (uint64_t i = 0; i < iterations / 16; i++)
+        fn(i);
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; i++)
+        fn(i);
+    auto end = std::chrono::steady_clock::now();
+
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    double ns_per_op = ns / (double)iterations;
+    fprintf(stderr, "  %-44s %10llu ops %10.1f ns/op %12.0f ops/s\n",
+            label, (unsigned long long)iterations, ns_per_op, 1e9 / ns_per_op);
+    return ns_per_op;
+}
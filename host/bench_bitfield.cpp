@@ -0,0 +1,177 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+
+// C/C++ language includes
+#include <vector>
+
+// RATGDO project includes
+#include "bench.h"
+#include "Packet.h"
+
+// Payload pack/unpack generated from BitField layouts against the hand written
+// mask-and-shift code it replaced.  The legacy functions are copies of the old
+// Packet.h constructors and to_data() methods, kept only as a baseline.
+
+static StatusCommandData legacy_status_decode(uint32_t pkt_data)
+{
+    StatusCommandData s;
+    s.door = static_cast<DoorState>((pkt_data >> 8) & 0b1111);
+    s.parity = ((pkt_data >> 12) & 0b1111);
+    s.unknown1 = ((pkt_data >> 21) & 0b1);
+    s.obstruction = ((pkt_data >> 22) & 0b1);
+    s.lock = ((pkt_data >> 24) & 0b1);
+    s.light = ((pkt_data >> 25) & 0b1);
+    s.unknown2 = ((pkt_data >> 30) & 0b1);
+    return s;
+}
+
+static uint32_t legacy_status_encode(const StatusCommandData &s)
+{
+    uint32_t pkt_data = 0;
+    pkt_data |= static_cast<uint8_t>(s.door) << 8;
+    pkt_data |= s.parity << 12;
+    pkt_data |= s.unknown1 << 21;
+    pkt_data |= s.obstruction << 22;
+    pkt_data |= s.lock << 24;
+    pkt_data |= s.light << 25;
+    pkt_data |= s.unknown2 << 30;
+    return pkt_data;
+}
+
+static DoorActionCommandData legacy_door_action_decode(uint32_t pkt_data)
+{
+    DoorActionCommandData d;
+    d.action = static_cast<DoorAction>((pkt_data >> 8) & 0b11);
+    d.parity = ((pkt_data >> 12) & 0b1111);
+    d.pressed = ((pkt_data >> 16) & 0b1);
+    d.id = ((pkt_data >> 24) & 0b11);
+    return d;
+}
+
+static uint32_t legacy_door_action_encode(const DoorActionCommandData &d)
+{
+    uint32_t pkt_data = 0;
+    pkt_data |= static_cast<uint32_t>(d.action) << 8;
+    pkt_data |= d.parity << 12;
+    pkt_data |= d.pressed << 16;
+    pkt_data |= (d.id & 0b11) << 24;
+    return pkt_data;
+}
+
+static OpeningsCommandData legacy_openings_decode(uint32_t pkt_data)
+{
+    OpeningsCommandData o;
+    uint8_t lo = ((pkt_data >> 24) & 0xFF);
+    uint8_t hi = ((pkt_data >> 16) & 0xFF);
+    o.parity = ((pkt_data >> 12) & 0b1111);
+    o.count = hi << 8 | lo;
+    return o;
+}
+
+static uint32_t legacy_openings_encode(const OpeningsCommandData &o)
+{
+    uint32_t pkt_data = 0;
+    uint8_t lo = o.count & 0xFF;
+    uint8_t hi = o.count >> 8;
+    pkt_data |= lo << 24;
+    pkt_data |= hi << 16;
+    pkt_data |= o.parity << 12;
+    return pkt_data;
+}
+
+static LightCommandData legacy_light_decode(uint32_t pkt_data)
+{
+    LightCommandData l;
+    l.light = static_cast<LightState>((pkt_data >> 8) & 0b11);
+    l.parity = ((pkt_data >> 12) & 0b1111);
+    l.pressed = false;
+    return l;
+}
+
+static uint32_t legacy_light_encode(const LightCommandData &l)
+{
+    uint32_t pkt_data = 0;
+    pkt_data |= static_cast<uint32_t>(l.light) << 8;
+    pkt_data |= l.parity << 12;
+    return pkt_data;
+}
+
+#define BENCH_WORDS 1024
+
+static std::vector<uint32_t> bench_words()
+{
+    BenchRandom rnd(0xB17F);
+    std::vector<uint32_t> words(BENCH_WORDS);
+    for (size_t i = 0; i < BENCH_WORDS; i++)
+        words[i] = rnd.next32();
+    return words;
+}
+
+// Time decode and encode of one payload type both ways, after checking that both
+// produce identical words for every input.
+template <typename Data, typename LegacyDecode, typename LegacyEncode>
+static void bench_payload(const char *name, LegacyDecode legacy_decode, LegacyEncode legacy_encode)
+{
+    std::vector<uint32_t> words = bench_words();
+    std::vector<Data> values;
+    for (uint32_t w : words)
+    {
+        if (legacy_encode(legacy_decode(w)) != Data(w).to_data())
+        {
+            bench_fail("%s for data word 0x%08X\n", name, w);
+            return;
+        }
+        values.push_back(Data(w));
+    }
+
+    char label[64];
+    snprintf(label, sizeof(label), "hand coded %s decode", name);
+    bench_run(label, 20000000, [&](uint64_t i)
+              {
+        Data d = legacy_decode(words[i % BENCH_WORDS]);
+        bench_keep(d); });
+    snprintf(label, sizeof(label), "BitField %s decode", name);
+    bench_run(label, 20000000, [&](uint64_t i)
+              {
+        Data d(words[i % BENCH_WORDS]);
+        bench_keep(d); });
+    snprintf(label, sizeof(label), "hand coded %s encode", name);
+    bench_run(label, 20000000, [&](uint64_t i)
+              {
+        uint32_t w = legacy_encode(values[i % BENCH_WORDS]);
+        bench_keep(w); });
+    snprintf(label, sizeof(label), "BitField %s encode", name);
+    bench_run(label, 20000000, [&](uint64_t i)
+              {
+        uint32_t w = values[i % BENCH_WORDS].to_data();
+        bench_keep(w); });
+}
+
+BENCH(bitfield_status)
+{
+    bench_payload<StatusCommandData>("Status", legacy_status_decode, legacy_status_encode);
+}
+
+BENCH(bitfield_door_action)
+{
+    bench_payload<DoorActionCommandData>("DoorAction", legacy_door_action_decode, legacy_door_action_encode);
+}
+
+BENCH(bitfield_openings)
+{
+    bench_payload<OpeningsCommandData>("Openings", legacy_openings_decode, legacy_openings_encode);
+}
+
+BENCH(bitfield_light)
+{
+    // Lock has the identical layout
+    bench_payload<LightCommandData>("Light", legacy_light_decode, legacy_light_encode);
+}
@@ -0,0 +1,138 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+
+// C/C++ language includes
+#include <string.h>
+#include <vector>
+
+// RATGDO project includes
+#include "bench.h"
+#include "Packet.h"
+#include "Reader.h"
+
+// Mix of commands roughly as seen on a live bus, status dominates.
+static const PacketCommand::PacketCommandValue bench_commands[] = {
+    PacketCommand::Status,
+    PacketCommand::Status,
+    PacketCommand::Status,
+    PacketCommand::GetStatus,
+    PacketCommand::Light,
+    PacketCommand::Lock,
+    PacketCommand::DoorAction,
+    PacketCommand::Openings,
+    PacketCommand::Motion,
+    PacketCommand::Ping,
+};
+
+#define BENCH_FRAMES 1024
+
+// Build a fixed set of packets with random (but reproducible) payloads.
+static std::vector<Packet> bench_packets()
+{
+    BenchRandom rnd;
+    std::vector<Packet> pkts;
+    for (size_t i = 0; i < BENCH_FRAMES; i++)
+    {
+        PacketCommand cmd = bench_commands[rnd.next32() % (sizeof(bench_commands) / sizeof(bench_commands[0]))];
+        PacketData d;
+        uint32_t raw = rnd.next32();
+        switch (cmd)
+        {
+        case PacketCommand::Status:
+            d.type = PacketDataType::Status;
+            d.value.status = StatusCommandData(raw);
+            break;
+        case PacketCommand::Light:
+            d.type = PacketDataType::Light;
+            d.value.light = LightCommandData(raw);
+            break;
+        case PacketCommand::Lock:
+            d.type = PacketDataType::Lock;
+            d.value.lock = LockCommandData(raw);
+            break;
+        case PacketCommand::DoorAction:
+            d.type = PacketDataType::DoorAction;
+            d.value.door_action = DoorActionCommandData(raw);
+            break;
+        case PacketCommand::Openings:
+            d.type = PacketDataType::Openings;
+            d.value.openings = OpeningsCommandData(raw);
+            break;
+        default:
+            d.type = PacketDataType::NoData;
+            d.value.no_data = NoData();
+            break;
+        }
+        pkts.push_back(Packet(cmd, d, rnd.next32() & 0xFFFFFF));
+    }
+    return pkts;
+}
+
+// Encode every packet once to produce the wireline frames used for decode.
+static std::vector<uint8_t> bench_frames(std::vector<Packet> &pkts)
+{
+    BenchRandom rnd(0xF7A3E5);
+    std::vector<uint8_t> frames(pkts.size() * SECPLUS2_CODE_LEN);
+    for (size_t i = 0; i < pkts.size(); i++)
+    {
+        pkts[i].encode(rnd.next32() & 0xFFFFFFF, &frames[i * SECPLUS2_CODE_LEN]);
+    }
+    return frames;
+}
+
+BENCH(codec_packet_decode)
+{
+    std::vector<Packet> pkts = bench_packets();
+    std::vector<uint8_t> frames = bench_frames(pkts);
+
+    bench_run("Packet(const uint8_t[SECPLUS2_CODE_LEN])", 1000000, [&](uint64_t i)
+              {
+        Packet pkt(&frames[(i % BENCH_FRAMES) * SECPLUS2_CODE_LEN]);
+        bench_keep(pkt); });
+}
+
+BENCH(codec_packet_encode)
+{
+    std::vector<Packet> pkts = bench_packets();
+    uint8_t buf[SECPLUS2_CODE_LEN];
+
+    bench_run("Packet::encode()", 1000000, [&](uint64_t i)
+              {
+        pkts[i % BENCH_FRAMES].encode((uint32_t)i & 0xFFFFFFF, buf);
+        bench_keep(buf); });
+}
+
+BENCH(codec_reader_push_byte)
+{
+    std::vector<Packet> pkts = bench_packets();
+    std::vector<uint8_t> frames = bench_frames(pkts);
+
+    // Interleave a little line noise between frames, as seen on a real bus
+    BenchRandom rnd(0xB0B);
+    std::vector<uint8_t> stream;
+    for (size_t i = 0; i < BENCH_FRAMES; i++)
+    {
+        size_t noise = rnd.next32() % 4;
+        for (size_t n = 0; n < noise; n++)
+            stream.push_back(rnd.next32() & 0xFE); // never 0x55 0x01 0x00
+        stream.insert(stream.end(), &frames[i * SECPLUS2_CODE_LEN], &frames[(i + 1) * SECPLUS2_CODE_LEN]);
+    }
+
+    SecPlus2Reader reader;
+    uint64_t completed = 0;
+    double ns = bench_run("SecPlus2Reader::push_byte() per byte", 20000000, [&](uint64_t i)
+                          {
+        if (reader.push_byte(stream[i % stream.size()], 0))
+            completed++; });
+    bench_keep(completed);
+    double frame_bytes = (double)stream.size() / BENCH_FRAMES;
+    fprintf(stderr, "  %-44s %10.1f ns/frame %11.0f frames/s\n", "  => SecPlus2Reader frames", ns * frame_bytes, 1e9 / (ns * frame_bytes));
+}
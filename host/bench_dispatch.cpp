@@ -0,0 +1,231 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+
+// C/C++ language includes
+#include <string.h>
+#include <vector>
+
+// RATGDO project includes
+#include "bench.h"
+#include "Packet.h"
+
+// Command dispatch, PACKET_COMMANDS table lookup against the switch statements
+// it replaced.  The legacy versions below are copies of the old Packet.h code
+// kept only as a baseline.
+
+static PacketCommand legacy_from_word(uint16_t raw)
+{
+    switch (raw)
+    {
+    case PacketCommand::GetStatus:
+    case PacketCommand::Status:
+    case PacketCommand::Obst1:
+    case PacketCommand::Obst2:
+    case PacketCommand::Pair3:
+    case PacketCommand::Pair3Resp:
+    case PacketCommand::Learn2:
+    case PacketCommand::Lock:
+    case PacketCommand::DoorAction:
+    case PacketCommand::Light:
+    case PacketCommand::MotorOn:
+    case PacketCommand::Motion:
+    case PacketCommand::Learn1:
+    case PacketCommand::Ping:
+    case PacketCommand::PingResp:
+    case PacketCommand::Pair2:
+    case PacketCommand::Pair2Resp:
+    case PacketCommand::SetTtc:
+    case PacketCommand::CancelTtc:
+    case PacketCommand::Ttc:
+    case PacketCommand::GetOpenings:
+    case PacketCommand::Openings:
+        return static_cast<PacketCommand::PacketCommandValue>(raw);
+    default:
+        return PacketCommand::Unknown;
+    }
+}
+
+static const char *legacy_to_string(PacketCommand cmd)
+{
+    switch (cmd)
+    {
+    case PacketCommand::Unknown:
+        return "UNKNOWN";
+    case PacketCommand::GetStatus:
+        return "GetStatus";
+    case PacketCommand::Status:
+        return "Status";
+    case PacketCommand::Obst1:
+        return "Obst1";
+    case PacketCommand::Obst2:
+        return "Obst2";
+    case PacketCommand::Pair3:
+        return "Pair3";
+    case PacketCommand::Pair3Resp:
+        return "Pair3Resp";
+    case PacketCommand::Learn2:
+        return "Learn2";
+    case PacketCommand::Lock:
+        return "Lock";
+    case PacketCommand::DoorAction:
+        return "DoorAction";
+    case PacketCommand::Light:
+        return "Light";
+    case PacketCommand::MotorOn:
+        return "MotorOn";
+    case PacketCommand::Motion:
+        return "Motion";
+    case PacketCommand::Learn1:
+        return "Learn1";
+    case PacketCommand::Ping:
+        return "Ping";
+    case PacketCommand::PingResp:
+        return "PingResp";
+    case PacketCommand::Pair2:
+        return "Pair2";
+    case PacketCommand::Pair2Resp:
+        return "Pair2Resp";
+    case PacketCommand::SetTtc:
+        return "SetTtc";
+    case PacketCommand::CancelTtc:
+        return "CancelTtc";
+    case PacketCommand::Ttc:
+        return "Ttc";
+    case PacketCommand::GetOpenings:
+        return "GetOpenings";
+    case PacketCommand::Openings:
+        return "Openings";
+    }
+    return "Invalid PacketCommandValue";
+}
+
+// The old Packet constructor's data decode, command switch to payload struct
+static void legacy_decode(PacketData &d, PacketCommand cmd, uint16_t word, uint32_t pkt_data)
+{
+    switch (cmd)
+    {
+    case PacketCommand::Unknown:
+        d.type = PacketDataType::Unknown;
+        d.value.cmd = word;
+        break;
+    case PacketCommand::Status:
+        d.type = PacketDataType::Status;
+        d.value.status = StatusCommandData(pkt_data);
+        break;
+    case PacketCommand::Lock:
+        d.type = PacketDataType::Lock;
+        d.value.lock = LockCommandData(pkt_data);
+        break;
+    case PacketCommand::DoorAction:
+        d.type = PacketDataType::DoorAction;
+        d.value.door_action = DoorActionCommandData(pkt_data);
+        break;
+    case PacketCommand::Light:
+        d.type = PacketDataType::Light;
+        d.value.light = LightCommandData(pkt_data);
+        break;
+    case PacketCommand::Openings:
+        d.type = PacketDataType::Openings;
+        d.value.openings = OpeningsCommandData(pkt_data);
+        break;
+    default:
+        d.type = PacketDataType::NoData;
+        d.value.no_data = NoData(pkt_data);
+        break;
+    }
+}
+
+static void table_decode(PacketData &d, uint16_t word, uint32_t pkt_data)
+{
+    const PacketCommandInfo &info = packet_command_info(word);
+    d.type = info.type;
+    if (info.type == PacketDataType::Unknown)
+        d.value.cmd = word;
+    else
+        packet_data_codec(info.type).decode(d, pkt_data);
+}
+
+#define BENCH_WORDS 1024
+
+// Command words as they come off the bus: every known command plus 1 in 8 unknown
+static std::vector<uint16_t> bench_words()
+{
+    BenchRandom rnd(0xD15);
+    std::vector<uint16_t> words;
+    for (size_t i = 0; i < BENCH_WORDS; i++)
+    {
+        if (rnd.next32() % 8 == 0)
+            words.push_back(rnd.next32() & 0xFFF);
+        else
+            words.push_back(PACKET_COMMANDS[1 + rnd.next32() % (PACKET_COMMAND_COUNT - 1)].value);
+    }
+    return words;
+}
+
+BENCH(dispatch_from_word)
+{
+    std::vector<uint16_t> words = bench_words();
+
+    // both implementations must agree on every 12-bit word before timing anything
+    for (uint32_t w = 0; w <= 0xFFF; w++)
+    {
+        if (PacketCommand::from_word(w) != legacy_from_word(w) ||
+            strcmp(PacketCommand::to_string(PacketCommand::from_word(w)), legacy_to_string(legacy_from_word(w))))
+        {
+            bench_fail("for command word 0x%03X\n", w);
+            return;
+        }
+    }
+
+    bench_run("legacy switch from_word()", 20000000, [&](uint64_t i)
+              {
+        PacketCommand cmd = legacy_from_word(words[i % BENCH_WORDS]);
+        bench_keep(cmd); });
+    bench_run("PACKET_COMMANDS from_word()", 20000000, [&](uint64_t i)
+              {
+        PacketCommand cmd = PacketCommand::from_word(words[i % BENCH_WORDS]);
+        bench_keep(cmd); });
+}
+
+BENCH(dispatch_to_string)
+{
+    std::vector<uint16_t> words = bench_words();
+
+    bench_run("legacy switch to_string()", 20000000, [&](uint64_t i)
+              {
+        const char *name = legacy_to_string(legacy_from_word(words[i % BENCH_WORDS]));
+        bench_keep(name); });
+    bench_run("PACKET_COMMANDS to_string()", 20000000, [&](uint64_t i)
+              {
+        const char *name = PacketCommand::to_string(PacketCommand::from_word(words[i % BENCH_WORDS]));
+        bench_keep(name); });
+}
+
+BENCH(dispatch_decode_data)
+{
+    std::vector<uint16_t> words = bench_words();
+    BenchRandom rnd(0xDA7A);
+    std::vector<uint32_t> data(BENCH_WORDS);
+    for (size_t i = 0; i < BENCH_WORDS; i++)
+        data[i] = (rnd.next32() & ~0xFF) | (words[i] & 0xFF);
+
+    bench_run("legacy switch payload decode", 20000000, [&](uint64_t i)
+              {
+        PacketData d;
+        uint16_t word = words[i % BENCH_WORDS];
+        legacy_decode(d, legacy_from_word(word), word, data[i % BENCH_WORDS]);
+        bench_keep(d); });
+    bench_run("PACKET_COMMANDS payload decode", 20000000, [&](uint64_t i)
+              {
+        PacketData d;
+        table_decode(d, words[i % BENCH_WORDS], data[i % BENCH_WORDS]);
+        bench_keep(d); });
+}
@@ -0,0 +1,121 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+
+// C/C++ language includes
+#include <stdio.h>
+
+// RATGDO project includes
+#include "bench.h"
+#include "DoorReducer.h"
+
+// DoorReducer over every door and reported state, and over a status stream like
+// a Security+ 2.0 opener's, counting what would be sent to HomeKit.
+
+static const DoorState STATES[] = {DoorState::Unknown, DoorState::Open, DoorState::Closed,
+                                   DoorState::Stopped, DoorState::Opening, DoorState::Closing};
+
+BENCH(door_reducer_table)
+{
+    uint32_t cases = 0;
+    for (int active = 0; active < 2; active++)
+    {
+        for (uint8_t current = 0; current <= DoorReducer::CURR_STOPPED; current++)
+        {
+            for (uint8_t target = 0; target <= DoorReducer::TGT_CLOSED; target++)
+            {
+                for (DoorState state : STATES)
+                {
+                    DoorView door = {active != 0, current, target};
+                    DoorReducer::Result r = DoorReducer::reduce(door, state);
+                    cases++;
+                    // changed says exactly what differs
+                    bool differs = r.door.active != door.active || r.door.current != door.current ||
+                                   r.door.target != door.target;
+                    if (active && ((r.changed & DoorReducer::CURRENT) != 0) != (r.door.current != door.current))
+                        bench_fail("state %u from %u/%u: current change not flagged\n", (unsigned)state, current, target);
+                    if (active && ((r.changed & DoorReducer::TARGET) != 0) != (r.door.target != door.target))
+                        bench_fail("state %u from %u/%u: target change not flagged\n", (unsigned)state, current, target);
+                    if (!differs && r.changed && active)
+                        bench_fail("state %u from %u/%u: change flagged with none\n", (unsigned)state, current, target);
+                    if (state == DoorState::Unknown && (r.changed || differs))
+                        bench_fail("unknown state changed the door\n");
+                    if (state != DoorState::Unknown && !r.door.active)
+                        bench_fail("state %u did not activate the door\n", (unsigned)state);
+                    // the same report again changes nothing
+                    if (DoorReducer::reduce(r.door, state).changed)
+                        bench_fail("state %u twice from %u/%u changed the door twice\n", (unsigned)state, current, target);
+                }
+            }
+        }
+    }
+    fprintf(stderr, "  %u door and state combinations\n", cases);
+
+    DoorView door = {true, DoorReducer::CURR_CLOSED, DoorReducer::TGT_CLOSED};
+    bench_run("DoorReducer::reduce()", 10000000, [&](uint64_t i)
+              {
+        DoorReducer::Result r = DoorReducer::reduce(door, STATES[i % 6]);
+        door = r.door;
+        bench_keep(r.changed); });
+}
+
+// An open and close as a Security+ 2.0 opener reports it, status after every poll
+BENCH(door_reducer_stream)
+{
+    struct Step
+    {
+        DoorState state;
+        int repeats;
+    };
+    const Step steps[] = {
+        {DoorState::Unknown, 2}, {DoorState::Closed, 20}, {DoorState::Opening, 12}, {DoorState::Open, 30},
+        {DoorState::Closing, 12}, {DoorState::Stopped, 5}, {DoorState::Opening, 4}, {DoorState::Open, 10},
+        {DoorState::Closing, 12}, {DoorState::Closed, 20},
+    };
+
+    DoorView door = {false, 0, 0};
+    uint32_t reports = 0, notify_current = 0, notify_target = 0, legacy = 0;
+    uint8_t shown[16];
+    uint32_t changes = 0;
+    for (const Step &step : steps)
+    {
+        for (int i = 0; i < step.repeats; i++)
+        {
+            DoorReducer::Result r = DoorReducer::reduce(door, step.state);
+            reports++;
+            if (r.changed & DoorReducer::CURRENT)
+            {
+                notify_current++;
+                if (changes < sizeof(shown))
+                    shown[changes++] = r.door.current;
+            }
+            if (r.changed & DoorReducer::TARGET)
+                notify_target++;
+            // Security+ 2.0 sent both whenever either changed
+            if (r.changed)
+                legacy += 2;
+            door = r.door;
+        }
+    }
+    fprintf(stderr, "  %u status reports, %u HomeKit notifications, was %u\n",
+            reports, notify_current + notify_target, legacy);
+
+    const uint8_t expect[] = {DoorReducer::CURR_CLOSED, DoorReducer::CURR_OPENING, DoorReducer::CURR_OPEN,
+                              DoorReducer::CURR_CLOSING, DoorReducer::CURR_STOPPED, DoorReducer::CURR_OPENING,
+                              DoorReducer::CURR_OPEN, DoorReducer::CURR_CLOSING, DoorReducer::CURR_CLOSED};
+    bool same = changes == sizeof(expect);
+    for (uint32_t i = 0; same && i < changes; i++)
+        same = shown[i] == expect[i];
+    if (!same)
+        bench_fail("HomeKit shown a different sequence of door states\n");
+    // closed, then open, closing, (stopped keeps open), open, closing
+    if (notify_target != 5)
+        bench_fail("%u target notifications, expected 5\n", notify_target);
+}
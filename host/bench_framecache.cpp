@@ -0,0 +1,112 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+
+// C/C++ language includes
+#include <string.h>
+#include <vector>
+
+// RATGDO project includes
+#include "bench.h"
+#include "FrameCache.h"
+
+// Cost of producing the frame to transmit, from SecPlus2FrameCache against a
+// fresh Packet::encode().  Cached frames must be identical to fresh ones, and
+// must never be used once the rolling code has moved on.
+
+static const uint32_t bench_id_code = 0x4E2539;
+
+static Packet bench_door_packet(DoorAction action, bool pressed)
+{
+    PacketData data = {};
+    data.type = PacketDataType::DoorAction;
+    data.value.door_action.action = action;
+    data.value.door_action.pressed = pressed;
+    data.value.door_action.id = 1;
+    return Packet(PacketCommand::DoorAction, data, bench_id_code);
+}
+
+static Packet bench_get_status_packet()
+{
+    PacketData data = {};
+    data.type = PacketDataType::NoData;
+    return Packet(PacketCommand::GetStatus, data, bench_id_code);
+}
+
+// Cache filled as comms does while the bus is idle
+static void bench_fill(SecPlus2FrameCache<12> &cache, uint32_t rolling)
+{
+    cache.set_rolling(rolling);
+    while (cache.fill_one())
+        ;
+}
+
+static bool bench_same_frame(SecPlus2FrameCache<12> &cache, Packet pkt, uint32_t rolling)
+{
+    uint8_t cached[SECPLUS2_CODE_LEN];
+    uint8_t fresh[SECPLUS2_CODE_LEN];
+    Packet copy = pkt;
+    return cache.encode(pkt, rolling, cached) == 0 &&
+           copy.encode(rolling, fresh) == 0 &&
+           !memcmp(cached, fresh, SECPLUS2_CODE_LEN) &&
+           pkt.m_rolling == rolling;
+}
+
+BENCH(framecache_transmit)
+{
+    SecPlus2FrameCache<12> cache;
+    for (DoorAction action : {DoorAction::Open, DoorAction::Close, DoorAction::Toggle})
+    {
+        cache.add(bench_door_packet(action, true));
+        cache.add(bench_door_packet(action, false));
+    }
+    cache.add(bench_get_status_packet(), 0);
+    cache.add(bench_get_status_packet(), 1);
+
+    // door open as comms sends it: press and release at R, get status at R+1,
+    // including across the 28-bit rolling code wrap
+    for (uint32_t rolling : {0x1234u, 0xFFFFFFFu})
+    {
+        bench_fill(cache, rolling);
+        uint32_t hits = cache.hits();
+        uint32_t next = (rolling + 1) & 0xFFFFFFF;
+        if (!bench_same_frame(cache, bench_door_packet(DoorAction::Open, true), rolling) ||
+            !bench_same_frame(cache, bench_door_packet(DoorAction::Open, false), rolling) ||
+            !bench_same_frame(cache, bench_get_status_packet(), next) ||
+            cache.hits() != hits + 3)
+            bench_fail("pre-encoded door open sequence at rolling code %07X\n", rolling);
+
+        // not a candidate, or a candidate at the wrong rolling code, is encoded fresh
+        hits = cache.hits();
+        if (!bench_same_frame(cache, bench_door_packet(DoorAction::Stop, true), rolling) ||
+            !bench_same_frame(cache, bench_door_packet(DoorAction::Open, true), next) ||
+            cache.hits() != hits)
+            bench_fail("cache hit where a fresh encode was needed at %07X\n", rolling);
+    }
+    // moving the rolling code on drops every entry until refilled
+    cache.set_rolling(0x1235);
+    uint32_t hits = cache.hits();
+    if (!bench_same_frame(cache, bench_door_packet(DoorAction::Open, true), 0x1235) || cache.hits() != hits)
+        bench_fail("stale entry used after rolling code advanced\n");
+
+    bench_fill(cache, 0x2000);
+    uint8_t buf[SECPLUS2_CODE_LEN];
+    Packet press = bench_door_packet(DoorAction::Toggle, true);
+    bench_run("Packet::encode() at transmit", 1000000, [&](uint64_t i)
+              {
+        press.encode(0x2000, buf);
+        bench_keep(buf); });
+    bench_run("SecPlus2FrameCache::encode() hit", 1000000, [&](uint64_t i)
+              {
+        cache.encode(press, 0x2000, buf);
+        bench_keep(buf); });
+    bench_run("SecPlus2FrameCache refill, 8 frames", 20000, [&](uint64_t i)
+              { bench_fill(cache, 0x3000 + (uint32_t)i); });
+}
@@ -0,0 +1,100 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+
+// RATGDO project includes
+#include "bench.h"
+#include "Journal.h"
+#include "Flash.h"
+
+// The rolling code Journal on two 4K sectors of RAM flash, as in partitions.csv.
+// Power is cut after every few bytes written or erased through enough appends to
+// wrap round the sectors twice, and the journal must always recover to the last
+// value whose append returned, or to the one being appended when power went.
+
+static const size_t SECTORS = 2;
+static const uint32_t APPENDS = 1100; // 256 records to a sector
+
+BENCH(journal_power_cut)
+{
+    // flash operations the whole run takes, with power never cut
+    SimFlash whole(SECTORS);
+    Journal full(whole);
+    full.begin();
+    for (uint32_t v = 1; v <= APPENDS; v++)
+        full.append(v);
+    size_t total = whole.written() + whole.erases() * JournalFlash::SECTOR_SIZE;
+
+    uint32_t cases = 0, rolled_back = 0;
+    for (size_t cut = 0; cut < total; cut += 5)
+    {
+        SimFlash flash(SECTORS);
+        Journal journal(flash);
+        journal.begin();
+        flash.power_cut_after(cut);
+        uint32_t done = 0;
+        while (done < APPENDS && journal.append(done + 1))
+            done++;
+
+        flash.power_on();
+        Journal after(flash);
+        if (!after.begin())
+        {
+            bench_fail("cut after %zu bytes: journal not readable\n", cut);
+            return;
+        }
+        uint32_t got = after.empty() ? 0 : after.last();
+        if (got != done && got != done + 1)
+        {
+            bench_fail("cut after %zu bytes: recovered %u, last written %u\n", cut, got, done);
+            return;
+        }
+        rolled_back += (got == done);
+        // and carries on from there
+        if (!after.append(got + 1000))
+        {
+            bench_fail("cut after %zu bytes: cannot append after recovery\n", cut);
+            return;
+        }
+        Journal again(flash);
+        again.begin();
+        if (again.last() != got + 1000)
+        {
+            bench_fail("cut after %zu bytes: append after recovery lost\n", cut);
+            return;
+        }
+        cases++;
+    }
+    fprintf(stderr, "  %u power cuts over %u appends, all recovered (%u to the append before the cut)\n",
+            cases, APPENDS, rolled_back);
+}
+
+BENCH(journal_wear)
+{
+    SimFlash flash(SECTORS);
+    Journal journal(flash);
+    journal.begin();
+    const uint32_t checkpoints = 100000;
+    for (uint32_t v = 0; v < checkpoints; v++)
+        journal.append(v);
+    double per_erase = (double)checkpoints / flash.erases();
+    fprintf(stderr, "  %u checkpoints, %zu sector erases, %.0f checkpoints per erase\n",
+            checkpoints, flash.erases(), per_erase);
+    // 100,000 erase cycles per sector, spread over both
+    fprintf(stderr, "  flash good for about %.0f million checkpoints\n", per_erase * 100000.0 * SECTORS / 1e6);
+
+    bench_run("Journal::append()", 200000, [&](uint64_t i)
+              { journal.append((uint32_t)i); });
+    bench_run("Journal::begin(), full scan", 2000, [&](uint64_t i)
+              {
+        Journal j(flash);
+        j.begin();
+        bench_keep(j.last()); });
+}
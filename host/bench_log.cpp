@@ -0,0 +1,66 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+
+// C/C++ language includes
+#include <vector>
+
+// RATGDO project includes
+#include "bench.h"
+#include "Packet.h"
+#include "Reader.h"
+
+// Cost of log statements on the Security+2.0 receive path: reader plus decode
+// of one frame.  Run this in both the 'native' (production log level) and
+// 'native_debuglog' environments to see the before and after.  On the host the
+// log sink is printf to /dev/null, on the ESP32 each line also takes a mutex,
+// goes to Serial, the RAM log buffer, SSE clients and syslog, so the real cost
+// of a compiled-in message is considerably higher than measured here.
+
+static void bench_receive_path(const char *label, const std::vector<uint8_t> &frames)
+{
+    SecPlus2Reader reader;
+    bench_run(label, 500000, [&](uint64_t i)
+              {
+        const uint8_t *frame = &frames[(i % 64) * SECPLUS2_CODE_LEN];
+        for (uint8_t n = 0; n < SECPLUS2_CODE_LEN; n++)
+        {
+            if (reader.push_byte(frame[n], 0))
+            {
+                Packet pkt(reader.fetch_buf());
+                bench_keep(pkt);
+            }
+        } });
+}
+
+BENCH(log_receive_path)
+{
+    BenchRandom rnd;
+    std::vector<uint8_t> frames(64 * SECPLUS2_CODE_LEN);
+    for (size_t i = 0; i < 64; i++)
+    {
+        PacketData d;
+        d.type = PacketDataType::Status;
+        d.value.status = StatusCommandData(rnd.next32());
+        Packet pkt(PacketCommand::Status, d, rnd.next32() & 0xFFFFFF);
+        pkt.encode(rnd.next32() & 0xFFFFFFF, &frames[i * SECPLUS2_CODE_LEN]);
+    }
+
+    fprintf(stderr, "  compiled RATGDO_LOG_LEVEL = %d\n", RATGDO_LOG_LEVEL);
+#if RATGDO_LOG_LEVEL >= RATGDO_LOG_DEBUG
+    ratgdoLogLevels.set(NULL, RATGDO_LOG_DEBUG);
+    bench_receive_path("receive+decode, debug logged", frames);
+    ratgdoLogLevels.set(NULL, RATGDO_LOG_INFO);
+    bench_receive_path("receive+decode, debug compiled, runtime off", frames);
+    ratgdoLogLevels.reset();
+#else
+    bench_receive_path("receive+decode, debug compiled out", frames);
+#endif
+}
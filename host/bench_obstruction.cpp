@@ -0,0 +1,383 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+
+// C/C++ language includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+// RATGDO project includes
+#include "bench.h"
+#include "Obstruction.h"
+
+// ObstructionClassifier against pulse trains on the obstruction sensor line,
+// polled every millisecond as the comms loop does.  Each train checks how soon
+// the new state is reported and that nothing else is reported on the way, and
+// the counting every 50ms that the firmware used before is run on the same train
+// for comparison.
+//
+// A train recorded from a real sensor is replayed with
+//
+//   RATGDO_OBST_CAPTURE=edges.txt .pio/build/native/program -v obstruction_capture
+//
+// where each line of edges.txt is the time in microseconds and the level after
+// an edge, "12345 0", as a logic analyser exports them.
+
+static const char *state_name(ObstructionState s)
+{
+    switch (s)
+    {
+    case ObstructionState::Clear:
+        return "clear";
+    case ObstructionState::Obstructed:
+        return "obstructed";
+    case ObstructionState::Asleep:
+        return "asleep";
+    default:
+        return "unknown";
+    }
+}
+
+// Builds a train of edges, time moving forward as it goes
+struct Train
+{
+    std::vector<ObstructionEdge> edges;
+    uint32_t t;
+    uint8_t level;
+
+    explicit Train(uint8_t start_level, uint32_t start_us = 0) : t(start_us), level(start_level) {}
+
+    void set(uint8_t to)
+    {
+        if (to != level)
+            edges.push_back({t, to});
+        level = to;
+    }
+
+    // n pulses low for low_us of every period_us, starting with the fall
+    void pulses(uint32_t n, uint32_t period_us = 7000, uint32_t low_us = 1000)
+    {
+        for (uint32_t i = 0; i < n; i++)
+        {
+            set(0);
+            t += low_us;
+            set(1);
+            t += period_us - low_us;
+        }
+    }
+
+    void hold(uint8_t to, uint32_t us)
+    {
+        set(to);
+        t += us;
+    }
+};
+
+// What the firmware did before: count falling edges, every 50ms more than three
+// is clear, none with the line high and not asleep in the last 700ms is obstructed
+class LegacyObstruction
+{
+public:
+    void edge(uint32_t us, uint8_t level)
+    {
+        if (!level)
+            m_low_count++;
+    }
+
+    ObstructionState poll(uint32_t now, uint8_t level)
+    {
+        uint32_t ms = now / 1000;
+        if (ms - m_last_ms > 50)
+        {
+            if (m_low_count > 3)
+                m_state = ObstructionState::Clear;
+            else if (m_low_count == 0)
+            {
+                if (!level)
+                    m_last_asleep = ms;
+                else if (ms - m_last_asleep > 700)
+                    m_state = ObstructionState::Obstructed;
+            }
+            m_last_ms = ms;
+            m_low_count = 0;
+        }
+        return m_state;
+    }
+
+private:
+    ObstructionState m_state = ObstructionState::Unknown;
+    uint32_t m_low_count = 0;
+    uint32_t m_last_ms = 0;
+    uint32_t m_last_asleep = 0;
+};
+
+struct Change
+{
+    uint32_t at;
+    ObstructionState state;
+};
+
+// Poll every ms from the first edge (or start_us) to end_us, as the comms loop
+// would, feeding edges in as they fall due
+template <typename D>
+static std::vector<Change> run(D &det, const Train &train, uint32_t end_us, uint32_t start_us = 0)
+{
+    std::vector<Change> changes;
+    ObstructionState last = ObstructionState::Unknown;
+    size_t next = 0;
+    uint8_t level = train.edges.empty() ? train.level : !train.edges[0].level;
+    for (uint32_t now = start_us; now <= end_us; now += 1000)
+    {
+        while (next < train.edges.size() && train.edges[next].micros <= now)
+        {
+            det.edge(train.edges[next].micros, train.edges[next].level);
+            level = train.edges[next].level;
+            next++;
+        }
+        ObstructionState s = det.poll(now, level);
+        if (s != last)
+            changes.push_back({now, s});
+        last = s;
+    }
+    return changes;
+}
+
+// Time from `from` to the first report of `want`, or -1
+static double first(const std::vector<Change> &changes, ObstructionState want, uint32_t from)
+{
+    for (const Change &c : changes)
+    {
+        if (c.at >= from && c.state == want)
+            return (c.at - from) / 1000.0;
+    }
+    return -1;
+}
+
+static bool reported(const std::vector<Change> &changes, ObstructionState s, uint32_t from = 0)
+{
+    return first(changes, s, from) >= 0;
+}
+
+static void report(const char *label, double now_ms, double was_ms)
+{
+    char was[32];
+    if (was_ms < 0)
+        snprintf(was, sizeof(was), "never");
+    else
+        snprintf(was, sizeof(was), "%.0f ms", was_ms);
+    fprintf(stderr, "  %-40s %6.0f ms, was %s\n", label, now_ms, was);
+}
+
+// Sensor pulsing, then the beam broken, then clear again
+BENCH(obstruction_transitions)
+{
+    Train train(1);
+    train.pulses(100);
+    uint32_t broken = train.t;
+    train.hold(1, 2000000);
+    uint32_t restored = train.t;
+    train.pulses(100);
+    uint32_t asleep = train.t;
+    train.hold(0, 500000);
+
+    ObstructionClassifier now;
+    LegacyObstruction was;
+    std::vector<Change> c = run(now, train, train.t);
+    std::vector<Change> l = run(was, train, train.t);
+
+    double boot = first(c, ObstructionState::Clear, 0);
+    double obstructed = first(c, ObstructionState::Obstructed, broken);
+    double clear = first(c, ObstructionState::Clear, restored);
+    double sleep = first(c, ObstructionState::Asleep, asleep);
+    report("power up to clear", boot, first(l, ObstructionState::Clear, 0));
+    report("beam broken to obstructed", obstructed, first(l, ObstructionState::Obstructed, broken));
+    report("beam restored to clear", clear, first(l, ObstructionState::Clear, restored));
+    fprintf(stderr, "  %-40s %6.0f ms\n", "pulses stop, line low, to asleep", sleep);
+    fprintf(stderr, "  pulse every %u us, %u%% low\n", now.period_us(), now.duty());
+
+    // a pulse is 7ms, the line must be steady for two before it counts
+    if (boot < 0 || boot > 16)
+        bench_fail("clear %.0f ms after power up\n", boot);
+    if (obstructed < 0 || obstructed > 16)
+        bench_fail("obstruction reported %.0f ms after the beam was broken\n", obstructed);
+    if (clear < 0 || clear > 16)
+        bench_fail("clear reported %.0f ms after the beam was restored\n", clear);
+    if (sleep < 0 || sleep > 16)
+        bench_fail("asleep reported %.0f ms after the pulses stopped\n", sleep);
+    if (now.period_us() != 7000 || now.duty() != 14)
+        bench_fail("measured pulse every %u us %u%% low, expected 7000 us 14%%\n", now.period_us(), now.duty());
+    if (c.size() != 4)
+        bench_fail("%zu state changes, expected 4\n", c.size());
+}
+
+// Asleep, then the sensor wakes, holding the line high for a while before pulsing
+BENCH(obstruction_wake)
+{
+    Train train(0);
+    train.hold(0, 1000000);
+    uint32_t woke = train.t;
+    train.hold(1, 400000);
+    uint32_t pulsing = train.t;
+    train.pulses(50);
+    // and something is in the way when it wakes the next time
+    train.hold(0, 1000000);
+    uint32_t woke_blocked = train.t;
+    train.hold(1, 1000000);
+
+    ObstructionClassifier now;
+    LegacyObstruction was;
+    std::vector<Change> c = run(now, train, train.t);
+    std::vector<Change> l = run(was, train, train.t);
+
+    double clear = first(c, ObstructionState::Clear, pulsing);
+    double blocked = first(c, ObstructionState::Obstructed, woke_blocked);
+    report("waking, pulses start, to clear", clear, first(l, ObstructionState::Clear, pulsing));
+    report("waking with the beam broken to obstructed", blocked, first(l, ObstructionState::Obstructed, woke_blocked));
+    fprintf(stderr, "  obstructed while waking: %s, was %s\n",
+            reported(c, ObstructionState::Obstructed, woke) && first(c, ObstructionState::Obstructed, woke) < (pulsing - woke) / 1000.0 ? "yes" : "no",
+            reported(l, ObstructionState::Obstructed, woke) && first(l, ObstructionState::Obstructed, woke) < (pulsing - woke) / 1000.0 ? "yes" : "no");
+
+    if (first(c, ObstructionState::Obstructed, 0) >= 0 && first(c, ObstructionState::Obstructed, 0) < woke_blocked / 1000.0)
+        bench_fail("obstruction reported while the sensor woke\n");
+    if (clear < 0 || clear > 16)
+        bench_fail("clear %.0f ms after the pulses started\n", clear);
+    if (blocked < ObstructionClassifier::WAKE_US / 1000.0 || blocked > ObstructionClassifier::WAKE_US / 1000.0 + 16)
+        bench_fail("obstruction reported %.0f ms after waking with the beam broken\n", blocked);
+}
+
+// Falling asleep the line sags, the pulses stretch and it ends up low
+BENCH(obstruction_falling_asleep)
+{
+    Train train(1);
+    train.pulses(50);
+    uint32_t sagging = train.t;
+    for (uint32_t low = 1000; low < 7000; low += 250)
+        train.pulses(1, 7000, low);
+    train.hold(0, 500000);
+
+    ObstructionClassifier now;
+    std::vector<Change> c = run(now, train, train.t);
+    fprintf(stderr, "  %u stretched pulses rejected, %s at the end\n", now.bad_pulses(), state_name(now.state()));
+    if (reported(c, ObstructionState::Obstructed, sagging))
+        bench_fail("obstruction reported while the sensor fell asleep\n");
+    if (now.state() != ObstructionState::Asleep)
+        bench_fail("%s after falling asleep\n", state_name(now.state()));
+}
+
+// Pulse period wandering 15% either way and a short glitch now and then, must stay clear
+BENCH(obstruction_noise)
+{
+    BenchRandom rnd;
+    Train train(1);
+    train.pulses(10);
+    uint32_t settled = train.t;
+    for (int i = 0; i < 20000; i++)
+    {
+        uint32_t period = 5950 + rnd.next32() % 2100;
+        train.pulses(1, period, 800 + rnd.next32() % 400);
+        if ((i % 10) == 3)
+        {
+            // 5us spike low in the high part of the pulse
+            train.t -= period / 2;
+            train.hold(0, 5);
+            train.set(1);
+            train.t += period / 2 - 5;
+        }
+    }
+
+    ObstructionClassifier now;
+    std::vector<Change> c = run(now, train, train.t);
+    size_t flips = 0;
+    for (const Change &ch : c)
+        flips += (ch.at > settled);
+    fprintf(stderr, "  %zu pulses with glitches, %u rejected, %zu state changes once clear\n",
+            train.edges.size() / 2, now.bad_pulses(), flips);
+    if (flips)
+        bench_fail("state changed %zu times on a noisy but clear line\n", flips);
+
+    bench_run("ObstructionClassifier::edge()", train.edges.size(), [&](uint64_t i)
+              { now.edge(train.edges[i].micros, train.edges[i].level); });
+}
+
+// The ring between the ISR and the loop keeps order, drops when full, and
+// carries on past its counters wrapping
+BENCH(obstruction_edge_ring)
+{
+    ObstructionEdgeRing<64> ring;
+    for (uint32_t i = 0; i < 100; i++)
+        ring.push(i, i & 1);
+    ObstructionEdge e;
+    uint32_t expect = 0;
+    while (ring.pop(e))
+    {
+        if (e.micros != expect || e.level != (expect & 1))
+        {
+            bench_fail("ring gave edge %u, expected %u\n", e.micros, expect);
+            return;
+        }
+        expect++;
+    }
+    if (expect != 64 || ring.dropped() != 36)
+        bench_fail("ring held %u and dropped %u of 100, expected 64 and 36\n", expect, ring.dropped());
+
+    bench_run("ObstructionEdgeRing push and pop", 5000000, [&](uint64_t i)
+              {
+        ring.push((uint32_t)i, 0);
+        ring.pop(e);
+        bench_keep(e); });
+    if (ring.pop(e) || ring.dropped() != 36)
+        bench_fail("ring not empty after balanced push and pop\n");
+}
+
+BENCH(obstruction_capture)
+{
+    const char *path = getenv("RATGDO_OBST_CAPTURE");
+    if (!path)
+    {
+        fprintf(stderr, "  set RATGDO_OBST_CAPTURE to replay a capture\n");
+        return;
+    }
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        bench_fail("cannot open %s\n", path);
+        return;
+    }
+    Train train(1);
+    unsigned long us;
+    unsigned level;
+    while (fscanf(f, " %lu%*[ ,\t]%u", &us, &level) == 2)
+    {
+        train.t = (uint32_t)us;
+        if (train.edges.empty())
+            train.level = !level;
+        train.set(level ? 1 : 0);
+    }
+    fclose(f);
+    if (train.edges.empty())
+    {
+        bench_fail("no edges in %s\n", path);
+        return;
+    }
+
+    uint32_t start = train.edges.front().micros - train.edges.front().micros % 1000;
+    ObstructionClassifier now;
+    LegacyObstruction was;
+    std::vector<Change> c = run(now, train, train.t + 100000, start);
+    std::vector<Change> l = run(was, train, train.t + 100000, start);
+    fprintf(stderr, "  %zu edges over %.1f s, %u pulses rejected\n", train.edges.size(),
+            (train.t - start) / 1e6, now.bad_pulses());
+    for (const Change &ch : c)
+        fprintf(stderr, "  %10.3f s  %s\n", (ch.at - start) / 1e6, state_name(ch.state));
+    fprintf(stderr, "  counting every 50ms:\n");
+    for (const Change &ch : l)
+        fprintf(stderr, "  %10.3f s  %s\n", (ch.at - start) / 1e6, state_name(ch.state));
+}
@@ -0,0 +1,183 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+
+// C/C++ language includes
+#include <string.h>
+#include <vector>
+
+// RATGDO project includes
+#include "bench.h"
+#include "Reader.h"
+
+// SecPlus2Reader::push_bytes() against one push_byte() call per byte, on
+// synthetic streams.  Frames are random bodies behind a real preamble, the
+// noise between them is unrestricted so it sometimes contains 0x55 and
+// partial preambles.
+
+#define BENCH_FRAMES 1024
+
+static std::vector<uint8_t> bench_stream(uint32_t max_noise, BenchRandom &rnd)
+{
+    std::vector<uint8_t> stream;
+    for (size_t i = 0; i < BENCH_FRAMES; i++)
+    {
+        uint32_t noise = max_noise ? rnd.next32() % (max_noise + 1) : 0;
+        for (uint32_t n = 0; n < noise; n++)
+        {
+            // bias toward preamble bytes to exercise partial matches
+            uint32_t r = rnd.next32();
+            stream.push_back((r & 3) == 0 ? 0x55 : (r & 3) == 1 ? 0x01 : (uint8_t)(r >> 8));
+        }
+        stream.push_back(0x55);
+        stream.push_back(0x01);
+        stream.push_back(0x00);
+        for (size_t n = 3; n < SECPLUS2_CODE_LEN; n++)
+            stream.push_back(rnd.next32() & 0xFE); // body never 0x55, keeps frame count exact
+    }
+    return stream;
+}
+
+// Every frame that push_byte() yields, in order, concatenated.
+static std::vector<uint8_t> frames_by_byte(const std::vector<uint8_t> &stream)
+{
+    SecPlus2Reader reader;
+    std::vector<uint8_t> out;
+    for (uint8_t b : stream)
+    {
+        if (reader.push_byte(b, 0))
+            out.insert(out.end(), reader.fetch_buf(), reader.fetch_buf() + SECPLUS2_CODE_LEN);
+    }
+    return out;
+}
+
+// Same, via push_bytes() in random sized chunks so that preambles and frames
+// straddle buffer boundaries at every offset.
+static std::vector<uint8_t> frames_by_chunk(const std::vector<uint8_t> &stream, BenchRandom &rnd)
+{
+    SecPlus2Reader reader;
+    std::vector<uint8_t> out;
+    size_t pos = 0;
+    while (pos < stream.size())
+    {
+        size_t n = 1 + rnd.next32() % 40;
+        if (n > stream.size() - pos)
+            n = stream.size() - pos;
+        reader.push_bytes(&stream[pos], n, 0, [&](const uint8_t *frame)
+                          { out.insert(out.end(), frame, frame + SECPLUS2_CODE_LEN); });
+        pos += n;
+    }
+    return out;
+}
+
+BENCH(reader_push_bytes)
+{
+    BenchRandom rnd;
+
+    for (uint32_t max_noise : {0, 3, 40})
+    {
+        std::vector<uint8_t> stream = bench_stream(max_noise, rnd);
+        std::vector<uint8_t> expect = frames_by_byte(stream);
+        if (expect.size() < BENCH_FRAMES * SECPLUS2_CODE_LEN || frames_by_chunk(stream, rnd) != expect)
+        {
+            bench_fail("between push_byte() and push_bytes(), noise up to %u\n", max_noise);
+            return;
+        }
+    }
+
+    std::vector<uint8_t> stream = bench_stream(3, rnd);
+    double frame_bytes = (double)stream.size() / BENCH_FRAMES;
+    const uint64_t passes = 200;
+    char label[64];
+
+    SecPlus2Reader reader;
+    double ns = bench_run("push_byte() per byte", passes * stream.size(), [&](uint64_t i)
+                          {
+        bool done = reader.push_byte(stream[i % stream.size()], 0);
+        bench_keep(done); });
+    fprintf(stderr, "  %-44s %10.1f ns/frame\n", "  => per frame", ns * frame_bytes);
+
+    // chunk sizes: one frame, the SoftwareSerial drain buffer, a whole burst
+    for (size_t chunk : {19, 64, 1024})
+    {
+        size_t chunks = (stream.size() + chunk - 1) / chunk;
+        snprintf(label, sizeof(label), "push_bytes() %zu byte chunks", chunk);
+        uint64_t frames = 0;
+        ns = bench_run(label, passes * chunks, [&](uint64_t i)
+                       {
+            size_t pos = (i % chunks) * chunk;
+            size_t n = (pos + chunk > stream.size()) ? stream.size() - pos : chunk;
+            frames += reader.push_bytes(&stream[pos], n, 0, [](const uint8_t *frame)
+                                        { bench_keep(frame); }); });
+        bench_keep(frames);
+        fprintf(stderr, "  %-44s %10.1f ns/frame\n", "  => per frame", ns * chunks / BENCH_FRAMES);
+    }
+}
+
+// Link recovery rather than speed.  One frame in eight loses one to four body
+// bytes, as when the GDO's UART drops a byte on a long noisy wall-control run.
+// Every intact frame must still come out of the reader, whether the damaged
+// frame is followed immediately by the next or the next arrives after a gap.
+BENCH(reader_resync)
+{
+    BenchRandom rnd(0x6A9);
+    std::vector<std::vector<uint8_t>> frames;
+    std::vector<bool> intact;
+    for (size_t i = 0; i < BENCH_FRAMES; i++)
+    {
+        std::vector<uint8_t> frame = {0x55, 0x01, 0x00};
+        for (size_t n = 3; n < SECPLUS2_CODE_LEN; n++)
+            frame.push_back(rnd.next32() & 0xFE);
+        frame[3] = i & 0xFE; // make frames distinguishable
+        frame[4] = (i >> 7) & 0xFE;
+        bool damage = (rnd.next32() % 8) == 0;
+        if (damage)
+        {
+            size_t drop = 1 + rnd.next32() % 4;
+            size_t at = 5 + rnd.next32() % (SECPLUS2_CODE_LEN - 5 - drop);
+            frame.erase(frame.begin() + at, frame.begin() + at + drop);
+        }
+        frames.push_back(frame);
+        intact.push_back(!damage);
+    }
+
+    for (bool gaps : {false, true})
+    {
+        SecPlus2Reader reader;
+        size_t delivered = 0;
+        size_t intact_total = 0;
+        size_t intact_delivered = 0;
+        std::vector<bool> seen(BENCH_FRAMES, false);
+        for (size_t i = 0; i < BENCH_FRAMES; i++)
+        {
+            intact_total += intact[i];
+            // with gaps each frame arrives well after the previous, else all back-to-back
+            uint32_t now = gaps ? i * 10 * SECPLUS2_GAP_TIMEOUT_MS : 0;
+            reader.push_bytes(frames[i].data(), frames[i].size(), now, [&](const uint8_t *frame)
+                              {
+                delivered++;
+                for (size_t f = 0; f < BENCH_FRAMES; f++)
+                {
+                    if (intact[f] && !seen[f] && !memcmp(frame, frames[f].data(), SECPLUS2_CODE_LEN))
+                    {
+                        seen[f] = true;
+                        intact_delivered++;
+                        break;
+                    }
+                } });
+        }
+        fprintf(stderr, "  %-44s %zu/%zu intact, %zu damaged delivered, %u lost, %u resynced\n",
+                gaps ? "frames separated by gaps" : "frames back-to-back",
+                intact_delivered, intact_total, delivered - intact_delivered,
+                reader.lost_count(), reader.resync_count());
+        if (intact_delivered != intact_total)
+            bench_fail("intact frames were lost\n");
+    }
+}
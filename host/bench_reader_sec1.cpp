@@ -0,0 +1,222 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+
+// C/C++ language includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+// RATGDO project includes
+#include "bench.h"
+#include "Reader.h"
+#include "Capture.h"
+#include "Sim.h"
+#include "OpenerSec1.h"
+#include "comms.h"
+
+// SecPlus1Reader framing, and its speed against the reader it replaced on 889LM
+// traffic: a minute of the simulated opener and digital wall panel in host/sim,
+// or a capture from a Security+1.0 ratgdo with
+//
+//   RATGDO_CAPTURE=capture.bin .pio/build/native/program -v reader_sec1
+
+// The reader before SECPLUS1_FRAME_LEN, framing on byte ranges, and timing out
+// a partial message only when the next byte arrives
+class LegacySecPlus1Reader
+{
+private:
+    bool m_is_reading = false;
+    uint8_t m_byte_count = 0;
+    uint8_t m_rx_buf[SECPLUS1_MSG_LEN] = {0};
+    uint32_t m_last_byte_at = 0;
+    uint32_t m_lost_count = 0;
+
+public:
+    bool push_byte(uint8_t inp, uint32_t now)
+    {
+        if (m_is_reading && (now - m_last_byte_at) > SECPLUS1_GAP_TIMEOUT_MS)
+        {
+            m_is_reading = false;
+            m_lost_count++;
+        }
+        m_last_byte_at = now;
+
+        if (m_is_reading)
+        {
+            m_rx_buf[m_byte_count++] = inp;
+            if (m_byte_count < SECPLUS1_MSG_LEN)
+                return false;
+            m_is_reading = false;
+            return true;
+        }
+
+        if (inp < SECPLUS1_FIRST_CODE || inp > SECPLUS1_LAST_CODE)
+            return false;
+        m_rx_buf[0] = inp;
+        m_byte_count = 1;
+        if (inp <= SECPLUS1_LAST_BUTTON)
+        {
+            m_rx_buf[1] = 0;
+            return true;
+        }
+        m_is_reading = true;
+        return false;
+    }
+
+    const uint8_t *fetch_buf(void) const { return m_rx_buf; }
+    uint32_t lost_count(void) const { return m_lost_count; }
+};
+
+struct Sec1Byte
+{
+    uint8_t byte;
+    uint32_t ms;
+};
+
+// What ratgdo hears of an 889LM and wall panel for a minute after power up
+static std::vector<Sec1Byte> record_889lm(void)
+{
+    std::vector<Sec1Byte> traffic;
+    sim::reset();
+    sim::attach(new SimOpenerSec1(SimOpenerSec1::Config()));
+    sim::attach(new SimWallPanelSec1(SimWallPanelSec1::Config()));
+    gdo_bus.begin(1200, BusParity::Even);
+    sim::loop_until([&]
+                    {
+        while (gdo_bus.available())
+            traffic.push_back({(uint8_t)gdo_bus.read(), (uint32_t)(sim::now_us() / 1000)}); },
+                    []
+                    { return false; }, 60000000, 1000);
+    return traffic;
+}
+
+static bool load_capture(const char *path, std::vector<Sec1Byte> &traffic)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    std::vector<uint8_t> file;
+    int c;
+    while ((c = fgetc(f)) != EOF)
+        file.push_back((uint8_t)c);
+    fclose(f);
+    BusCaptureHeader hdr;
+    const BusCaptureRecord *rec = bus_capture_parse(file.data(), file.size(), hdr);
+    if (!rec || hdr.protocol != 1)
+        return false;
+    for (uint32_t i = 0; i < hdr.count; i++)
+    {
+        if (rec[i].dir == BUS_CAPTURE_RX)
+            traffic.push_back({rec[i].byte, rec[i].micros / 1000});
+    }
+    return true;
+}
+
+BENCH(reader_sec1_framing)
+{
+    // every byte starts a message of the length the table says, or none
+    for (int b = 0; b < 256; b++)
+    {
+        SecPlus1Reader reader;
+        uint8_t len = secplus1_frame_len((uint8_t)b);
+        bool done = reader.push_byte((uint8_t)b, 0);
+        if (len == 1 && !(done && reader.fetch_buf()[0] == b && reader.fetch_buf()[1] == 0))
+            bench_fail("button 0x%02X not a message on its own\n", b);
+        if (len == 2 && (done || !reader.pending() || !reader.push_byte(0x55, 5) || reader.fetch_buf()[1] != 0x55))
+            bench_fail("poll 0x%02X not a message with its reply\n", b);
+        if (len == 0 && (done || reader.pending()))
+            bench_fail("0x%02X started a message\n", b);
+    }
+
+    // a poll with no reply goes at the timeout, without another byte to prompt it
+    SecPlus1Reader reader;
+    reader.push_byte(0x38, 1000);
+    if (reader.expire(1000 + SECPLUS1_GAP_TIMEOUT_MS) || !reader.pending())
+        bench_fail("partial message expired early\n");
+    if (!reader.expire(1001 + SECPLUS1_GAP_TIMEOUT_MS) || reader.pending() || reader.lost_count() != 1)
+        bench_fail("partial message did not expire\n");
+    // the byte after an overdue reply starts a message, as a late reply would not
+    reader.push_byte(0x3A, 2000);
+    if (reader.push_byte(0x39, 2000 + SECPLUS1_GAP_TIMEOUT_MS + 1) || reader.fetch_buf()[0] != 0x39 ||
+        reader.lost_count() != 2)
+        bench_fail("late reply taken as one\n");
+    if (!reader.push_byte(0x00, 2000 + 2 * SECPLUS1_GAP_TIMEOUT_MS) || reader.fetch_buf()[1] != 0x00)
+        bench_fail("reply at the timeout not taken\n");
+}
+
+BENCH(reader_sec1)
+{
+    std::vector<Sec1Byte> traffic;
+    const char *path = getenv("RATGDO_CAPTURE");
+    if (path)
+    {
+        if (!load_capture(path, traffic))
+        {
+            bench_fail("%s is not a Security+1.0 capture\n", path);
+            return;
+        }
+    }
+    else
+    {
+        traffic = record_889lm();
+    }
+    if (traffic.empty())
+    {
+        bench_fail("no traffic\n");
+        return;
+    }
+
+    // both readers agree message for message
+    SecPlus1Reader reader;
+    LegacySecPlus1Reader legacy;
+    uint32_t messages = 0, by_key[SECPLUS1_LAST_CODE - SECPLUS1_FIRST_CODE + 1] = {};
+    for (size_t i = 0; i < traffic.size(); i++)
+    {
+        const Sec1Byte &b = traffic[i];
+        bool got = reader.push_byte(b.byte, b.ms);
+        if (got != legacy.push_byte(b.byte, b.ms) ||
+            (got && (reader.fetch_buf()[0] != legacy.fetch_buf()[0] || reader.fetch_buf()[1] != legacy.fetch_buf()[1])))
+        {
+            bench_fail("readers differ at byte %zu\n", i);
+            break;
+        }
+        if (got)
+        {
+            messages++;
+            by_key[reader.fetch_buf()[0] - SECPLUS1_FIRST_CODE]++;
+        }
+    }
+    fprintf(stderr, "  %zu bytes over %.1f s, %u messages, %u partial thrown away\n", traffic.size(),
+            (traffic.back().ms - traffic.front().ms) / 1000.0, messages, reader.lost_count());
+    fprintf(stderr, "  door/obstruction/light and lock polls %u/%u/%u, buttons %u\n", by_key[8], by_key[9], by_key[10],
+            messages - by_key[8] - by_key[9] - by_key[10]);
+    if (!path && messages < traffic.size() / 3)
+        bench_fail("only %u messages from %zu bytes\n", messages, traffic.size());
+
+    // a pass over the traffic per op, so that picking the byte costs no division;
+    // timestamps keep rising across passes
+    size_t n = traffic.size();
+    uint32_t span = traffic.back().ms - traffic.front().ms + 1000;
+    uint64_t passes = 20000000 / n;
+    SecPlus1Reader r;
+    double ns = bench_run("SecPlus1Reader::push_byte() pass", passes, [&](uint64_t i)
+                          {
+        uint32_t base = (uint32_t)i * span;
+        for (const Sec1Byte &b : traffic)
+            bench_keep(r.push_byte(b.byte, b.ms + base)); });
+    LegacySecPlus1Reader l;
+    double legacy_ns = bench_run("legacy push_byte() pass", passes, [&](uint64_t i)
+                                 {
+        uint32_t base = (uint32_t)i * span;
+        for (const Sec1Byte &b : traffic)
+            bench_keep(l.push_byte(b.byte, b.ms + base)); });
+    fprintf(stderr, "  %.2f ns/byte, %.2fx legacy\n", ns / n, legacy_ns / ns);
+}
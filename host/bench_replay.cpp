@@ -0,0 +1,340 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+
+// C/C++ language includes
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// RATGDO project includes
+#include "bench.h"
+#include "Packet.h"
+#include "Reader.h"
+#include "Capture.h"
+
+// Replay a bus capture downloaded from /capture.bin through the same readers and
+// decoder as the firmware, report what it contained and time decoding it.
+//
+//   RATGDO_CAPTURE=capture.bin .pio/build/native/program -v replay
+//
+// With -v every decoded packet is logged as the firmware would.  Without
+// RATGDO_CAPTURE a synthetic capture is built and replayed instead, which also
+// checks the capture file format round trip.  Only received bytes are replayed,
+// on Sec+2.0 our own transmissions are also received as an echo.
+
+// Microsecond timestamps wrap every 71 minutes, keep a 64-bit running clock
+struct ReplayClock
+{
+    uint64_t us = 0;
+    uint32_t last = 0;
+    bool started = false;
+
+    uint32_t ms(uint32_t stamp)
+    {
+        if (started)
+            us += (uint32_t)(stamp - last);
+        started = true;
+        last = stamp;
+        return (uint32_t)(us / 1000);
+    }
+};
+
+struct ReplayStats
+{
+    uint32_t rx_bytes = 0;
+    uint32_t tx_bytes = 0;
+    uint32_t messages = 0;
+    uint32_t valid = 0;
+    uint32_t rejected = 0;
+    uint32_t lost = 0;
+    uint32_t resynced = 0;
+    uint32_t by_type[256] = {0}; // Sec+1.0 key, or Sec+2.0 index in PACKET_COMMANDS
+};
+
+static ReplayStats replay_sec2(const BusCaptureRecord *rec, uint32_t count, bool log)
+{
+    ReplayStats st;
+    SecPlus2Reader reader;
+    ReplayClock clock;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (rec[i].dir != BUS_CAPTURE_RX)
+        {
+            st.tx_bytes++;
+            continue;
+        }
+        st.rx_bytes++;
+        if (!reader.push_byte(rec[i].byte, clock.ms(rec[i].micros)))
+            continue;
+        Packet pkt(reader.fetch_buf());
+        st.messages++;
+        // same test as comms_loop_sec2()
+        if (!pkt.valid())
+        {
+            st.rejected++;
+            continue;
+        }
+        st.valid++;
+        st.by_type[&packet_command_info(pkt.m_pkt_cmd) - PACKET_COMMANDS]++;
+        if (log)
+            pkt.print();
+    }
+    st.lost = reader.lost_count();
+    st.resynced = reader.resync_count();
+    return st;
+}
+
+static ReplayStats replay_sec1(const BusCaptureRecord *rec, uint32_t count, bool log)
+{
+    ReplayStats st;
+    SecPlus1Reader reader;
+    ReplayClock clock;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (rec[i].dir != BUS_CAPTURE_RX)
+        {
+            st.tx_bytes++;
+            continue;
+        }
+        st.rx_bytes++;
+        if (!reader.push_byte(rec[i].byte, clock.ms(rec[i].micros)))
+            continue;
+        const uint8_t *msg = reader.fetch_buf();
+        st.messages++;
+        st.valid++;
+        st.by_type[msg[0]]++;
+        if (log)
+            printf("SEC1 RX %02X %02X\n", msg[0], msg[1]);
+    }
+    st.lost = reader.lost_count();
+    return st;
+}
+
+static ReplayStats replay(const BusCaptureHeader &hdr, const BusCaptureRecord *rec, bool log = false)
+{
+    return (hdr.protocol == 1) ? replay_sec1(rec, hdr.count, log) : replay_sec2(rec, hdr.count, log);
+}
+
+static void replay_report(const BusCaptureHeader &hdr, const BusCaptureRecord *rec)
+{
+    ReplayStats st = replay(hdr, rec, true);
+    double seconds = hdr.count ? (double)(uint32_t)(rec[hdr.count - 1].micros - rec[0].micros) / 1e6 : 0;
+    fprintf(stderr, "  Sec+%s capture, %u records (%u dropped), %.1f s of traffic\n",
+            (hdr.protocol == 1) ? "1.0" : "2.0", hdr.count, hdr.dropped, seconds);
+    fprintf(stderr, "  %u bytes rx, %u bytes tx, %u messages, %u valid, %u rejected, %u lost, %u resynced\n",
+            st.rx_bytes, st.tx_bytes, st.messages, st.valid, st.rejected, st.lost, st.resynced);
+    for (int t = 0; t < 256; t++)
+    {
+        if (!st.by_type[t])
+            continue;
+        if (hdr.protocol == 1)
+            fprintf(stderr, "    0x%02X %8u\n", t, st.by_type[t]);
+        else
+            fprintf(stderr, "    %-20s %8u\n", PACKET_COMMANDS[t].name, st.by_type[t]);
+    }
+    if (!st.messages)
+        return;
+
+    // whole capture per op, so ns/op divided by the message count is the host cost
+    // of getting one message from bytes to a decoded packet
+    double ns = bench_run("replay whole capture", 200, [&](uint64_t)
+                          { ReplayStats s = replay(hdr, rec); bench_keep(s); });
+    fprintf(stderr, "  %-44s %10.1f ns/message %8.1f ns/byte\n", "replay",
+            ns / st.messages, ns / (st.rx_bytes ? st.rx_bytes : 1));
+}
+
+// Bytes at 9600 baud (Sec+2.0) or 1200 baud (Sec+1.0) are about 1ms or 8ms apart
+static void synth_bytes(BusCapture &cap, uint32_t &now, const uint8_t *buf, size_t len,
+                        BusCaptureDir dir, uint32_t byte_us)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        cap.record(&buf[i], 1, dir, now);
+        now += byte_us;
+    }
+}
+
+static std::vector<uint8_t> synth_file(const BusCapture &cap)
+{
+    BusCaptureHeader hdr = cap.header();
+    std::vector<uint8_t> file((const uint8_t *)&hdr, (const uint8_t *)&hdr + sizeof(hdr));
+    cap.for_each_span([&](const uint8_t *buf, size_t len)
+                      { file.insert(file.end(), buf, buf + len); });
+    return file;
+}
+
+// Status polls and replies with door commands mixed in, one frame in 16 loses a byte
+static std::vector<uint8_t> synth_sec2(uint32_t &expect_valid)
+{
+    BusCapture cap;
+    BenchRandom rnd;
+    uint32_t now = 0xFFF00000; // wraps part way through
+    uint32_t rolling = 0x1000;
+    cap.start(2, 16384);
+    expect_valid = 0;
+    for (int i = 0; i < 400; i++)
+    {
+        PacketData d = {};
+        PacketCommand cmd = PacketCommand::GetStatus;
+        d.type = PacketDataType::NoData;
+        if (i & 1)
+        {
+            cmd = PacketCommand::Status;
+            d.type = PacketDataType::Status;
+            d.value.status = StatusCommandData(rnd.next32());
+        }
+        else if ((i % 10) == 4)
+        {
+            cmd = PacketCommand::DoorAction;
+            d.type = PacketDataType::DoorAction;
+            d.value.door_action.action = DoorAction::Toggle;
+            d.value.door_action.pressed = true;
+            d.value.door_action.id = 1;
+        }
+        Packet pkt(cmd, d, 0x539);
+        uint8_t frame[SECPLUS2_CODE_LEN];
+        pkt.encode(rolling++, frame);
+
+        if ((i % 16) == 7)
+        {
+            // byte lost in the UART, the rest of the frame arrives late and is abandoned
+            synth_bytes(cap, now, frame, 10, BUS_CAPTURE_RX, 1042);
+            now += 150000;
+            synth_bytes(cap, now, frame + 11, SECPLUS2_CODE_LEN - 11, BUS_CAPTURE_RX, 1042);
+        }
+        else
+        {
+            if (!(i & 1))
+                synth_bytes(cap, now, frame, sizeof(frame), BUS_CAPTURE_TX, 0);
+            synth_bytes(cap, now, frame, sizeof(frame), BUS_CAPTURE_RX, 1042);
+            expect_valid += Packet(frame).valid();
+        }
+        now += 20000 + rnd.next32() % 200000;
+    }
+    return synth_file(cap);
+}
+
+// Wall panel polls 0x38-0x3A every 250ms and the opener replies, with presses,
+// releases and line noise in between.  One reply in 32 never comes.
+static std::vector<uint8_t> synth_sec1(uint32_t &expect_valid)
+{
+    static const uint8_t replies[] = {0x55, 0x00, 0x54};
+    BusCapture cap;
+    BenchRandom rnd;
+    uint32_t now = 0;
+    cap.start(1, 16384);
+    expect_valid = 0;
+    for (int i = 0; i < 600; i++)
+    {
+        uint8_t poll = 0x38 + (i % 3);
+        synth_bytes(cap, now, &poll, 1, BUS_CAPTURE_RX, 8333);
+        if ((i % 32) != 31)
+        {
+            now += 5000;
+            synth_bytes(cap, now, &replies[i % 3], 1, BUS_CAPTURE_RX, 8333);
+            expect_valid++;
+        }
+        now += 250000;
+        if ((i % 20) == 10)
+        {
+            uint8_t press[] = {0x30, 0x31};
+            synth_bytes(cap, now, press, 1, BUS_CAPTURE_RX, 8333);
+            now += 300000;
+            synth_bytes(cap, now, press + 1, 1, BUS_CAPTURE_RX, 8333);
+            expect_valid += 2;
+        }
+        if ((i % 50) == 25)
+        {
+            uint8_t noise = 0xFF;
+            synth_bytes(cap, now, &noise, 1, BUS_CAPTURE_RX, 8333);
+        }
+    }
+    return synth_file(cap);
+}
+
+static void replay_check(const char *label, const std::vector<uint8_t> &file, uint32_t expect_valid)
+{
+    BusCaptureHeader hdr;
+    const BusCaptureRecord *rec = bus_capture_parse(file.data(), file.size(), hdr);
+    if (!rec)
+    {
+        bench_fail("%s: synthetic capture did not parse\n", label);
+        return;
+    }
+    ReplayStats st = replay(hdr, rec);
+    if (st.valid != expect_valid)
+        bench_fail("%s: %u valid messages, expected %u\n", label, st.valid, expect_valid);
+    replay_report(hdr, rec);
+}
+
+static void ring_check(void)
+{
+    BusCapture cap;
+    cap.start(2, 8);
+    for (uint8_t b = 0; b < 20; b++)
+        cap.record(&b, 1, BUS_CAPTURE_RX, b);
+    std::vector<uint8_t> file = synth_file(cap);
+    BusCaptureHeader hdr;
+    const BusCaptureRecord *rec = bus_capture_parse(file.data(), file.size(), hdr);
+    if (!rec || hdr.count != 8 || hdr.dropped != 12)
+    {
+        bench_fail("capture ring: bad header after wrap\n");
+        return;
+    }
+    for (uint32_t i = 0; i < hdr.count; i++)
+    {
+        if (rec[i].byte != 12 + i || rec[i].micros != 12 + i)
+            bench_fail("capture ring: record %u is %u, expected %u\n", i, rec[i].byte, 12 + i);
+    }
+    if (bus_capture_parse(file.data(), file.size() - 1, hdr))
+        bench_fail("capture ring: truncated file accepted\n");
+    // a size whose byte count wraps is refused, not allocated short
+    if (cap.start(2, SIZE_MAX / sizeof(BusCaptureRecord) + 1) || cap.start(2, 0) || cap.running())
+        bench_fail("capture ring: impossible size accepted\n");
+}
+
+BENCH(replay)
+{
+    const char *path = getenv("RATGDO_CAPTURE");
+    if (!path)
+    {
+        uint32_t expect;
+        ring_check();
+        std::vector<uint8_t> sec2 = synth_sec2(expect);
+        replay_check("synthetic sec2", sec2, expect);
+        std::vector<uint8_t> sec1 = synth_sec1(expect);
+        replay_check("synthetic sec1", sec1, expect);
+        return;
+    }
+
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        bench_fail("cannot open %s\n", path);
+        return;
+    }
+    std::vector<uint8_t> file;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        file.insert(file.end(), buf, buf + n);
+    fclose(f);
+
+    BusCaptureHeader hdr;
+    const BusCaptureRecord *rec = bus_capture_parse(file.data(), file.size(), hdr);
+    if (!rec)
+    {
+        bench_fail("%s is not a bus capture\n", path);
+        return;
+    }
+    fprintf(stderr, "  %s\n", path);
+    replay_report(hdr, rec);
+}
@@ -0,0 +1,207 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+
+// C/C++ language includes
+#include <stdio.h>
+
+// RATGDO project includes
+#include "bench.h"
+#include "Sim.h"
+#include "OpenerSec1.h"
+#include "OpenerSec2.h"
+#include "ratgdo.h"
+#include "comms.h"
+#include "config.h"
+
+// Protocol detection on first boot, src/comms.cpp against each kind of opener in
+// host/sim, with GDOSecurityType left at its default of Security+2.0.  Checks
+// what is found, whether it restarts to change the setting, and that the
+// firmware sends nothing and never asserts TX until it knows.
+
+// host/sim/firmware.cpp
+extern bool sim_restart_requested;
+
+static const uint64_t DETECT_TIMEOUT_US = 30000000;
+
+// Sent by the firmware up to the loop that finished detecting
+static uint32_t sent_detecting;
+
+// First boot, with nothing in NVRAM.  Returns time to detection done, calling
+// during() every loop until then.
+template <typename F>
+static uint64_t first_boot(F &&during)
+{
+    doorControlType = 0;
+    setup_comms();
+    uint64_t start = sim::now_us();
+    uint64_t t = sim::loop_until([&]
+                                 {
+        during(sim::now_us() - start);
+        sent_detecting = sim::stats().firmware_tx;
+        comms_loop(); }, []
+                                 { return protocol_detector.done(); }, DETECT_TIMEOUT_US, 1000);
+    return (t == sim::NEVER) ? t : sim::now_us() - start;
+}
+
+static uint64_t first_boot(void)
+{
+    return first_boot([](uint64_t) {});
+}
+
+static void report(const char *what, uint64_t t)
+{
+    if (t == sim::NEVER)
+        fprintf(stderr, "  %-32s still listening after %.0f s, sent %u\n", what, DETECT_TIMEOUT_US / 1e6,
+                sent_detecting);
+    else
+        fprintf(stderr, "  %-32s %-14s in %6.1f s, sent %u%s\n", what,
+                ProtocolDetector::name(protocol_detector.result()), t / 1e6, sent_detecting,
+                sim_restart_requested ? ", restarting" : "");
+}
+
+// Unknown for still listening
+static void expect(GdoProtocol found, bool restart, uint32_t gdo_type)
+{
+    GdoProtocol got = protocol_detector.done() ? protocol_detector.result() : GdoProtocol::Unknown;
+    if (got != found)
+        bench_fail("detected %s, expected %s\n", ProtocolDetector::name(got), ProtocolDetector::name(found));
+    if (sim_restart_requested != restart)
+        bench_fail("restart %s\n", restart ? "not requested" : "requested");
+    bool remembered = nvRam->read(nvram_protocol_set) != 0;
+    if (remembered != (found != GdoProtocol::Unknown))
+        bench_fail("detection %s for next boot\n", remembered ? "remembered" : "not remembered");
+    if (userConfig->getGDOSecurityType() != (int)gdo_type)
+        bench_fail("GDOSecurityType is %d\n", userConfig->getGDOSecurityType());
+}
+
+static void expect_silent(void)
+{
+    if (sent_detecting)
+        bench_fail("firmware sent %u before knowing the protocol\n", sent_detecting);
+}
+
+static void scenario_sec2(void)
+{
+    sim::reset();
+    SimOpenerSec2 *opener = new SimOpenerSec2(SimOpenerSec2::Config());
+    sim::attach(opener);
+    // says nothing until its door is moved
+    uint64_t t = first_boot([&](uint64_t since)
+                            { if (since == 5000000) opener->press_button(); });
+    report("Security+2.0, remote at 5s", t);
+    expect(GdoProtocol::SecPlus2, false, 2);
+    expect_silent();
+    // carries on as Security+2.0 without a restart
+    if (sim::loop_until(comms_loop, []
+                        { return garage_door.active; }, DETECT_TIMEOUT_US, 1000) == sim::NEVER)
+        bench_fail("no status after detection\n");
+}
+
+static void scenario_sec1(bool panel)
+{
+    sim::reset();
+    SimOpenerSec1 *opener = new SimOpenerSec1(SimOpenerSec1::Config());
+    sim::attach(opener);
+    if (panel)
+        sim::attach(new SimWallPanelSec1(SimWallPanelSec1::Config()));
+    uint64_t t = first_boot();
+    report(panel ? "Security+1.0, wall panel" : "Security+1.0 opener", t);
+    expect(GdoProtocol::SecPlus1, true, 1);
+    expect_silent();
+    if (opener->presses() || opener->openings())
+        bench_fail("opener saw %u button presses\n", opener->presses());
+}
+
+static void scenario_sec1_alone(void)
+{
+    scenario_sec1(false);
+}
+
+static void scenario_sec1_panel(void)
+{
+    scenario_sec1(true);
+}
+
+static void scenario_drycontact(void)
+{
+    sim::reset();
+    sim::set_limit_switch(true);
+    uint64_t t = first_boot();
+    report("Dry contact, door closed", t);
+    expect(GdoProtocol::DryContact, true, 3);
+    expect_silent();
+}
+
+static void scenario_drycontact_moving(void)
+{
+    sim::reset();
+    // reaches its limit switch 10s after power up
+    uint64_t t = first_boot([](uint64_t since)
+                            { sim::set_limit_switch(since >= 10000000); });
+    report("Dry contact, door moving", t);
+    expect(GdoProtocol::DryContact, true, 3);
+    expect_silent();
+    if (t != sim::NEVER && t < 10000000)
+        bench_fail("dry contact decided before the door stopped\n");
+}
+
+static void scenario_drycontact_no_limits(void)
+{
+    sim::reset();
+    uint64_t t = first_boot();
+    report("Dry contact, no limit switch", t);
+    expect(GdoProtocol::Unknown, false, 2);
+    expect_silent();
+}
+
+static void scenario_set_by_hand(void)
+{
+    sim::reset();
+    SimOpenerSec1 *opener = new SimOpenerSec1(SimOpenerSec1::Config());
+    sim::attach(opener);
+    // chosen while still detecting, which wins, and whatever is saved for it stays
+    uint64_t t = first_boot([](uint64_t since)
+                            {
+        if (since == 100000)
+        {
+            userConfig->set(cfg_GDOSecurityType, 2);
+            nvRam->write(nvram_id_code, 0x2A5539);
+        } });
+    report("Security+2.0 chosen, hears 1.0", t);
+    expect(GdoProtocol::SecPlus1, false, 2);
+    if (nvRam->read(nvram_id_code) != 0x2A5539)
+        bench_fail("client ID reset\n");
+}
+
+static void scenario_upgrade(void)
+{
+    sim::reset();
+    // from firmware before detection, paired with a Security+2.0 opener
+    nvRam->write(nvram_id_code, 0x2A5539);
+    nvRam->write(nvram_rolling, 0x4000);
+    doorControlType = 0;
+    setup_comms();
+    fprintf(stderr, "  %-32s %s\n", "Upgraded, id and rolling code",
+            protocol_detector.listening() == GdoProtocol::Unknown ? "not detecting" : "detecting");
+    if (protocol_detector.listening() != GdoProtocol::Unknown || doorControlType != 2)
+        bench_fail("detecting on a device already set up\n");
+    if (!nvRam->read(nvram_protocol_set))
+        bench_fail("protocol_set not migrated\n");
+}
+
+BENCH(sim_detect)
+{
+    if (!sim::isolated(scenario_sec2) || !sim::isolated(scenario_sec1_alone) ||
+        !sim::isolated(scenario_sec1_panel) || !sim::isolated(scenario_drycontact) ||
+        !sim::isolated(scenario_drycontact_moving) || !sim::isolated(scenario_drycontact_no_limits) ||
+        !sim::isolated(scenario_set_by_hand) || !sim::isolated(scenario_upgrade))
+        bench_fail("sim_detect\n");
+}
@@ -0,0 +1,291 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+
+// C/C++ language includes
+#include <string>
+
+// RATGDO project includes
+#include "bench.h"
+#include "Sim.h"
+#include "OpenerSec1.h"
+#include "ratgdo.h"
+#include "comms.h"
+
+// End to end timing of the Security+1.0 side of src/comms.cpp against the
+// simulated 889LM style opener in host/sim, with and without a digital wall panel.
+// Wall panel detection waits 15s after the first byte is heard and emulation then
+// polls every 250ms, button presses are held 250ms (3000ms for lock) and followed
+// by two releases 40ms apart; the numbers here show what each of those costs.
+// Each case runs at a 1ms and a 20ms loop() period, and as the comms task.  Times are simulated so
+// they repeat exactly.  Run with -v to see the firmware's log.
+
+// comms.cpp internals looked at here
+extern bool wallPanelDetected;
+extern SecPlus1Reader sec1_reader;
+
+static const uint64_t BOOT_TIMEOUT_US = 60000000;
+static const uint64_t CMD_TIMEOUT_US = 10000000;
+
+static SimOpenerSec1 *opener;
+// loop() period, or 0 to run comms as its own task
+static uint32_t loop_us = 1000;
+
+template <typename D>
+static uint64_t run_comms(D &&done, uint64_t timeout_us)
+{
+    if (!loop_us)
+        return sim::task_until(comms_task_step, done, timeout_us);
+    return sim::loop_until(comms_loop, done, timeout_us, loop_us);
+}
+
+static bool boot(bool panel, sim::Latency &detected, sim::Latency &first_status,
+                 SimOpenerSec1::Config cfg = SimOpenerSec1::Config())
+{
+    sim::reset();
+    cfg.travel_ms = 10000;
+    opener = new SimOpenerSec1(cfg);
+    sim::attach(opener);
+    if (panel)
+        sim::attach(new SimWallPanelSec1(SimWallPanelSec1::Config()));
+
+    doorControlType = 1;
+    setup_comms();
+
+    uint64_t t_detected = sim::NEVER;
+    uint64_t t_status = sim::NEVER;
+    run_comms([&]
+              {
+        if (t_detected == sim::NEVER && wallPanelDetected)
+            t_detected = sim::now_us();
+        if (t_status == sim::NEVER && garage_door.active)
+            t_status = sim::now_us();
+        return garage_door.active && (!panel || wallPanelDetected); }, BOOT_TIMEOUT_US);
+    if (panel)
+        detected.add(t_detected);
+    first_status.add(t_status);
+    return garage_door.active;
+}
+
+// Latency of one command to the opener acting on it, HomeKit state catching up
+// with it, and the firmware having sent every byte queued for it
+struct Command
+{
+    sim::Latency acted;
+    sim::Latency reflected;
+    sim::Latency drained;
+
+    template <typename A, typename R>
+    void run(A &&at_opener, R &&in_homekit)
+    {
+        uint64_t start = sim::now_us();
+        uint64_t t_acted = sim::NEVER, t_reflected = sim::NEVER, t_drained = sim::NEVER;
+        run_comms([&]
+                  {
+            uint64_t t = sim::now_us() - start;
+            if (t_acted == sim::NEVER && at_opener())
+                t_acted = t;
+            if (t_reflected == sim::NEVER && in_homekit())
+                t_reflected = t;
+            if (t_drained == sim::NEVER && t_acted != sim::NEVER && !tx_scheduler.depth())
+                t_drained = t;
+            return t_acted != sim::NEVER && t_reflected != sim::NEVER && t_drained != sim::NEVER; }, CMD_TIMEOUT_US);
+        acted.add(t_acted);
+        reflected.add(t_reflected);
+        drained.add(t_drained);
+    }
+
+    void report(const std::string &what) const
+    {
+        acted.report((what + " to opener").c_str());
+        reflected.report((what + " to HomeKit").c_str());
+        drained.report((what + " to queue drained").c_str());
+    }
+};
+
+static void scenario(bool panel, uint32_t period_us)
+{
+    loop_us = period_us;
+    if (loop_us)
+        fprintf(stderr, "  %s, loop() every %u us\n", panel ? "wall panel" : "no wall panel", loop_us);
+    else
+        fprintf(stderr, "  %s, comms task\n", panel ? "wall panel" : "no wall panel");
+
+    sim::Latency detected, first_status;
+    if (!boot(panel, detected, first_status))
+    {
+        first_status.report("power up to door state");
+        bench_fail("no door state after boot\n");
+        return;
+    }
+
+    Command open, close, light_on, light_off, lock_on, lock_off;
+    sim::Latency travel;
+    for (int i = 0; i < 3; i++)
+    {
+        open_door();
+        open.run([]
+                 { return opener->door() == DoorState::Opening; }, []
+                 { return garage_door.current_state == CURR_OPENING; });
+        travel.add(run_comms([]
+                             { return garage_door.current_state == CURR_OPEN; }, CMD_TIMEOUT_US + 10000000));
+        close_door();
+        close.run([]
+                  { return opener->door() == DoorState::Closing; }, []
+                  { return garage_door.current_state == CURR_CLOSING; });
+        run_comms([]
+                  { return garage_door.current_state == CURR_CLOSED; }, CMD_TIMEOUT_US + 10000000);
+        set_light(true);
+        light_on.run([]
+                     { return opener->light(); }, []
+                     { return garage_door.light; });
+        set_light(false);
+        light_off.run([]
+                      { return !opener->light(); }, []
+                      { return !garage_door.light; });
+        set_lock(1);
+        lock_on.run([]
+                    { return opener->lock(); }, []
+                    { return garage_door.current_lock == CURR_LOCKED; });
+        set_lock(0);
+        lock_off.run([]
+                     { return !opener->lock(); }, []
+                     { return garage_door.current_lock == CURR_UNLOCKED; });
+    }
+
+    if (panel)
+        detected.report("power up to wall panel detected");
+    first_status.report("power up to door state");
+    open.report("open_door()");
+    travel.report("Opening to Open (10s travel)");
+    close.report("close_door()");
+    light_on.report("set_light(true)");
+    light_off.report("set_light(false)");
+    lock_on.report("set_lock(1)");
+    lock_off.report("set_lock(0)");
+    sim::Stats &st = sim::stats();
+    fprintf(stderr, "  opener polled %u times, %u button presses; bus %u bytes, %u collisions\n",
+            opener->polls(), opener->presses(), st.bus_bytes, st.collisions);
+    fprintf(stderr, "  queue peak %zu, dropped %u, coalesced %u, retries %u; reader lost %u\n",
+            tx_scheduler.high_water(), tx_scheduler.dropped(), tx_scheduler.coalesced(), tx_scheduler.retries(),
+            sec1_reader.lost_count());
+
+    if (panel && !wallPanelDetected)
+        bench_fail("wall panel not detected\n");
+    if (opener->openings() != 3 || opener->door() != DoorState::Closed)
+        bench_fail("opener door not cycled 3 times (%u openings)\n", opener->openings());
+}
+
+static void scenario_panel_fast(void)
+{
+    scenario(true, 1000);
+}
+
+static void scenario_panel_slow(void)
+{
+    scenario(true, 20000);
+}
+
+static void scenario_emulated_fast(void)
+{
+    scenario(false, 1000);
+}
+
+static void scenario_emulated_slow(void)
+{
+    scenario(false, 20000);
+}
+
+static void scenario_panel_task(void)
+{
+    scenario(true, 0);
+}
+
+static void scenario_emulated_task(void)
+{
+    scenario(false, 0);
+}
+
+// Light and lock asked for together, each done once the opener's status shows it
+static void light_and_lock(uint32_t lock_hold_ms)
+{
+    SimOpenerSec1::Config cfg;
+    cfg.lock_hold_ms = lock_hold_ms;
+    sim::Latency detected, first_status;
+    if (!boot(false, detected, first_status, cfg))
+    {
+        bench_fail("no door state after boot\n");
+        return;
+    }
+    Command both;
+    set_light(true);
+    set_lock(1);
+    both.run([]
+             { return opener->light() && opener->lock(); }, []
+             { return garage_door.light && garage_door.current_lock == CURR_LOCKED; });
+    char label[64];
+    snprintf(label, sizeof(label), "light+lock, lock held %ums", lock_hold_ms);
+    both.report(label);
+    if (!opener->light() || !opener->lock())
+        bench_fail("light and lock not both on at the opener\n");
+}
+
+static void scenario_light_and_lock(void)
+{
+    light_and_lock(0);
+}
+
+static void scenario_light_and_lock_held(void)
+{
+    light_and_lock(3000);
+}
+
+// Opener misses a button press, firmware sees nothing change and presses again
+static void scenario_missed_press(void)
+{
+    sim::Latency detected, first_status;
+    if (!boot(false, detected, first_status))
+    {
+        bench_fail("no door state after boot\n");
+        return;
+    }
+    Command light;
+    opener->miss_next_press();
+    set_light(true);
+    light.run([]
+              { return opener->light(); }, []
+              { return garage_door.light; });
+    light.report("set_light(true), first press missed");
+    fprintf(stderr, "  %u commands acknowledged, %u not\n", commands_acked, commands_unacked);
+    if (!opener->light())
+        bench_fail("light press not sent again\n");
+}
+
+BENCH(sim_sec1_panel)
+{
+    if (!sim::isolated(scenario_panel_fast) || !sim::isolated(scenario_panel_slow) ||
+        !sim::isolated(scenario_panel_task))
+        bench_fail("sim_sec1_panel\n");
+}
+
+BENCH(sim_sec1_emulated)
+{
+    if (!sim::isolated(scenario_emulated_fast) || !sim::isolated(scenario_emulated_slow) ||
+        !sim::isolated(scenario_emulated_task))
+        bench_fail("sim_sec1_emulated\n");
+}
+
+BENCH(sim_sec1_ack)
+{
+    loop_us = 1000;
+    if (!sim::isolated(scenario_light_and_lock) || !sim::isolated(scenario_light_and_lock_held) ||
+        !sim::isolated(scenario_missed_press))
+        bench_fail("sim_sec1_ack\n");
+}
@@ -0,0 +1,549 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+
+// RATGDO project includes
+#include "bench.h"
+#include "Sim.h"
+#include "OpenerSec2.h"
+#include "ratgdo.h"
+#include "comms.h"
+#include "config.h"
+
+// End to end timing of src/comms.cpp against the simulated Security+2.0 opener in
+// host/sim.  Times are simulated, so they are what the firmware would see on the
+// bus (for a given loop() period) and are exactly repeatable; host speed does not
+// enter into it.  Each scenario runs in its own process so it starts from a fresh
+// boot.  Run with -v to see the firmware's log.
+//
+// A command is counted as lost if HomeKit state has not caught up within the
+// timeout.  The usual cause is the firmware starting a transmit in the gap between
+// two bytes of a packet from the opener, garbling the opener's reply; these are
+// reported, not failed, as they are what the numbers here are for.  Self checks
+// are limited to things that must hold whatever the firmware's timing.  The
+// commands are also run with comms in its own task, woken by the bus and the
+// command queue, as on the ESP32.
+
+static const uint32_t CLIENT_ID = 0x2A5539;
+static const uint32_t SAVED_ROLLING = 0x4000;
+static const uint32_t ROLLING_MASK = 0xFFFFFFF; // 28 bits
+static const uint64_t BOOT_TIMEOUT_US = 30000000;
+static const uint64_t CMD_TIMEOUT_US = 3000000;
+
+// src/comms.cpp
+extern uint32_t rolling_code;
+
+// loop() period, or 0 to run comms as its own task
+static uint32_t loop_us = 1000;
+// gdo_bus.write() returns once the bytes are out, as software serial does
+static bool blocking_write = false;
+
+template <typename D>
+static uint64_t run_comms(D &&done, uint64_t timeout_us)
+{
+    if (!loop_us)
+        return sim::task_until(comms_task_step, done, timeout_us);
+    return sim::loop_until(comms_loop, done, timeout_us, loop_us);
+}
+
+// Boot the firmware against a fresh opener, paired or not, and wait for the
+// first status.  Returns time from power up to knowing the door state.
+static uint64_t boot(SimOpenerSec2 *&opener, const SimOpenerSec2::Config &cfg, bool paired,
+                     uint32_t saved_rolling = SAVED_ROLLING)
+{
+    sim::reset();
+    opener = new SimOpenerSec2(cfg);
+    sim::attach(opener);
+    if (paired)
+    {
+        nvRam->write(nvram_id_code, CLIENT_ID);
+        nvRam->write(nvram_rolling, saved_rolling);
+        opener->learn(CLIENT_ID, saved_rolling);
+    }
+    doorControlType = 2;
+    static_cast<sim::LoopbackBus &>(gdo_bus).set_blocking_write(blocking_write);
+    uint64_t start = sim::now_us();
+    setup_comms();
+    uint64_t t = run_comms([]
+                           { return garage_door.active; }, BOOT_TIMEOUT_US);
+    return (t == sim::NEVER) ? t : sim::now_us() - start;
+}
+
+template <typename D>
+static uint64_t settle(D &&done, uint64_t timeout_us = CMD_TIMEOUT_US)
+{
+    return run_comms(done, timeout_us);
+}
+
+static void report_counts(SimOpenerSec2 *opener)
+{
+    sim::Stats &st = sim::stats();
+    fprintf(stderr, "  opener accepted %u, ignored %u, corrupt %u; bus %u bytes, %u collisions\n",
+            opener->accepted(), opener->ignored(), opener->corrupt(), st.bus_bytes, st.collisions);
+    fprintf(stderr, "  queue peak %zu, dropped %u, coalesced %u, retries %u; firmware rejected %u, reader lost %u\n",
+            tx_scheduler.high_water(), tx_scheduler.dropped(), tx_scheduler.coalesced(), tx_scheduler.retries(),
+            rejected_packets, reader.lost_count());
+    fprintf(stderr, "  sent after 0/1/2/3/4+ collisions %u/%u/%u/%u/%u, gave up %u; ready to sent %.1f avg %.1f max ms\n",
+            sec2_contention.retries(0), sec2_contention.retries(1), sec2_contention.retries(2),
+            sec2_contention.retries(3), sec2_contention.retries(4), sec2_contention.given_up(),
+            sec2_contention.wait_avg_us() / 1000.0, sec2_contention.wait_max_us() / 1000.0);
+
+    // the web server's copy, taken at the end of the last comms pass
+    CommsStats c;
+    comms_stats(c);
+    if (c.packets_lost != reader.lost_count() || c.packets_rejected != rejected_packets ||
+        c.transmit_collisions != sec2_contention.collisions() || c.status_polls != status_poller.polls() ||
+        c.pings_sent != link_monitor.pings_sent() || c.link_health != link_monitor.health() ||
+        c.ping_rtt_histogram[0] != link_monitor.histogram(0) || c.command_queue_peak != tx_scheduler.high_water() ||
+        c.commands_unacked != commands_unacked)
+        bench_fail("comms_stats() does not match the counters after the last pass\n");
+}
+
+static void scenario_boot_new(void)
+{
+    SimOpenerSec2 *opener;
+    uint64_t t = boot(opener, SimOpenerSec2::Config(), false);
+    sim::Latency l;
+    l.add(t);
+    l.report("power up to door state, new client ID");
+    if (t == sim::NEVER)
+        bench_fail("no status after boot with new client ID\n");
+}
+
+static void scenario_boot_paired(void)
+{
+    SimOpenerSec2 *opener;
+    uint64_t t = boot(opener, SimOpenerSec2::Config(), true);
+    sim::Latency l;
+    l.add(t);
+    l.report("power up to door state, paired");
+    if (t == sim::NEVER)
+        bench_fail("no status after boot when paired\n");
+}
+
+static void scenario_commands(void)
+{
+    SimOpenerSec2 *opener;
+    SimOpenerSec2::Config cfg;
+    cfg.travel_ms = 10000;
+    if (boot(opener, cfg, true) == sim::NEVER)
+    {
+        bench_fail("no status after boot\n");
+        return;
+    }
+
+    uint64_t travel_us = (uint64_t)cfg.travel_ms * 1000 + CMD_TIMEOUT_US;
+    sim::Latency moving, open, closing, closed, light_on, light_off, lock_on, lock_off;
+    for (int i = 0; i < 5; i++)
+    {
+        open_door();
+        moving.add(settle([]
+                          { return garage_door.current_state == CURR_OPENING; }));
+        open.add(settle([]
+                        { return garage_door.current_state == CURR_OPEN; }, travel_us));
+        close_door();
+        closing.add(settle([]
+                           { return garage_door.current_state == CURR_CLOSING; }));
+        closed.add(settle([]
+                          { return garage_door.current_state == CURR_CLOSED; }, travel_us));
+        set_light(true);
+        light_on.add(settle([]
+                            { return garage_door.light; }));
+        set_light(false);
+        light_off.add(settle([]
+                             { return !garage_door.light; }));
+        set_lock(1);
+        lock_on.add(settle([]
+                           { return garage_door.current_lock == CURR_LOCKED && garage_door.target_lock == TGT_LOCKED; }));
+        set_lock(0);
+        lock_off.add(settle([]
+                            { return garage_door.current_lock == CURR_UNLOCKED && garage_door.target_lock == TGT_UNLOCKED; }));
+        // firmware keeps running, so whatever is still queued goes out
+        settle([]
+               { return false; }, 2000000);
+    }
+
+    if (loop_us)
+        fprintf(stderr, "  loop() every %u us, door travel %u ms, opener replies after %u ms\n",
+                loop_us, cfg.travel_ms, cfg.reply_us / 1000);
+    else
+        fprintf(stderr, "  comms task%s, door travel %u ms, opener replies after %u ms\n",
+                blocking_write ? ", writes wait for the bytes" : "", cfg.travel_ms, cfg.reply_us / 1000);
+    moving.report("open_door() to Opening");
+    open.report("Opening to Open");
+    closing.report("close_door() to Closing");
+    closed.report("Closing to Closed");
+    light_on.report("set_light(true) to light on");
+    light_off.report("set_light(false) to light off");
+    lock_on.report("set_lock(1) to locked");
+    lock_off.report("set_lock(0) to unlocked");
+    report_counts(opener);
+    sim::Stats &st = sim::stats();
+    fprintf(stderr, "  wake pulse %llu-%llu us, released %llu-%llu us before the frame (%u frames)\n",
+            (unsigned long long)st.wake.min, (unsigned long long)st.wake.max,
+            (unsigned long long)st.settle.min, (unsigned long long)st.settle.max, st.settle.count);
+
+    // door commands are acted on by the opener even if a status reply is lost
+    if (opener->door() != DoorState::Closed || opener->openings() != 5)
+        bench_fail("opener door not cycled 5 times (%u openings)\n", opener->openings());
+    if (opener->corrupt())
+        bench_fail("opener decoded %u corrupt packets\n", opener->corrupt());
+    if (st.wake.min != SecPlus2Transmitter::WAKE_US || st.wake.max != SecPlus2Transmitter::WAKE_US ||
+        st.settle.min != SecPlus2Transmitter::SETTLE_US || st.settle.max != SecPlus2Transmitter::SETTLE_US)
+        bench_fail("wake pulse or the gap after it is not %u us and %u us\n",
+                   SecPlus2Transmitter::WAKE_US, SecPlus2Transmitter::SETTLE_US);
+}
+
+static void scenario_commands_slow_loop(void)
+{
+    loop_us = 10000;
+    scenario_commands();
+}
+
+static void scenario_commands_task(void)
+{
+    loop_us = 0;
+    scenario_commands();
+}
+
+static void scenario_commands_blocking_write(void)
+{
+    loop_us = 0;
+    blocking_write = true;
+    scenario_commands();
+}
+
+// Several commands at once, more packets than the queue holds
+static void scenario_burst(void)
+{
+    SimOpenerSec2 *opener;
+    if (boot(opener, SimOpenerSec2::Config(), true) == sim::NEVER)
+    {
+        bench_fail("no status after boot\n");
+        return;
+    }
+    uint32_t dropped = tx_scheduler.dropped();
+    open_door();
+    set_light(true);
+    set_lock(1);
+    uint64_t t = settle([]
+                        { return garage_door.current_state == CURR_OPENING && garage_door.light &&
+                                 garage_door.current_lock == CURR_LOCKED; });
+    sim::Latency l;
+    l.add(t);
+    l.report("open+light+lock to all three reflected");
+    fprintf(stderr, "  %u commands refused by a full queue\n", tx_scheduler.dropped() - dropped);
+    fprintf(stderr, "  door %s, light %s, lock %s at the opener\n",
+            opener->door() == DoorState::Opening ? "opening" : "not opening",
+            opener->light() ? "on" : "off", opener->lock() ? "locked" : "unlocked");
+    report_counts(opener);
+}
+
+// Opener sending status every 50ms, commands have to find gaps
+static void scenario_chatter(void)
+{
+    SimOpenerSec2 *opener;
+    SimOpenerSec2::Config cfg;
+    cfg.chatter_ms = 50;
+    if (boot(opener, cfg, true) == sim::NEVER)
+    {
+        bench_fail("no status after boot\n");
+        return;
+    }
+    sim::Latency light;
+    for (int i = 0; i < 20; i++)
+    {
+        bool on = !garage_door.light;
+        set_light(on);
+        light.add(settle([on]
+                         { return garage_door.light == on; }));
+        settle([]
+               { return false; }, 333000);
+    }
+    light.report("set_light() to reflected, status every 50ms");
+    report_counts(opener);
+    if (!light.count)
+        bench_fail("no light command got through with a busy bus\n");
+}
+
+// A wall panel polling the opener every 100ms or so, without listening first, so
+// it sometimes starts while we wake the bus and we have to back off
+class SimBusyPanel : public sim::Device
+{
+public:
+    static const uint32_t PANEL_ID = 0x3B1A07;
+    static const uint32_t PERIOD_US = 100000;
+    static const uint32_t JITTER_US = 2000;
+
+    SimBusyPanel() : m_next(sim::now_us() + PERIOD_US) {}
+
+    void receive(uint8_t byte, uint64_t at) override {}
+    uint64_t next_event(void) const override { return m_next; }
+    void on_event(uint64_t now) override
+    {
+        PacketData d;
+        d.type = PacketDataType::NoData;
+        d.value.no_data = NoData();
+        Packet pkt(PacketCommand::GetStatus, d, PANEL_ID);
+        uint64_t fixed;
+        uint32_t data;
+        pkt.wire_words(fixed, data);
+        data = (data & ~COMMAND_PARITY::word_mask) | COMMAND_PARITY::put(packet_parity(fixed, data));
+        uint8_t frame[SECPLUS2_CODE_LEN];
+        encode_wireline(m_rolling++, fixed, data, frame);
+        sim::transmit(this, frame, SECPLUS2_CODE_LEN, now, 1042, 1300 + 130);
+        m_next = now + PERIOD_US - JITTER_US + random(0, 2 * JITTER_US);
+    }
+
+private:
+    uint64_t m_next;
+    uint32_t m_rolling = 0x200;
+};
+
+static void scenario_panel(void)
+{
+    SimOpenerSec2 *opener;
+    SimOpenerSec2::Config cfg;
+    if (boot(opener, cfg, true) == sim::NEVER)
+    {
+        bench_fail("no status after boot\n");
+        return;
+    }
+    opener->learn(SimBusyPanel::PANEL_ID, 0x1FF);
+    sim::attach(new SimBusyPanel());
+    settle([]
+           { return false; }, 1000000);
+    sim::Latency light;
+    for (int i = 0; i < 20; i++)
+    {
+        bool on = !garage_door.light;
+        set_light(on);
+        light.add(settle([opener, on]
+                         { return opener->light() == on && garage_door.light == on; }, 10000000));
+        settle([]
+               { return false; }, 333000);
+    }
+    light.report("set_light() to reflected, panel polling");
+    fprintf(stderr, "  opener reply learned as %.1f ms after our frame\n", sec2_contention.reply_us() / 1000.0);
+    report_counts(opener);
+    if (!light.count)
+        bench_fail("no light command got through with a busy wall panel\n");
+}
+
+// Opener misses a light command, firmware sends it again when no status shows it
+static void scenario_missed(void)
+{
+    SimOpenerSec2 *opener;
+    if (boot(opener, SimOpenerSec2::Config(), true) == sim::NEVER)
+    {
+        bench_fail("no status after boot\n");
+        return;
+    }
+    opener->miss_next_command();
+    set_light(true);
+    sim::Latency l;
+    // the firmware hears its own Light command, so wait for the opener's status
+    l.add(settle([opener]
+                 { return opener->light() && garage_door.light; }, 10000000));
+    l.report("set_light(true), first command missed");
+    fprintf(stderr, "  %u commands acknowledged, %u not\n", commands_acked, commands_unacked);
+    report_counts(opener);
+    if (!opener->light())
+        bench_fail("light command not sent again\n");
+}
+
+// Opener's status when the door stops is lost, firmware polls while the door moves
+static void scenario_lost_status(void)
+{
+    SimOpenerSec2 *opener;
+    SimOpenerSec2::Config cfg;
+    cfg.travel_ms = 10000;
+    if (boot(opener, cfg, true) == sim::NEVER)
+    {
+        bench_fail("no status after boot\n");
+        return;
+    }
+
+    uint64_t travel_us = (uint64_t)cfg.travel_ms * 1000 + CMD_TIMEOUT_US;
+    sim::Latency open, closed;
+    uint32_t polls = status_poller.polls();
+    for (int i = 0; i < 3; i++)
+    {
+        opener->miss_next_arrival();
+        open_door();
+        settle([opener]
+               { return opener->door() == DoorState::Open; }, travel_us);
+        open.add(settle([]
+                        { return garage_door.current_state == CURR_OPEN; }));
+        opener->miss_next_arrival();
+        close_door();
+        settle([opener]
+               { return opener->door() == DoorState::Closed; }, travel_us);
+        closed.add(settle([]
+                          { return garage_door.current_state == CURR_CLOSED; }));
+    }
+    // polling decays away once the door is still
+    settle([]
+           { return !status_poller.active(); }, 30000000);
+    uint32_t cycle_polls = status_poller.polls() - polls;
+    polls = status_poller.polls();
+    settle([]
+           { return false; }, 60000000);
+    uint32_t idle_polls = status_poller.polls() - polls;
+
+    open.report("door open to HomeKit Open, status lost");
+    closed.report("door closed to HomeKit Closed, status lost");
+    fprintf(stderr, "  %.1f status polls per open or close, %u in a minute idle\n", cycle_polls / 6.0, idle_polls);
+    report_counts(opener);
+    if (open.lost || closed.lost || open.max > 2 * StatusPoller::FAST_MS * 1000 || closed.max > 2 * StatusPoller::FAST_MS * 1000)
+        bench_fail("HomeKit slow to see the door stop when its status was lost\n");
+    if (idle_polls)
+        bench_fail("%u status polls with the door idle\n", idle_polls);
+}
+
+// Idle link pinged, then the opener unplugged and plugged back in
+static void scenario_link(void)
+{
+    SimOpenerSec2 *opener;
+    if (boot(opener, SimOpenerSec2::Config(), true) == sim::NEVER)
+    {
+        bench_fail("no status after boot\n");
+        return;
+    }
+    settle([]
+           { return false; }, 300000000);
+    LinkHealth idle = link_monitor.health();
+    uint32_t idle_pings = link_monitor.pings_sent();
+
+    opener->set_unplugged(true);
+    uint64_t unplugged = sim::now_us();
+    settle([]
+           { return link_monitor.health() == LinkHealth::Degraded; }, 120000000);
+    uint64_t degraded = sim::now_us() - unplugged;
+    settle([]
+           { return link_monitor.health() == LinkHealth::Offline; }, 120000000);
+    uint64_t offline = sim::now_us() - unplugged;
+
+    opener->set_unplugged(false);
+    uint64_t plugged = sim::now_us();
+    settle([]
+           { return link_monitor.health() == LinkHealth::Good; }, 120000000);
+    uint64_t good = sim::now_us() - plugged;
+
+    fprintf(stderr, "  %u pings in 5 minutes idle, round trip %.1f min %.1f avg %.1f max ms, link %s\n",
+            idle_pings, link_monitor.rtt_min_us() / 1000.0, link_monitor.rtt_avg_us() / 1000.0,
+            link_monitor.rtt_max_us() / 1000.0, LinkMonitor::name(idle));
+    fprintf(stderr, "  round trips below 8/16/32/64/128/256/512 ms and over: %u/%u/%u/%u/%u/%u/%u/%u\n",
+            link_monitor.histogram(0), link_monitor.histogram(1), link_monitor.histogram(2), link_monitor.histogram(3),
+            link_monitor.histogram(4), link_monitor.histogram(5), link_monitor.histogram(6), link_monitor.histogram(7));
+    fprintf(stderr, "  unplugged to degraded %.1f s, to offline %.1f s; plugged in to good %.1f s\n",
+            degraded / 1e6, offline / 1e6, good / 1e6);
+    report_counts(opener);
+    if (idle != LinkHealth::Good)
+        bench_fail("link %s with the opener answering\n", LinkMonitor::name(idle));
+    if (link_monitor.health() != LinkHealth::Good)
+        bench_fail("link %s after plugging back in\n", LinkMonitor::name(link_monitor.health()));
+    if (idle_pings > 6)
+        bench_fail("%u pings in 5 minutes idle\n", idle_pings);
+}
+
+// Rolling code saved just below the 28 bit wrap.  Commands carry on across it and
+// the journal is written once a lease, not on every idle pass while its
+// reservation has wrapped and the code has not.
+static void scenario_rolling_wrap(void)
+{
+    SimOpenerSec2 *opener;
+    if (boot(opener, SimOpenerSec2::Config(), true, ROLLING_MASK - 24) == sim::NEVER)
+    {
+        bench_fail("no status after boot\n");
+        return;
+    }
+    uint32_t boot_appends = rolling_journal.appends();
+    uint32_t sent = 0;
+    bool wrapped = false;
+    for (int i = 0; i < 20; i++)
+    {
+        uint32_t before = rolling_code;
+        set_light(!(i & 1));
+        if (settle([i]
+                   { return garage_door.light == !(i & 1); }) == sim::NEVER)
+            bench_fail("light command %d lost\n", i);
+        // idle a while, when the journal would be rewritten every pass
+        settle([]
+               { return false; }, 200000);
+        sent += (rolling_code - before) & ROLLING_MASK;
+        wrapped |= rolling_code < before;
+    }
+    uint32_t appends = rolling_journal.appends() - boot_appends;
+    fprintf(stderr, "  %u codes sent from 0x%07X, now 0x%07X; %u journal records (%u at boot)\n", sent,
+            ROLLING_MASK - 24, rolling_code, appends, boot_appends);
+    report_counts(opener);
+    if (!wrapped)
+        bench_fail("rolling code did not wrap\n");
+    if (appends > sent / 12 + 2)
+        bench_fail("%u journal records for %u codes\n", appends, sent);
+    if (opener->ignored())
+        bench_fail("opener ignored %u packets\n", opener->ignored());
+}
+
+BENCH(sim_sec2_boot)
+{
+    if (!sim::isolated(scenario_boot_new) || !sim::isolated(scenario_boot_paired))
+        bench_fail("sim_sec2_boot\n");
+}
+
+BENCH(sim_sec2_commands)
+{
+    if (!sim::isolated(scenario_commands) || !sim::isolated(scenario_commands_slow_loop) ||
+        !sim::isolated(scenario_commands_task) || !sim::isolated(scenario_commands_blocking_write))
+        bench_fail("sim_sec2_commands\n");
+}
+
+BENCH(sim_sec2_burst)
+{
+    if (!sim::isolated(scenario_burst))
+        bench_fail("sim_sec2_burst\n");
+}
+
+BENCH(sim_sec2_chatter)
+{
+    if (!sim::isolated(scenario_chatter))
+        bench_fail("sim_sec2_chatter\n");
+}
+
+BENCH(sim_sec2_panel)
+{
+    if (!sim::isolated(scenario_panel))
+        bench_fail("sim_sec2_panel\n");
+}
+
+BENCH(sim_sec2_missed)
+{
+    if (!sim::isolated(scenario_missed))
+        bench_fail("sim_sec2_missed\n");
+}
+
+BENCH(sim_sec2_lost_status)
+{
+    if (!sim::isolated(scenario_lost_status))
+        bench_fail("sim_sec2_lost_status\n");
+}
+
+BENCH(sim_sec2_link)
+{
+    if (!sim::isolated(scenario_link))
+        bench_fail("sim_sec2_link\n");
+}
+
+BENCH(sim_sec2_rolling_wrap)
+{
+    if (!sim::isolated(scenario_rolling_wrap))
+        bench_fail("sim_sec2_rolling_wrap\n");
+}
@@ -0,0 +1,115 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+
+// C/C++ language includes
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// RATGDO project includes
+#include "bench.h"
+
+static BenchCase *bench_list = NULL;
+static BenchCase **bench_tail = &bench_list;
+static int bench_failures = 0;
+
+BenchCase::BenchCase(const char *n, void (*f)()) : name(n), fn(f), next(NULL)
+{
+    // keep registration order so output reads in source order
+    *bench_tail = this;
+    bench_tail = &next;
+}
+
+void bench_fail(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "  MISMATCH ");
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    bench_failures++;
+}
+
+int bench_fail_count(void)
+{
+    return bench_failures;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-v] [-l] [filter...]\n", prog);
+    fprintf(stderr, "  -v  keep RINFO/RERROR output from the code under test on stdout\n");
+    fprintf(stderr, "  -l  list benchmarks and exit\n");
+    fprintf(stderr, "  filter  run only benchmarks whose name contains one of the filters\n");
+}
+
+/****************************************************************************
+ * Host benchmark runner.  Results are written to stderr, stdout is reserved
+ * for log output from the code under test and is discarded unless -v given.
+ */
+int main(int argc, char *argv[])
+{
+    bool verbose = false;
+    bool list = false;
+    int first_filter = argc;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-v"))
+            verbose = true;
+        else if (!strcmp(argv[i], "-l"))
+            list = true;
+        else if (argv[i][0] == '-')
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        else
+        {
+            first_filter = i;
+            break;
+        }
+    }
+
+    if (!verbose)
+        freopen("/dev/null", "w", stdout);
+
+    int run = 0;
+    for (BenchCase *b = bench_list; b; b = b->next)
+    {
+        bool selected = (first_filter == argc);
+        for (int i = first_filter; i < argc && !selected; i++)
+            selected = (strstr(b->name, argv[i]) != NULL);
+        if (!selected)
+            continue;
+
+        if (list)
+        {
+            fprintf(stderr, "%s\n", b->name);
+            continue;
+        }
+        fprintf(stderr, "%s\n", b->name);
+        b->fn();
+        run++;
+    }
+
+    if (!list && run == 0)
+    {
+        fprintf(stderr, "no benchmarks matched\n");
+        return 1;
+    }
+    if (bench_failures)
+    {
+        fprintf(stderr, "%d self check(s) failed\n", bench_failures);
+        return 1;
+    }
+    return 0;
+}
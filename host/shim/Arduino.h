@@ -0,0 +1,96 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+#pragma once
+
+// Host stand-in for the parts of the Arduino core and FreeRTOS that src/comms.cpp
+// uses, so that it can be compiled unchanged into the native build and driven by
+// the simulator in host/sim.  Time, pins and the serial port are all simulated,
+// see host/sim/Sim.h.  Nothing here is used by the ESP32 build.
+
+// C/C++ language includes
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Marks this as an Arduino build for headers that test for it (utilities.h)
+#ifndef ARDUINO
+#define ARDUINO 10812
+#endif
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define IRAM_ATTR
+#define PSTR(s) (s)
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+
+#define ESP_LOGD(tag, format, ...) ((void)0)
+#define ESP_LOGI(tag, format, ...) ((void)0)
+#define ESP_LOGW(tag, format, ...) ((void)0)
+#define ESP_LOGE(tag, format, ...) ((void)0)
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t val);
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode);
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration = 0);
+long random(long min, long max);
+
+/****************************************************************************
+ * FreeRTOS mutexes.  Single threaded on the host, so there is nothing to wait for.
+ */
+typedef void *SemaphoreHandle_t;
+typedef struct SimQueue *QueueHandle_t; // named in headers, never created
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY 0xFFFFFFFF
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex(void) { return (SemaphoreHandle_t)1; }
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t m, TickType_t wait) { return pdTRUE; }
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t m) { return pdTRUE; }
+
+/****************************************************************************
+ * FreeRTOS tasks.  Nothing is started, the simulator runs the task body itself
+ * (sim::task_until()) and a notification wakes it from sim::sleep_until().
+ */
+typedef struct SimTask *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdPASS pdTRUE
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms)) // 1ms tick
+#define configMAX_PRIORITIES 25
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                          uint32_t priority, TaskHandle_t *task, BaseType_t core)
+{
+    *task = (TaskHandle_t)1;
+    return pdPASS;
+}
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+inline uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait) { return 0; }
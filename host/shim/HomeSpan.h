@@ -0,0 +1,71 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+#pragma once
+
+// Host stand-in, see host/shim/Arduino.h.  Only the HomeKit characteristic values
+// that ratgdo.h maps its door and lock states onto, and empty services so that
+// homekit.h parses.  Values are those defined by HomeKit.
+#include "Arduino.h"
+
+struct SpanCharacteristic
+{
+};
+
+namespace Characteristic
+{
+    struct CurrentDoorState : SpanCharacteristic
+    {
+        enum { OPEN = 0, CLOSED = 1, OPENING = 2, CLOSING = 3, STOPPED = 4 };
+    };
+    struct TargetDoorState : SpanCharacteristic
+    {
+        enum { OPEN = 0, CLOSED = 1 };
+    };
+    struct LockCurrentState : SpanCharacteristic
+    {
+        enum { UNLOCKED = 0, LOCKED = 1, JAMMED = 2, UNKNOWN = 3 };
+    };
+    struct LockTargetState : SpanCharacteristic
+    {
+        enum { UNLOCK = 0, LOCK = 1 };
+    };
+    struct ObstructionDetected : SpanCharacteristic
+    {
+    };
+    struct On : SpanCharacteristic
+    {
+    };
+    struct MotionDetected : SpanCharacteristic
+    {
+    };
+    struct OccupancyDetected : SpanCharacteristic
+    {
+    };
+}
+
+namespace Service
+{
+    struct GarageDoorOpener
+    {
+    };
+    struct AccessoryInformation
+    {
+    };
+    struct LightBulb
+    {
+    };
+    struct MotionSensor
+    {
+    };
+    struct OccupancySensor
+    {
+    };
+}
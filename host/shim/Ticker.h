@@ -0,0 +1,38 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+#pragma once
+
+// Host stand-in, see host/shim/Arduino.h.  Callbacks run from the simulator as
+// simulated time passes, in place of the esp_timer task.
+#include <stdint.h>
+
+class Ticker
+{
+public:
+    typedef void (*callback_t)(void);
+
+    Ticker() = default;
+    ~Ticker();
+
+    void attach_ms(uint32_t ms, callback_t fn) { arm(ms, fn, true); }
+    void once_ms(uint32_t ms, callback_t fn) { arm(ms, fn, false); }
+    void detach();
+    bool active() const { return m_fn != nullptr; }
+
+    // for the simulator
+    uint64_t m_due_us = 0;
+    uint32_t m_period_ms = 0;
+    bool m_repeat = false;
+    callback_t m_fn = nullptr;
+
+private:
+    void arm(uint32_t ms, callback_t fn, bool repeat);
+};
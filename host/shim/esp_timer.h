@@ -0,0 +1,17 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+#pragma once
+
+
+// Host stand-in, see host/shim/Arduino.h.  Simulated microseconds since start.
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
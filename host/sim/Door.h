@@ -0,0 +1,124 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+#pragma once
+
+// C/C++ language includes
+#include <algorithm>
+
+// RATGDO project includes
+#include "Sim.h"
+#include "Packet.h"
+
+// The door itself, shared by the simulated openers.  Takes travel_ms to go from
+// fully closed to fully open, can be stopped part way and will not close onto an
+// obstruction.  Methods return true if the door state changed, so that the
+// opener can report it.
+class SimDoor
+{
+public:
+    explicit SimDoor(uint32_t travel_ms) : m_travel_ms(travel_ms) {}
+
+    DoorState state(void) const { return m_door; }
+    uint16_t openings(void) const { return m_openings; }
+
+    bool press(DoorAction action, uint64_t now)
+    {
+        switch (action)
+        {
+        case DoorAction::Open:
+            if (m_door == DoorState::Closed || m_door == DoorState::Stopped || m_door == DoorState::Closing)
+                return start(DoorState::Opening, now);
+            break;
+        case DoorAction::Close:
+            if (m_door == DoorState::Open || m_door == DoorState::Stopped || m_door == DoorState::Opening)
+                return start(DoorState::Closing, now);
+            break;
+        case DoorAction::Stop:
+            if (m_door == DoorState::Opening || m_door == DoorState::Closing)
+                return stop(DoorState::Stopped, now);
+            break;
+        case DoorAction::Toggle:
+            if (m_door == DoorState::Closed || m_door == DoorState::Closing)
+                return start(DoorState::Opening, now);
+            if (m_door == DoorState::Open)
+                return start(DoorState::Closing, now);
+            if (m_door == DoorState::Opening)
+                return stop(DoorState::Stopped, now);
+            return start((m_last_direction == DoorState::Opening) ? DoorState::Closing : DoorState::Opening, now);
+        }
+        return false;
+    }
+
+    // Obstruction appearing reverses a closing door
+    bool set_obstructed(bool obstructed, uint64_t now)
+    {
+        m_obstructed = obstructed;
+        return obstructed && m_door == DoorState::Closing && start(DoorState::Opening, now);
+    }
+
+    // Time the moving door reaches the end of travel, or NEVER
+    uint64_t arrival(void) const
+    {
+        if (m_door == DoorState::Opening)
+            return m_move_started + (uint64_t)(m_travel_ms - m_position) * 1000;
+        if (m_door == DoorState::Closing)
+            return m_move_started + (uint64_t)m_position * 1000;
+        return sim::NEVER;
+    }
+
+    // Call when arrival() is due
+    bool arrive(uint64_t now)
+    {
+        if (arrival() > now)
+            return false;
+        return stop((m_door == DoorState::Opening) ? DoorState::Open : DoorState::Closed, now);
+    }
+
+private:
+    uint32_t m_travel_ms;
+    DoorState m_door = DoorState::Closed;
+    DoorState m_last_direction = DoorState::Closing;
+    uint64_t m_move_started = 0;
+    uint32_t m_position = 0; // 0 closed to travel_ms open, as of m_move_started
+    bool m_obstructed = false;
+    uint16_t m_openings = 0;
+
+    uint32_t position(uint64_t now) const
+    {
+        uint32_t elapsed = (uint32_t)((now - m_move_started) / 1000);
+        if (m_door == DoorState::Opening)
+            return std::min(m_travel_ms, m_position + elapsed);
+        if (m_door == DoorState::Closing)
+            return (elapsed >= m_position) ? 0 : m_position - elapsed;
+        return m_position;
+    }
+
+    bool start(DoorState direction, uint64_t now)
+    {
+        if (direction == DoorState::Closing && m_obstructed)
+            return false;
+        if (direction == DoorState::Opening && m_door == DoorState::Closed)
+            m_openings++;
+        m_position = position(now);
+        m_move_started = now;
+        m_door = direction;
+        m_last_direction = direction;
+        return true;
+    }
+
+    bool stop(DoorState state, uint64_t now)
+    {
+        m_position = position(now);
+        m_move_started = now;
+        m_door = state;
+        return true;
+    }
+};
@@ -0,0 +1,105 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+#pragma once
+
+// C/C++ language includes
+#include <string.h>
+#include <vector>
+
+// RATGDO project includes
+#include "Journal.h"
+
+// NOR flash in RAM for a Journal.  Writes AND into what is there, as real flash
+// can only clear bits.  power_cut_after() makes the flash stop part way through
+// an operation, counting each byte written or erased, to check recovery from
+// losing power at any point.
+class SimFlash : public JournalFlash
+{
+public:
+    explicit SimFlash(size_t sectors) : m_data(sectors * SECTOR_SIZE, 0xFF) {}
+
+    bool begin(void) override { return true; }
+    size_t sectors(void) override { return m_data.size() / SECTOR_SIZE; }
+
+    bool read(size_t offset, void *buf, size_t len) override
+    {
+        if (offset + len > m_data.size())
+            return false;
+        memcpy(buf, &m_data[offset], len);
+        return true;
+    }
+
+    bool write(size_t offset, const void *buf, size_t len) override
+    {
+        if (!m_powered || offset + len > m_data.size())
+            return false;
+        const uint8_t *p = (const uint8_t *)buf;
+        for (size_t i = 0; i < len; i++)
+        {
+            if (!spend())
+                return false;
+            m_data[offset + i] &= p[i];
+        }
+        m_written += len;
+        return true;
+    }
+
+    bool erase(size_t sector) override
+    {
+        if (!m_powered || sector >= sectors())
+            return false;
+        for (size_t i = 0; i < SECTOR_SIZE; i++)
+        {
+            if (!spend())
+                return false;
+            m_data[sector * SECTOR_SIZE + i] = 0xFF;
+        }
+        m_erases++;
+        return true;
+    }
+
+    // Lose power after this many more bytes, or never
+    void power_cut_after(size_t bytes)
+    {
+        m_budget = bytes;
+        m_limited = true;
+    }
+
+    void power_on(void)
+    {
+        m_powered = true;
+        m_limited = false;
+    }
+
+    size_t written(void) const { return m_written; }
+    size_t erases(void) const { return m_erases; }
+
+private:
+    std::vector<uint8_t> m_data;
+    bool m_powered = true;
+    bool m_limited = false;
+    size_t m_budget = 0;
+    size_t m_written = 0;
+    size_t m_erases = 0;
+
+    bool spend(void)
+    {
+        if (!m_limited)
+            return true;
+        if (m_budget == 0)
+        {
+            m_powered = false;
+            return false;
+        }
+        m_budget--;
+        return true;
+    }
+};
@@ -0,0 +1,167 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+
+// RATGDO project includes
+#include "OpenerSec1.h"
+
+void Sec1Sender::on_event(sim::Device *dev, uint64_t now)
+{
+    if (m_tx.empty() || m_tx.front().due > now)
+        return;
+    // a byte's worth of quiet line before talking
+    uint64_t free = sim::line_free_at(now, SEC1_BYTE_US);
+    if (free > now)
+    {
+        m_tx.front().due = free;
+        return;
+    }
+    sim::transmit(dev, &m_tx.front().byte, 1, now, SEC1_BYTE_US);
+    m_tx.pop_front();
+}
+
+/****************************************************************************
+ * Opener
+ */
+SimOpenerSec1::SimOpenerSec1(const Config &cfg) : m_cfg(cfg), m_door(cfg.travel_ms)
+{
+    m_next_idle_status = sim::now_us() + (uint64_t)m_cfg.power_on_ms * 1000;
+}
+
+void SimOpenerSec1::set_obstructed(bool obstructed)
+{
+    m_obstructed = obstructed;
+    sim::set_obstruction(obstructed ? sim::Obstruction::Obstructed : sim::Obstruction::Clear);
+    m_door.set_obstructed(obstructed, sim::now_us());
+}
+
+uint8_t SimOpenerSec1::door_byte(void) const
+{
+    // upper nibble 0x5 when at rest, 0x0 while moving
+    switch (m_door.state())
+    {
+    case DoorState::Opening:
+        return 0x01;
+    case DoorState::Open:
+        return 0x52;
+    case DoorState::Closing:
+        return 0x04;
+    case DoorState::Closed:
+        return 0x55;
+    default:
+        return 0x56;
+    }
+}
+
+uint8_t SimOpenerSec1::light_lock_byte(void) const
+{
+    // bit 2 light on, bit 3 lock off
+    return 0x50 | (m_light ? 0x04 : 0) | (m_lock ? 0 : 0x08);
+}
+
+void SimOpenerSec1::receive(uint8_t byte, uint64_t at)
+{
+    uint64_t reply = at + m_cfg.reply_us;
+    if (byte >= 0x38 && byte <= 0x3A)
+        m_polls++;
+    switch (byte)
+    {
+    case 0x38:
+        m_sender.send(door_byte(), reply);
+        break;
+    case 0x39:
+        m_sender.send(m_obstructed ? 0x01 : 0x00, reply);
+        break;
+    case 0x3A:
+        m_sender.send(light_lock_byte(), reply);
+        break;
+
+    case 0x30:
+    case 0x32:
+    case 0x34:
+        if (m_held == byte)
+            break;
+        if (m_miss_next)
+        {
+            m_miss_next = false;
+            break;
+        }
+        m_held = byte;
+        m_held_since = at;
+        m_presses++;
+        if (byte == 0x30)
+            m_door.press(DoorAction::Toggle, at);
+        else if (byte == 0x32)
+            m_light = !m_light;
+        else if (m_cfg.lock_hold_ms == 0)
+            m_lock = !m_lock;
+        break;
+
+    case 0x31:
+    case 0x33:
+    case 0x35:
+        if (m_held == 0x34 && byte == 0x35 && m_cfg.lock_hold_ms &&
+            at - m_held_since >= (uint64_t)m_cfg.lock_hold_ms * 1000)
+            m_lock = !m_lock;
+        if (m_held == byte - 1)
+            m_held = 0;
+        break;
+
+    default:
+        return;
+    }
+    // anything addressed to the opener means someone is polling it
+    m_next_idle_status = at + (uint64_t)m_cfg.idle_status_ms * 1000;
+}
+
+uint64_t SimOpenerSec1::next_event(void) const
+{
+    return std::min({m_door.arrival(), m_sender.next_event(), m_next_idle_status});
+}
+
+void SimOpenerSec1::on_event(uint64_t now)
+{
+    m_door.arrive(now);
+    if (m_next_idle_status <= now)
+    {
+        m_sender.send(door_byte(), now);
+        m_next_idle_status = now + (uint64_t)m_cfg.idle_status_ms * 1000;
+    }
+    m_sender.on_event(this, now);
+}
+
+/****************************************************************************
+ * Wall panel
+ */
+// release of every button on power up, then door, light and lock, obstruction polls
+static const uint8_t PANEL_SEQUENCE[] = {0x31, 0x35, 0x35, 0x33, 0x33, 0x38, 0x3A, 0x39};
+static const uint8_t PANEL_POLLS = 3;
+
+SimWallPanelSec1::SimWallPanelSec1(const Config &cfg) : m_cfg(cfg)
+{
+    m_next_poll = sim::now_us() + (uint64_t)m_cfg.boot_ms * 1000;
+}
+
+uint64_t SimWallPanelSec1::next_event(void) const
+{
+    return std::min(m_next_poll, m_sender.next_event());
+}
+
+void SimWallPanelSec1::on_event(uint64_t now)
+{
+    if (m_next_poll <= now)
+    {
+        m_sender.send(PANEL_SEQUENCE[m_index++], now);
+        if (m_index == sizeof(PANEL_SEQUENCE))
+            m_index = sizeof(PANEL_SEQUENCE) - PANEL_POLLS;
+        m_next_poll = now + (uint64_t)m_cfg.poll_ms * 1000;
+    }
+    m_sender.on_event(this, now);
+}
@@ -0,0 +1,123 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+#pragma once
+
+// C/C++ language includes
+#include <deque>
+
+// RATGDO project includes
+#include "Sim.h"
+#include "Door.h"
+
+// Security+1.0 runs at 1200 baud 8E1, eleven bits to the byte
+const uint32_t SEC1_BYTE_US = 9167;
+
+// Bytes a Security+1.0 device has waiting to go out, each sent no earlier than
+// its due time and only once the line is free.
+class Sec1Sender
+{
+public:
+    void send(uint8_t byte, uint64_t due) { m_tx.push_back({due, byte}); }
+    bool idle(void) const { return m_tx.empty(); }
+    uint64_t next_event(void) const { return m_tx.empty() ? sim::NEVER : m_tx.front().due; }
+    void on_event(sim::Device *dev, uint64_t now);
+
+private:
+    struct Pending
+    {
+        uint64_t due;
+        uint8_t byte;
+    };
+    std::deque<Pending> m_tx;
+};
+
+// An 889LM style Security+1.0 opener on the simulated bus.
+//
+// Whoever is acting as wall panel polls with a single byte and the opener answers
+// with one: 0x38 gets the door state, 0x3A light and lock, 0x39 obstruction.
+// Button codes 0x30 (door), 0x32 (light) and 0x34 (lock) act on the press; the
+// matching release must be seen before the same button counts again.  If the lock
+// button needs holding, set lock_hold_ms and it toggles on release instead.  With
+// nothing polling it the opener repeats its door state byte every idle_status_ms,
+// which is how the firmware learns there is a Security+1.0 bus at all.
+class SimOpenerSec1 : public sim::Device
+{
+public:
+    struct Config
+    {
+        uint32_t travel_ms = 12000;      // fully open to fully closed
+        uint32_t reply_us = 3000;        // poll received to reply on the wire
+        uint32_t lock_hold_ms = 0;       // lock button held at least this long to toggle
+        uint32_t power_on_ms = 500;      // power up to first byte
+        uint32_t idle_status_ms = 1000;  // unpolled, send door state this often
+    };
+
+    explicit SimOpenerSec1(const Config &cfg);
+
+    void set_obstructed(bool obstructed);
+    // Do not hear the next button press, as though it had collided with something
+    void miss_next_press(void) { m_miss_next = true; }
+
+    DoorState door(void) const { return m_door.state(); }
+    bool light(void) const { return m_light; }
+    bool lock(void) const { return m_lock; }
+    uint16_t openings(void) const { return m_door.openings(); }
+
+    uint32_t polls(void) const { return m_polls; }
+    uint32_t presses(void) const { return m_presses; }
+
+    void receive(uint8_t byte, uint64_t at) override;
+    uint64_t next_event(void) const override;
+    void on_event(uint64_t now) override;
+
+private:
+    Config m_cfg;
+    Sec1Sender m_sender;
+    SimDoor m_door;
+    bool m_light = false;
+    bool m_lock = false;
+    bool m_obstructed = false;
+    uint8_t m_held = 0; // button code held down, 0 for none
+    uint64_t m_held_since = 0;
+    uint64_t m_next_idle_status;
+    bool m_miss_next = false;
+
+    uint32_t m_polls = 0;
+    uint32_t m_presses = 0;
+
+    uint8_t door_byte(void) const;
+    uint8_t light_lock_byte(void) const;
+};
+
+// A Security+1.0 digital wall panel.  After booting it announces itself with
+// button releases, as the firmware expects, then polls the opener for door, light
+// and lock, and obstruction in turn every poll_ms.
+class SimWallPanelSec1 : public sim::Device
+{
+public:
+    struct Config
+    {
+        uint32_t boot_ms = 1500; // power up to first byte
+        uint32_t poll_ms = 250;  // between polls
+    };
+
+    explicit SimWallPanelSec1(const Config &cfg);
+
+    void receive(uint8_t byte, uint64_t at) override {}
+    uint64_t next_event(void) const override;
+    void on_event(uint64_t now) override;
+
+private:
+    Config m_cfg;
+    Sec1Sender m_sender;
+    uint64_t m_next_poll;
+    uint8_t m_index = 0;
+};
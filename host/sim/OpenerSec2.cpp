@@ -0,0 +1,221 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+
+// RATGDO project includes
+#include "OpenerSec2.h"
+
+// 9600 baud 8N1
+static const uint32_t BYTE_US = 1042;
+// line held asserted before each packet, as transmitSec2() does
+static const uint32_t BREAK_US = 1300 + 130;
+
+SimOpenerSec2::SimOpenerSec2(const Config &cfg) : m_cfg(cfg), m_door(cfg.travel_ms)
+{
+    m_reader.set_gap_timeout(0);
+    if (m_cfg.chatter_ms)
+        m_next_chatter = sim::now_us() + (uint64_t)m_cfg.chatter_ms * 1000;
+}
+
+void SimOpenerSec2::learn(uint32_t client_id, uint32_t rolling)
+{
+    m_clients[client_id & 0xFFFFFF] = rolling & 0xFFFFFFF;
+}
+
+void SimOpenerSec2::set_obstructed(bool obstructed)
+{
+    uint64_t now = sim::now_us();
+    m_obstructed = obstructed;
+    sim::set_obstruction(obstructed ? sim::Obstruction::Obstructed : sim::Obstruction::Clear);
+    m_door.set_obstructed(obstructed, now);
+    send_status(now);
+}
+
+void SimOpenerSec2::press_button(void)
+{
+    uint64_t now = sim::now_us();
+    if (m_door.press(DoorAction::Toggle, now))
+        send_status(now);
+}
+
+void SimOpenerSec2::receive(uint8_t byte, uint64_t at)
+{
+    if (m_unplugged)
+        return;
+    if (!m_reader.push_byte(byte, (uint32_t)(at / 1000)))
+        return;
+
+    Packet pkt(m_reader.fetch_buf());
+    if (!pkt.m_decoded)
+    {
+        m_corrupt++;
+        return;
+    }
+
+    // client IDs are learned from their first packet, which is otherwise ignored
+    auto client = m_clients.find(pkt.m_remote_id);
+    if (client == m_clients.end())
+    {
+        m_clients[pkt.m_remote_id] = pkt.m_rolling;
+        m_ignored++;
+        return;
+    }
+    uint32_t ahead = (pkt.m_rolling - client->second) & 0xFFFFFFF;
+    if (ahead == 0 || ahead > m_cfg.rolling_window)
+    {
+        m_ignored++;
+        return;
+    }
+    client->second = pkt.m_rolling;
+    m_accepted++;
+    handle(pkt, at);
+}
+
+void SimOpenerSec2::handle(Packet &pkt, uint64_t now)
+{
+    uint64_t reply = now + m_cfg.reply_us;
+    bool command = (pkt.m_pkt_cmd == PacketCommand::DoorAction && pkt.m_data.value.door_action.pressed) ||
+                   pkt.m_pkt_cmd == PacketCommand::Light || pkt.m_pkt_cmd == PacketCommand::Lock;
+    if (m_miss_next && command)
+    {
+        m_miss_next = false;
+        return;
+    }
+    switch (pkt.m_pkt_cmd)
+    {
+    case PacketCommand::GetStatus:
+        send_status(reply);
+        break;
+
+    case PacketCommand::GetOpenings:
+    {
+        PacketData d = {};
+        d.type = PacketDataType::Openings;
+        d.value.openings.count = m_door.openings();
+        send(PacketCommand::Openings, d, reply);
+        break;
+    }
+
+    case PacketCommand::Ping:
+    {
+        PacketData d = {};
+        d.type = PacketDataType::NoData;
+        send(PacketCommand::PingResp, d, reply);
+        break;
+    }
+
+    case PacketCommand::DoorAction:
+        if (pkt.m_data.value.door_action.pressed && m_door.press(pkt.m_data.value.door_action.action, now))
+            send_status(reply);
+        break;
+
+    case PacketCommand::Light:
+        switch (pkt.m_data.value.light.light)
+        {
+        case LightState::Off:
+            m_light = false;
+            break;
+        case LightState::On:
+            m_light = true;
+            break;
+        default:
+            m_light = !m_light;
+            break;
+        }
+        send_status(reply);
+        break;
+
+    case PacketCommand::Lock:
+        switch (pkt.m_data.value.lock.lock)
+        {
+        case LockState::Off:
+            m_lock = false;
+            break;
+        case LockState::On:
+            m_lock = true;
+            break;
+        default:
+            m_lock = !m_lock;
+            break;
+        }
+        send_status(reply);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void SimOpenerSec2::send(PacketCommand cmd, PacketData data, uint64_t due)
+{
+    // received packets must carry correct parity, set it as the opener would
+    Packet pkt(cmd, data, m_cfg.remote_id);
+    uint64_t fixed;
+    uint32_t pkt_data;
+    pkt.wire_words(fixed, pkt_data);
+    pkt_data = (pkt_data & ~COMMAND_PARITY::word_mask) | COMMAND_PARITY::put(packet_parity(fixed, pkt_data));
+
+    Pending p;
+    p.due = due;
+    encode_wireline(m_rolling, fixed, pkt_data, p.frame);
+    m_rolling = (m_rolling + 1) & 0xFFFFFFF;
+    m_tx.push_back(p);
+}
+
+void SimOpenerSec2::send_status(uint64_t due)
+{
+    PacketData d = {};
+    d.type = PacketDataType::Status;
+    d.value.status.door = m_door.state();
+    d.value.status.light = m_light;
+    d.value.status.lock = m_lock;
+    d.value.status.obstruction = m_obstructed;
+    send(PacketCommand::Status, d, due);
+}
+
+uint64_t SimOpenerSec2::next_event(void) const
+{
+    uint64_t next = std::min(m_door.arrival(), m_next_chatter);
+    if (!m_tx.empty())
+        next = std::min(next, m_tx.front().due);
+    return next;
+}
+
+void SimOpenerSec2::on_event(uint64_t now)
+{
+    if (m_door.arrive(now))
+    {
+        if (m_miss_arrival)
+            m_miss_arrival = false;
+        else
+            send_status(now);
+    }
+
+    if (m_next_chatter <= now)
+    {
+        send_status(now);
+        m_next_chatter = now + (uint64_t)m_cfg.chatter_ms * 1000;
+    }
+
+    if (m_unplugged)
+        m_tx.clear();
+    if (!m_tx.empty() && m_tx.front().due <= now)
+    {
+        // wait for the bus to have been quiet for a byte time
+        uint64_t free = sim::line_free_at(now, BYTE_US);
+        if (free > now)
+        {
+            m_tx.front().due = free;
+            return;
+        }
+        sim::transmit(this, m_tx.front().frame, SECPLUS2_CODE_LEN, now, BYTE_US, BREAK_US);
+        m_tx.pop_front();
+    }
+}
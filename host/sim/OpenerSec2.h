@@ -0,0 +1,102 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+#pragma once
+
+// C/C++ language includes
+#include <deque>
+#include <map>
+
+// RATGDO project includes
+#include "Sim.h"
+#include "Door.h"
+#include "Packet.h"
+#include "Reader.h"
+
+// A Security+2.0 garage door opener on the simulated bus.
+//
+// Follows docs/syncing.md: the first packet from a client ID it has not seen is
+// ignored, after that a packet is acted on only if its rolling code is ahead of
+// the last one accepted from that client, by no more than rolling_window.  A door
+// button press and its release share a rolling code, so the release is dropped as
+// a repeat.  Answers GetStatus with Status, GetOpenings with Openings and Ping
+// with PingResp, acts on DoorAction, Light and Lock, and sends Status unprompted
+// whenever anything changes.  Replies wait reply_us after the request, and until
+// the bus has been idle for a byte time.
+class SimOpenerSec2 : public sim::Device
+{
+public:
+    struct Config
+    {
+        uint32_t travel_ms = 12000;       // fully open to fully closed
+        uint32_t reply_us = 25000;        // request received to reply on the wire
+        uint32_t rolling_window = 1024;   // how far ahead a client's rolling code may jump
+        uint32_t chatter_ms = 0;          // if set, unprompted Status this often
+        uint32_t remote_id = 0xC27594;    // opener's own client ID
+    };
+
+    explicit SimOpenerSec2(const Config &cfg);
+
+    // Treat client as already paired, so its first packet is not ignored
+    void learn(uint32_t client_id, uint32_t rolling);
+    void set_obstructed(bool obstructed);
+    // Accept the next door, light or lock command but do nothing with it, as
+    // though it had been garbled
+    void miss_next_command(void) { m_miss_next = true; }
+    // Do not send the status when the door next stops, as though it had been garbled
+    void miss_next_arrival(void) { m_miss_arrival = true; }
+    // Hear nothing and send nothing, as though its wires were off
+    void set_unplugged(bool unplugged) { m_unplugged = unplugged; }
+    // Door button on the opener itself, or a remote
+    void press_button(void);
+
+    DoorState door(void) const { return m_door.state(); }
+    bool light(void) const { return m_light; }
+    bool lock(void) const { return m_lock; }
+    uint16_t openings(void) const { return m_door.openings(); }
+
+    uint32_t accepted(void) const { return m_accepted; }
+    uint32_t ignored(void) const { return m_ignored; }
+    uint32_t corrupt(void) const { return m_corrupt; }
+
+    void receive(uint8_t byte, uint64_t at) override;
+    uint64_t next_event(void) const override;
+    void on_event(uint64_t now) override;
+
+private:
+    struct Pending
+    {
+        uint64_t due;
+        uint8_t frame[SECPLUS2_CODE_LEN];
+    };
+
+    Config m_cfg;
+    SecPlus2Reader m_reader;
+    std::map<uint32_t, uint32_t> m_clients; // client ID to last rolling code accepted
+    std::deque<Pending> m_tx;
+    uint32_t m_rolling = 0x100;
+
+    SimDoor m_door;
+    bool m_light = false;
+    bool m_lock = false;
+    bool m_obstructed = false;
+    uint64_t m_next_chatter = sim::NEVER;
+    bool m_miss_next = false;
+    bool m_miss_arrival = false;
+    bool m_unplugged = false;
+
+    uint32_t m_accepted = 0;
+    uint32_t m_ignored = 0;
+    uint32_t m_corrupt = 0;
+
+    void handle(Packet &pkt, uint64_t now);
+    void send(PacketCommand cmd, PacketData data, uint64_t due);
+    void send_status(uint64_t due);
+};
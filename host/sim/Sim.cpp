@@ -0,0 +1,532 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+
+// C/C++ language includes
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+// RATGDO project includes
+#include "bench.h"
+#include "Sim.h"
+#include "Ticker.h"
+#include "ratgdo.h"
+
+namespace sim
+{
+    struct WireByte
+    {
+        uint64_t start;
+        uint64_t end;
+        int16_t byte; // -1 for a break, line held asserted with no data
+        Device *src;  // NULL for ratgdo
+        bool delivered;
+    };
+
+    static uint64_t s_now = 0;
+    static uint64_t s_rnd = 1;
+    static Stats s_stats = {};
+    static std::vector<Device *> s_devices;
+    static std::deque<WireByte> s_wire;
+    static std::vector<Ticker *> s_tickers;
+    static LoopbackBus *s_port = NULL;
+    static bool s_tx_asserted = false;
+    static uint64_t s_tx_asserted_at = 0;
+    static uint64_t s_tx_release_at = NEVER; // end of a LoopbackBus::pulse()
+    static uint64_t s_tx_released = NEVER;   // TX last released, until a write
+    static bool s_notified = false;
+    static Obstruction s_obstruction = Obstruction::Clear;
+    static uint64_t s_next_pulse = 0;
+    static bool s_obst_low = false; // part way through a pulse
+    static bool s_limit_switch = false;
+    static const uint32_t OBST_LOW_US = 1000;
+    static void (*s_isr[GPIO_NUM_MAX])(void) = {};
+
+    static void drive_tx(bool asserted);
+    static int read_pin(uint8_t pin);
+
+    void reset(uint64_t seed)
+    {
+        s_now = 0;
+        s_rnd = seed ? seed : 1;
+        s_stats = {};
+        s_devices.clear();
+        s_wire.clear();
+        s_tx_asserted = false;
+        s_tx_release_at = NEVER;
+        s_tx_released = NEVER;
+        s_notified = false;
+        s_obstruction = Obstruction::Clear;
+        s_next_pulse = 0;
+        s_obst_low = false;
+        s_limit_switch = false;
+    }
+
+    uint64_t now_us(void)
+    {
+        return s_now;
+    }
+
+    Stats &stats(void)
+    {
+        return s_stats;
+    }
+
+    void attach(Device *dev)
+    {
+        s_devices.push_back(dev);
+    }
+
+    uint64_t transmit(Device *dev, const uint8_t *buf, size_t len, uint64_t start,
+                      uint32_t byte_us, uint32_t break_us)
+    {
+        uint64_t t = start;
+        if (!dev && s_tx_released != NEVER)
+        {
+            s_stats.settle.add(start - s_tx_released);
+            s_tx_released = NEVER;
+        }
+        if (break_us)
+        {
+            s_wire.push_back({t, t + break_us, -1, dev, true});
+            t += break_us;
+        }
+        for (size_t i = 0; i < len; i++)
+        {
+            s_wire.push_back({t, t + byte_us, buf[i], dev, false});
+            t += byte_us;
+            s_stats.bus_bytes++;
+            if (!dev)
+                s_stats.firmware_tx++;
+        }
+        return t;
+    }
+
+    bool bus_busy(uint64_t at)
+    {
+        if (s_tx_asserted)
+            return true;
+        for (const WireByte &w : s_wire)
+        {
+            if (w.start <= at && at < w.end)
+                return true;
+        }
+        return false;
+    }
+
+    uint64_t bus_idle_since(void)
+    {
+        if (s_tx_asserted)
+            return NEVER;
+        uint64_t idle = 0;
+        for (const WireByte &w : s_wire)
+            idle = std::max(idle, w.end);
+        return idle;
+    }
+
+    uint64_t line_free_at(uint64_t now, uint32_t gap_us)
+    {
+        // ratgdo holding the line asserted, look again later
+        if (s_tx_asserted)
+            return now + gap_us;
+        return std::max(now, bus_idle_since() + gap_us);
+    }
+
+    void set_obstruction(Obstruction state)
+    {
+        int before = read_pin(INPUT_OBST_PIN);
+        s_obstruction = state;
+        s_obst_low = false;
+        s_next_pulse = s_now + 1000;
+        if (read_pin(INPUT_OBST_PIN) != before && s_isr[INPUT_OBST_PIN])
+            s_isr[INPUT_OBST_PIN]();
+    }
+
+    void set_limit_switch(bool closed)
+    {
+        s_limit_switch = closed;
+    }
+
+    // Anything else driving the line while this byte was being sent garbles it
+    static uint8_t received_value(const WireByte &b)
+    {
+        uint8_t value = (uint8_t)b.byte;
+        bool collided = false;
+        for (const WireByte &w : s_wire)
+        {
+            if (&w == &b || w.src == b.src || w.end <= b.start || w.start >= b.end)
+                continue;
+            value |= (w.byte < 0) ? 0xFF : (uint8_t)w.byte;
+            collided = true;
+        }
+        if (b.src != NULL && s_tx_asserted && s_tx_asserted_at < b.end)
+        {
+            value = 0xFF;
+            collided = true;
+        }
+        if (collided)
+            s_stats.collisions++;
+        return value;
+    }
+
+    static void deliver(WireByte &b)
+    {
+        b.delivered = true;
+        uint8_t value = received_value(b);
+        if (s_port)
+            s_port->receive(value, (uint32_t)(b.end - b.start));
+        for (Device *dev : s_devices)
+        {
+            if (dev != b.src)
+                dev->receive(value, b.end);
+        }
+    }
+
+    void notify(void)
+    {
+        s_notified = true;
+    }
+
+    // Everything due up to us, stopping early if woken
+    static void run(uint64_t us, bool wake)
+    {
+        for (;;)
+        {
+            if (wake && s_notified)
+            {
+                s_notified = false;
+                return;
+            }
+
+            // earliest thing due
+            uint64_t due = NEVER;
+            WireByte *byte = NULL;
+            for (WireByte &w : s_wire)
+            {
+                if (!w.delivered && w.end < due)
+                {
+                    due = w.end;
+                    byte = &w;
+                }
+            }
+            Ticker *ticker = NULL;
+            for (Ticker *t : s_tickers)
+            {
+                if (t->m_due_us < due)
+                {
+                    due = t->m_due_us;
+                    ticker = t;
+                    byte = NULL;
+                }
+            }
+            Device *device = NULL;
+            for (Device *dev : s_devices)
+            {
+                uint64_t next = dev->next_event();
+                if (next < due)
+                {
+                    due = next;
+                    device = dev;
+                    ticker = NULL;
+                    byte = NULL;
+                }
+            }
+            bool pulse = false;
+            if (s_obstruction == Obstruction::Clear && s_next_pulse < due)
+            {
+                due = s_next_pulse;
+                pulse = true;
+                device = NULL;
+                ticker = NULL;
+                byte = NULL;
+            }
+            bool release = false;
+            if (s_tx_release_at < due)
+            {
+                due = s_tx_release_at;
+                release = true;
+                pulse = false;
+                device = NULL;
+                ticker = NULL;
+                byte = NULL;
+            }
+            if (due > us)
+                break;
+
+            s_now = std::max(s_now, due);
+            if (byte)
+                deliver(*byte);
+            else if (ticker)
+            {
+                Ticker::callback_t fn = ticker->m_fn;
+                if (ticker->m_repeat)
+                    ticker->m_due_us += (uint64_t)ticker->m_period_ms * 1000;
+                else
+                    ticker->detach();
+                fn();
+            }
+            else if (device)
+                device->on_event(s_now);
+            else if (release)
+            {
+                s_tx_release_at = NEVER;
+                drive_tx(false);
+            }
+            else if (pulse)
+            {
+                // low for OBST_LOW_US of every 7ms
+                s_obst_low = !s_obst_low;
+                s_next_pulse = s_now + (s_obst_low ? OBST_LOW_US : 7000 - OBST_LOW_US);
+                if (s_isr[INPUT_OBST_PIN])
+                    s_isr[INPUT_OBST_PIN]();
+            }
+
+            // forget bytes that can no longer collide with anything
+            while (!s_wire.empty() && s_wire.front().delivered && s_wire.front().end + 100000 < s_now)
+                s_wire.pop_front();
+        }
+        s_now = std::max(s_now, us);
+    }
+
+    void run_until(uint64_t us)
+    {
+        run(us, false);
+    }
+
+    void sleep_until(uint64_t us)
+    {
+        run(us, true);
+    }
+
+    void Latency::add(uint64_t us)
+    {
+        if (us == NEVER)
+        {
+            lost++;
+            return;
+        }
+        min = std::min(min, us);
+        max = std::max(max, us);
+        sum += us;
+        count++;
+    }
+
+    void Latency::report(const char *label) const
+    {
+        if (!count)
+            fprintf(stderr, "  %-44s all %u lost\n", label, lost);
+        else
+            fprintf(stderr, "  %-44s %8.1f min %8.1f avg %8.1f max ms  (%u runs, %u lost)\n", label,
+                    min / 1e3, sum / 1e3 / count, max / 1e3, count, lost);
+    }
+
+    bool isolated(void (*fn)(void))
+    {
+        fflush(stdout);
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            fn();
+            fflush(stdout);
+            fflush(stderr);
+            _exit(bench_fail_count() ? 1 : 0);
+        }
+        int status = 0;
+        if (pid < 0 || waitpid(pid, &status, 0) != pid)
+            return false;
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    // for the shims below
+    static void attach_port(LoopbackBus *port) { s_port = port; }
+    static void add_ticker(Ticker *t)
+    {
+        if (std::find(s_tickers.begin(), s_tickers.end(), t) == s_tickers.end())
+            s_tickers.push_back(t);
+    }
+    static void remove_ticker(Ticker *t)
+    {
+        s_tickers.erase(std::remove(s_tickers.begin(), s_tickers.end(), t), s_tickers.end());
+    }
+    static void drive_tx(bool asserted)
+    {
+        if (asserted && !s_tx_asserted)
+        {
+            s_tx_asserted_at = s_now;
+            s_stats.firmware_tx++;
+        }
+        else if (!asserted && s_tx_asserted)
+        {
+            s_wire.push_back({s_tx_asserted_at, s_now, -1, NULL, true});
+            s_stats.wake.add(s_now - s_tx_asserted_at);
+            s_tx_released = s_now;
+        }
+        s_tx_asserted = asserted;
+    }
+    static int read_pin(uint8_t pin)
+    {
+        if (pin == UART_RX_PIN)
+            return bus_busy(s_now) ? HIGH : LOW; // inverted, asserted reads high
+        if (pin == INPUT_OBST_PIN)
+            return (s_obstruction == Obstruction::Asleep || s_obst_low) ? LOW : HIGH;
+        if (pin == DRY_CONTACT_OPEN_PIN)
+            return s_limit_switch ? LOW : HIGH;
+        if (pin == DRY_CONTACT_CLOSE_PIN)
+            return HIGH; // pulled up, open
+        return LOW;
+    }
+    static void set_isr(uint8_t pin, void (*isr)(void))
+    {
+        if (pin < GPIO_NUM_MAX)
+            s_isr[pin] = isr;
+    }
+    static long next_random(void)
+    {
+        s_rnd ^= s_rnd >> 12;
+        s_rnd ^= s_rnd << 25;
+        s_rnd ^= s_rnd >> 27;
+        return (long)((s_rnd * 0x2545F4914F6CDD1DULL) >> 33);
+    }
+} // namespace sim
+
+/****************************************************************************
+ * Arduino and FreeRTOS shims, see host/shim/Arduino.h
+ */
+unsigned long millis(void) { return (unsigned long)(sim::now_us() / 1000); }
+unsigned long micros(void) { return (unsigned long)(uint32_t)sim::now_us(); }
+int64_t esp_timer_get_time(void) { return (int64_t)sim::now_us(); }
+void delay(uint32_t ms) { sim::run_for((uint64_t)ms * 1000); }
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    sim::notify();
+    return pdPASS;
+}
+void delayMicroseconds(uint32_t us) { sim::run_for(us); }
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+int digitalRead(uint8_t pin) { return sim::read_pin(pin); }
+int gpio_get_level(gpio_num_t pin) { return sim::read_pin(pin); }
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    if (pin == UART_TX_PIN)
+        sim::drive_tx(val == HIGH);
+}
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode) { sim::set_isr(pin, isr); }
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration) {}
+long random(long min, long max) { return (max > min) ? min + sim::next_random() % (max - min) : min; }
+
+Ticker::~Ticker()
+{
+    detach();
+}
+
+void Ticker::arm(uint32_t ms, callback_t fn, bool repeat)
+{
+    m_fn = fn;
+    m_period_ms = ms;
+    m_repeat = repeat;
+    m_due_us = sim::now_us() + (uint64_t)ms * 1000;
+    sim::add_ticker(this);
+}
+
+void Ticker::detach()
+{
+    m_fn = nullptr;
+    sim::remove_ticker(this);
+}
+
+/****************************************************************************
+ * The firmware's end of the bus
+ */
+namespace sim
+{
+    void LoopbackBus::begin(uint32_t baud, BusParity parity)
+    {
+        uint32_t bits = (parity == BusParity::Even) ? 11 : 10;
+        m_byte_us = (uint32_t)((1000000ULL * bits + baud / 2) / baud);
+        m_rx.clear();
+        m_write_end = 0;
+        attach_port(this);
+    }
+
+    size_t LoopbackBus::read(uint8_t *buf, size_t len)
+    {
+        size_t n = 0;
+        while (n < len && !m_rx.empty())
+        {
+            buf[n++] = m_rx.front();
+            m_rx.pop_front();
+        }
+        return n;
+    }
+
+    bool LoopbackBus::write(const uint8_t *buf, size_t len)
+    {
+        if (!write_done())
+            return false;
+        m_write_end = transmit(NULL, buf, len, s_now, m_byte_us);
+        if (m_blocking_write)
+            run_until(m_write_end);
+        return true;
+    }
+
+    bool LoopbackBus::write_done(void)
+    {
+        return s_now >= m_write_end;
+    }
+
+    void LoopbackBus::flush(void)
+    {
+        run_until(m_write_end);
+    }
+
+    bool LoopbackBus::pulse(uint32_t us)
+    {
+        if (!write_done() || s_tx_release_at != NEVER)
+            return false;
+        drive_tx(true);
+        s_tx_release_at = s_now + us;
+        return true;
+    }
+
+    bool LoopbackBus::line_busy(void)
+    {
+        return bus_busy(s_now);
+    }
+
+    bool LoopbackBus::on_receive(void (*fn)(void *arg), void *arg)
+    {
+        m_on_receive = fn;
+        m_on_receive_arg = arg;
+        return true;
+    }
+
+    void LoopbackBus::receive(uint8_t b, uint32_t byte_us)
+    {
+        if (!m_rx_enabled)
+            return;
+        // more than a quarter out and the sampling lands on the wrong bits
+        if (byte_us * 4 > m_byte_us * 5)
+            b = 0x00;
+        else if (byte_us * 4 < m_byte_us * 3)
+            b = 0xFF;
+        m_rx.push_back(b);
+        if (m_on_receive)
+            m_on_receive(m_on_receive_arg);
+    }
+} // namespace sim
+
+static sim::LoopbackBus loopback_bus;
+GdoBus &gdo_bus = loopback_bus;
@@ -0,0 +1,184 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+#pragma once
+
+// C/C++ language includes
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+
+// RATGDO project includes
+#include "Bus.h"
+
+// Simulated time, GDO bus and pins for running src/comms.cpp on the host against
+// simulated door openers.  Everything is single threaded and deterministic: time
+// only moves when the harness (or code under test, through delay() and blocking
+// bus flushes) asks it to, and every byte, ticker and pin edge due in between
+// is delivered in time order.
+//
+// The bus is the single wire between ratgdo and the opener.  A byte occupies it
+// for its bit time, and every byte is received by everyone on the bus except its
+// sender (ratgdo also hears itself, as the real board does, unless it disabled
+// RX).  Transmissions that overlap in time corrupt each other.
+
+namespace sim
+{
+    const uint64_t NEVER = UINT64_MAX;
+
+    // Something on the bus other than ratgdo, an opener or a wall panel
+    class Device
+    {
+    public:
+        virtual ~Device() = default;
+        // a byte sent by someone else has been received in full at time `at`
+        virtual void receive(uint8_t byte, uint64_t at) = 0;
+        // time the device next wants on_event() called, or NEVER
+        virtual uint64_t next_event(void) const = 0;
+        virtual void on_event(uint64_t now) = 0;
+    };
+
+    // Spread of simulated latencies, NEVER counts as lost
+    struct Latency
+    {
+        uint64_t min = NEVER;
+        uint64_t max = 0;
+        uint64_t sum = 0;
+        uint32_t count = 0;
+        uint32_t lost = 0;
+
+        void add(uint64_t us);
+        void report(const char *label) const;
+    };
+
+    struct Stats
+    {
+        uint32_t bus_bytes;   // bytes put on the wire by anyone
+        uint32_t firmware_tx; // bytes the firmware wrote and times it asserted TX
+        uint32_t collisions;  // bytes received corrupted by an overlapping transmission
+        uint32_t notify_door; // HomeKit door state notifications
+        uint32_t notify_light;
+        uint32_t notify_lock;
+        uint32_t notify_obstruction;
+        Latency wake;   // each time the firmware asserted TX, for how long
+        Latency settle; // releasing TX to the start of the bytes written next
+    };
+
+    // Start over at time zero with an empty bus and no devices
+    void reset(uint64_t seed = 1);
+    uint64_t now_us(void);
+    Stats &stats(void);
+
+    // Advance time, delivering everything due on the way
+    void run_until(uint64_t us);
+    inline void run_for(uint64_t us) { run_until(now_us() + us); }
+
+    // Call loop() every loop_us until done() returns true or timeout_us passes.
+    // Returns time taken, or NEVER on timeout.
+    template <typename L, typename D>
+    uint64_t loop_until(L &&loop, D &&done, uint64_t timeout_us, uint32_t loop_us = 1000)
+    {
+        uint64_t start = now_us();
+        while (now_us() - start < timeout_us)
+        {
+            loop();
+            if (done())
+                return now_us() - start;
+            run_for(loop_us);
+        }
+        return NEVER;
+    }
+
+    void attach(Device *dev);
+
+    // The firmware's comms task, in place of loop_until().  step() does one pass
+    // and returns how long in ms the task may sleep, it sleeps until then or until
+    // notify() (xTaskNotifyGive() on the host) and goes round again.  Returns time
+    // taken, or NEVER on timeout.
+    void notify(void);
+    void sleep_until(uint64_t us);
+    template <typename S, typename D>
+    uint64_t task_until(S &&step, D &&done, uint64_t timeout_us)
+    {
+        uint64_t start = now_us();
+        while (now_us() - start < timeout_us)
+        {
+            uint32_t wait_ms = step();
+            if (done())
+                return now_us() - start;
+            sleep_until(now_us() + (uint64_t)wait_ms * 1000);
+        }
+        return NEVER;
+    }
+
+    // Put bytes on the wire from dev (NULL for ratgdo) starting at `start`, each
+    // taking byte_us, after holding the line asserted for break_us.  Returns the
+    // time the last byte completes.
+    uint64_t transmit(Device *dev, const uint8_t *buf, size_t len, uint64_t start,
+                      uint32_t byte_us, uint32_t break_us = 0);
+    // Is anyone driving the line at time `at`
+    bool bus_busy(uint64_t at);
+    // Time the line was last released (or will be, if busy)
+    uint64_t bus_idle_since(void);
+    // Earliest time from now that the line will have been free for gap_us
+    uint64_t line_free_at(uint64_t now, uint32_t gap_us);
+
+    // Obstruction sensor line as the opener drives it: low for 1ms every 7ms when
+    // clear, steady high when obstructed, low when the opener is asleep.
+    enum class Obstruction
+    {
+        Clear,
+        Obstructed,
+        Asleep,
+    };
+    void set_obstruction(Obstruction state);
+
+    // A dry contact opener's limit switch closed, pulling DRY_CONTACT_OPEN_PIN low
+    void set_limit_switch(bool closed);
+
+    // ratgdo's end of the bus, the firmware's gdo_bus on the host.  What it writes
+    // goes on the wire and, as on the real single wire bus, comes back to its own
+    // receive unless enable_rx(false).  Bytes sent at another speed than begin()
+    // set arrive as 0x00 if slower, 0xFF if faster, as a UART samples them.
+    class LoopbackBus : public GdoBus
+    {
+    public:
+        void begin(uint32_t baud, BusParity parity) override;
+        size_t available(void) override { return m_rx.size(); }
+        size_t read(uint8_t *buf, size_t len) override;
+        bool write(const uint8_t *buf, size_t len) override;
+        bool write_done(void) override;
+        void flush(void) override;
+        bool pulse(uint32_t us) override;
+        bool line_busy(void) override;
+        void enable_rx(bool on) override { m_rx_enabled = on; }
+        bool on_receive(void (*fn)(void *arg), void *arg) override;
+
+        // write() returns once the bytes are out, as software serial does on the
+        // ESP32, rather than when they are on their way
+        void set_blocking_write(bool on) { m_blocking_write = on; }
+
+        // for the simulator, a byte that took byte_us on the wire
+        void receive(uint8_t b, uint32_t byte_us);
+
+    private:
+        std::deque<uint8_t> m_rx;
+        uint32_t m_byte_us = 1042;
+        uint64_t m_write_end = 0;
+        bool m_rx_enabled = true;
+        bool m_blocking_write = false;
+        void (*m_on_receive)(void *arg) = NULL;
+        void *m_on_receive_arg = NULL;
+    };
+
+    // Run fn() in a child process so that it starts from the pristine static state
+    // of comms.cpp, returns false if it failed a self check or crashed.
+    bool isolated(void (*fn)(void));
+} // namespace sim
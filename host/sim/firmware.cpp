@@ -0,0 +1,187 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+
+// C/C++ language includes
+#include <map>
+#include <string>
+
+// RATGDO project includes
+#include "Sim.h"
+#include "ratgdo.h"
+#include "homekit.h"
+#include "config.h"
+#include "utilities.h"
+#include "led.h"
+#include "vehicle.h"
+#include "Transmit.h"
+#include "Flash.h"
+
+// The rest of the firmware as seen by src/comms.cpp when it runs in the simulator.
+// Settings and NVRAM are held in memory, HomeKit notifications are only counted,
+// and restarting does nothing.  The bus itself is sim::LoopbackBus.
+
+GarageDoor garage_door = {};
+bool status_done = false;
+motionTriggersUnion motionTriggers = {};
+bool sim_restart_requested = false;
+
+/****************************************************************************
+ * Settings, with the defaults that comms.cpp reads
+ */
+userSettings *userSettings::instancePtr = new userSettings();
+userSettings *userConfig = userSettings::getInstance();
+
+userSettings::userSettings()
+{
+    settings[cfg_GDOSecurityType] = {true, false, 2, NULL};
+    settings[cfg_TTCseconds] = {false, false, 0, NULL};
+    settings[cfg_motionTriggers] = {false, false, 0, NULL};
+    settings[cfg_softAPmode] = {true, false, false, NULL};
+}
+
+bool userSettings::contains(const std::string &key)
+{
+    return settings.count(key) > 0;
+}
+
+bool userSettings::set(const std::string &key, const bool value)
+{
+    settings[key].value = value;
+    return true;
+}
+
+bool userSettings::set(const std::string &key, const int value)
+{
+    // saved as it is on the ESP32
+    settings[key].value = value;
+    nvRam->write(key, value);
+    return true;
+}
+
+bool userSettings::set(const std::string &key, const std::string &value)
+{
+    settings[key].value = value;
+    return true;
+}
+
+bool userSettings::set(const std::string &key, const char *value)
+{
+    return set(key, std::string(value));
+}
+
+std::variant<bool, int, std::string> userSettings::get(const std::string &key)
+{
+    return settings[key].value;
+}
+
+/****************************************************************************
+ * NVRAM
+ */
+static std::map<std::string, int32_t> nv_values;
+
+nvRamClass *nvRamClass::instancePtr = new nvRamClass();
+nvRamClass *nvRam = nvRamClass::getInstance();
+
+nvRamClass::nvRamClass() : nvHandle(0) {}
+
+int32_t nvRamClass::read(const std::string &constKey, const int32_t dflt)
+{
+    auto it = nv_values.find(constKey);
+    return (it == nv_values.end()) ? dflt : it->second;
+}
+
+bool nvRamClass::write(const std::string &constKey, const int32_t value, bool commit)
+{
+    nv_values[constKey] = value;
+    return true;
+}
+
+bool nvRamClass::erase(const std::string &constKey)
+{
+    return nv_values.erase(constKey) > 0;
+}
+
+/****************************************************************************
+ * Rolling code journal, two sectors as on the ESP32
+ */
+static SimFlash sim_rolling_flash(2);
+JournalFlash &rolling_flash = sim_rolling_flash;
+
+/****************************************************************************
+ * HomeKit
+ */
+void notify_homekit_target_door_state_change() {}
+void notify_homekit_current_door_state_change() { sim::stats().notify_door++; }
+void notify_homekit_target_lock() {}
+void notify_homekit_current_lock() { sim::stats().notify_lock++; }
+void notify_homekit_obstruction() { sim::stats().notify_obstruction++; }
+void notify_homekit_light() { sim::stats().notify_light++; }
+void notify_homekit_motion() {}
+void enable_service_homekit_motion() {}
+
+/****************************************************************************
+ * Vehicle presence
+ */
+void doorOpening() {}
+void doorClosing() {}
+
+/****************************************************************************
+ * LED and utilities
+ */
+LED::LED(uint8_t gpio_num, uint8_t state) : pin(gpio_num) {}
+void LED::flash(unsigned long ms) {}
+LED led(LED_BUILTIN);
+
+void sync_and_restart()
+{
+    sim_restart_requested = true;
+}
+
+/****************************************************************************
+ * SECURITY2.0 transmit timer, the esp_timer of src/transmit.cpp as an event in
+ * simulated time
+ */
+class SimTxTimer : public SecPlus2TxTimer, public sim::Device
+{
+public:
+    void begin(SecPlus2Transmitter *owner) override
+    {
+        // each scenario starts with sim::reset(), which forgets devices
+        m_owner = owner;
+        m_due = sim::NEVER;
+        sim::attach(this);
+    }
+
+    void start(uint32_t us) override
+    {
+        m_due = sim::now_us() + us;
+    }
+
+    void receive(uint8_t byte, uint64_t at) override {}
+
+    uint64_t next_event(void) const override
+    {
+        return m_due;
+    }
+
+    void on_event(uint64_t now) override
+    {
+        m_due = sim::NEVER;
+        m_owner->on_timer();
+    }
+
+private:
+    SecPlus2Transmitter *m_owner = NULL;
+    uint64_t m_due = sim::NEVER;
+};
+
+static SimTxTimer sim_tx_timer;
+SecPlus2TxTimer &sec2_tx_timer = sim_tx_timer;
@@ -0,0 +1,69 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+
+// Compile time description of a field within a 32-bit packet word.  Declare the
+// layout once, for example
+//
+//   using STATUS_DOOR_STATE = BitField<8, 4, DoorState>;
+//
+// and use STATUS_DOOR_STATE::get(word) / STATUS_DOOR_STATE::put(value) to unpack
+// and pack it.  Both are a shift and a mask with no branches, and both are
+// constexpr so layouts can be checked with static_assert.
+template <uint8_t Shift, uint8_t Width, typename T = uint32_t>
+struct BitField
+{
+    static_assert(Width > 0 && Shift + Width <= 32, "BitField must fit in a 32-bit word");
+
+    using type = T;
+    static constexpr uint8_t shift = Shift;
+    static constexpr uint8_t width = Width;
+    static constexpr uint32_t mask = (uint32_t)((1ULL << Width) - 1);
+    static constexpr uint32_t word_mask = mask << Shift;
+
+    static constexpr T get(uint32_t word)
+    {
+        return static_cast<T>((word >> Shift) & mask);
+    }
+
+    // values wider than the field are truncated rather than spilling into neighbours
+    static constexpr uint32_t put(T value)
+    {
+        return (static_cast<uint32_t>(value) & mask) << Shift;
+    }
+};
+
+// A set of fields that together make up one word.  Checks that no two fields
+// overlap and provides the combined mask of all defined bits.
+template <typename... Fields>
+struct BitLayout
+{
+    static constexpr uint32_t mask = (0 | ... | Fields::word_mask);
+    static constexpr bool disjoint = (0 + ... + Fields::width) == __builtin_popcount(mask);
+};
+
+// Round trip check for a single field, for use in static_assert
+template <typename Field>
+constexpr bool bit_field_round_trips(typename Field::type value)
+{
+    return Field::get(Field::put(value)) == value &&
+           (Field::put(value) & ~Field::word_mask) == 0;
+}
+
+static_assert(bit_field_round_trips<BitField<0, 1, bool>>(true), "BitField bool");
+static_assert(bit_field_round_trips<BitField<31, 1, bool>>(true), "BitField top bit");
+static_assert(bit_field_round_trips<BitField<0, 32>>(0xFFFFFFFF), "BitField full word");
+static_assert(BitField<12, 4>::put(0x1F) == 0xF000, "BitField truncates to width");
+static_assert(BitField<12, 4>::get(0xFFFF0FFF) == 0, "BitField ignores neighbouring bits");
+static_assert(BitLayout<BitField<0, 8>, BitField<8, 4>>::disjoint, "BitLayout adjacent fields");
+static_assert(!BitLayout<BitField<0, 8>, BitField<7, 4>>::disjoint, "BitLayout detects overlap");
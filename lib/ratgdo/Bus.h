@@ -0,0 +1,70 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum class BusParity : uint8_t
+{
+    None, // SECURITY2.0, 9600 8N1
+    Even, // SECURITY1.0, 1200 8E1
+};
+
+// The single wire between ratgdo and the door opener, as seen by the protocol code
+// in src/comms.cpp.  Framing is always 8 data bits and one stop bit, and the line
+// is inverted: we assert it by driving TX high, and RX reads high while anyone is
+// asserting it.  Everyone hears every byte, us included unless enable_rx(false).
+//
+// Backends are software serial, the ESP32 hardware UART and software serial receive
+// with RMT transmit (src/bus.cpp, the latter two chosen with GDO_BUS_UART and
+// GDO_BUS_RMT), and on the host the simulator's loopback (host/sim).
+class GdoBus
+{
+public:
+    virtual ~GdoBus() = default;
+
+    // Configure and release the line
+    virtual void begin(uint32_t baud, BusParity parity) = 0;
+
+    // Bytes received and not yet read
+    virtual size_t available(void) = 0;
+    virtual size_t read(uint8_t *buf, size_t len) = 0;
+
+    // Start bytes on their way and return, if the backend can.  Returns false if
+    // an earlier write has not finished.
+    virtual bool write(const uint8_t *buf, size_t len) = 0;
+    virtual bool write_done(void) = 0;
+    // Wait for the last write to finish
+    virtual void flush(void) = 0;
+
+    // Assert the line for us microseconds, to wake the opener, returning at once.
+    // Returns false if the line could not be taken, as for write().
+    virtual bool pulse(uint32_t us) = 0;
+    // Someone, us included, is asserting the line right now
+    virtual bool line_busy(void) = 0;
+
+    // Stop hearing our own writes, or start again
+    virtual void enable_rx(bool on) = 0;
+
+    // Call fn(arg) when bytes arrive, from whatever task the backend receives in.
+    // Returns false if the backend cannot, and must be polled.
+    virtual bool on_receive(void (*fn)(void *arg), void *arg)
+    {
+        return false;
+    }
+
+    int read(void)
+    {
+        uint8_t b;
+        return read(&b, 1) ? b : -1;
+    }
+};
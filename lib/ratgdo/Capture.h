@@ -0,0 +1,162 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+// Raw capture of every byte that passes through the GDO serial port, for building
+// regression corpora from real openers and replaying them on the host (see
+// host/bench_replay.cpp).
+//
+// A capture file is a BusCaptureHeader followed by header.count BusCaptureRecords
+// in the order they were seen, all little endian.  Timestamps are microseconds
+// from any free running clock and wrap at 32 bits, use differences only.  Bytes
+// read in bulk share the timestamp of the read, so within a burst they are only
+// accurate to the polling interval of the comms loop.
+#define BUS_CAPTURE_MAGIC 0x43424752 // "RGBC"
+#define BUS_CAPTURE_VERSION 1
+#define BUS_CAPTURE_DEFAULT_RECORDS 4096
+
+enum BusCaptureDir : uint8_t
+{
+    BUS_CAPTURE_RX = 0,
+    BUS_CAPTURE_TX = 1,
+};
+
+struct __attribute__((packed)) BusCaptureHeader
+{
+    uint32_t magic;
+    uint8_t version;
+    uint8_t protocol; // doorControlType, 1 = Sec+1.0, 2 = Sec+2.0
+    uint16_t record_size;
+    uint32_t count;
+    uint32_t dropped; // oldest records overwritten before download
+};
+
+struct __attribute__((packed)) BusCaptureRecord
+{
+    uint32_t micros;
+    uint8_t byte;
+    uint8_t dir;
+};
+
+// Ring of capture records.  Holds no memory until start() and records nothing
+// while stopped, so the cost when not capturing is a single test per read.
+// Once full the oldest records are overwritten.  Not thread safe, src/comms.cpp
+// records from the comms task while the web server starts, stops and downloads,
+// so it holds a mutex around every call.  Only running() may be called without
+// it, for the test before taking the mutex to record.
+class BusCapture
+{
+private:
+    BusCaptureRecord *m_ring = NULL;
+    size_t m_capacity = 0;
+    size_t m_next = 0;
+    uint32_t m_total = 0;
+    std::atomic<bool> m_running{false};
+    uint8_t m_protocol = 0;
+
+public:
+    BusCapture() = default;
+    ~BusCapture() { free(m_ring); }
+
+    // Discard anything held and start recording into a ring of `records` entries.
+    // Returns false if the memory could not be allocated.
+    bool start(uint8_t protocol, size_t records = BUS_CAPTURE_DEFAULT_RECORDS)
+    {
+        m_running = false;
+        if (records == 0 || records > SIZE_MAX / sizeof(BusCaptureRecord))
+            return false;
+        if (records != m_capacity)
+        {
+            free(m_ring);
+            m_ring = (BusCaptureRecord *)malloc(records * sizeof(BusCaptureRecord));
+            m_capacity = m_ring ? records : 0;
+        }
+        m_next = 0;
+        m_total = 0;
+        m_protocol = protocol;
+        m_running = (m_ring != NULL);
+        return m_running;
+    }
+
+    // Stop recording, what was captured remains available for download
+    void stop(void)
+    {
+        m_running = false;
+    }
+
+    // Stop and give the memory back
+    void clear(void)
+    {
+        m_running = false;
+        free(m_ring);
+        m_ring = NULL;
+        m_capacity = 0;
+        m_next = 0;
+        m_total = 0;
+    }
+
+    void record(const uint8_t *buf, size_t len, BusCaptureDir dir, uint32_t now_us)
+    {
+        if (!m_running)
+            return;
+        for (size_t i = 0; i < len; i++)
+        {
+            m_ring[m_next] = {now_us, buf[i], dir};
+            if (++m_next == m_capacity)
+                m_next = 0;
+        }
+        m_total += len;
+    }
+
+    bool running(void) const { return m_running; }
+    uint32_t total(void) const { return m_total; }
+    size_t count(void) const { return (m_total < m_capacity) ? m_total : m_capacity; }
+
+    BusCaptureHeader header(void) const
+    {
+        return {BUS_CAPTURE_MAGIC, BUS_CAPTURE_VERSION, m_protocol, sizeof(BusCaptureRecord),
+                (uint32_t)count(), (uint32_t)(m_total - count())};
+    }
+
+    // Records oldest first, as at most two contiguous spans.  Calls
+    // out(ptr, bytes) for each, for writing to a file or socket.
+    template <typename F>
+    void for_each_span(F &&out) const
+    {
+        size_t n = count();
+        if (!n)
+            return;
+        size_t first = (n < m_capacity) ? 0 : m_next;
+        size_t len = (first + n > m_capacity) ? m_capacity - first : n;
+        out((const uint8_t *)&m_ring[first], len * sizeof(BusCaptureRecord));
+        if (len < n)
+            out((const uint8_t *)&m_ring[0], (n - len) * sizeof(BusCaptureRecord));
+    }
+};
+
+// Validate a capture file held in memory, returns a pointer to its first record
+// (and the header) or NULL if it is not a capture this code understands.
+inline const BusCaptureRecord *bus_capture_parse(const uint8_t *file, size_t len, BusCaptureHeader &hdr)
+{
+    if (len < sizeof(hdr))
+        return NULL;
+    memcpy(&hdr, file, sizeof(hdr));
+    if (hdr.magic != BUS_CAPTURE_MAGIC || hdr.version != BUS_CAPTURE_VERSION ||
+        hdr.record_size != sizeof(BusCaptureRecord) ||
+        (len - sizeof(hdr)) / sizeof(BusCaptureRecord) < hdr.count)
+        return NULL;
+    return (const BusCaptureRecord *)(file + sizeof(hdr));
+}
@@ -0,0 +1,247 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Transmit.h"
+
+// Decides when a Security+2.0 frame may go out on a bus shared with the opener
+// and any wall panel, which SecPlus2Transmitter only checks for a moment before
+// sending.
+//
+// The bus must have been quiet for IDLE_US, and the frame must fit before any
+// frame we expect: the opener's reply to our last one, after the delay it has
+// been seen to take, or the next frame from a sender that has been sending at a
+// steady period (a wall panel polling, status chatter).  A frame kept waiting
+// MAX_DEFER_US goes in the first idle gap regardless, so a prediction that is
+// wrong, or a bus with no gap long enough, cannot hold it up for ever.  After a collision we back off for a
+// random time in the upper half of a window that doubles with each attempt, so
+// that two senders that collided do not try again together.
+//
+// Times are micros(), wrapping.  Counts retries and time from a frame being
+// ready to it going out.  Not thread safe, only the comms loop uses it.
+class SecPlus2Contention
+{
+public:
+    // our frame on the wire, wake pulse and all
+    static const uint32_t TX_US = SecPlus2Transmitter::WAKE_US + SecPlus2Transmitter::SETTLE_US +
+                                  SECPLUS2_CODE_LEN * 10 * 1000000 / 9600;
+    // anyone else's, from first byte to last
+    static const uint32_t RX_FRAME_US = SECPLUS2_CODE_LEN * 10 * 1000000 / 9600;
+    // quiet for three byte times, so not between two bytes of a frame
+    static const uint32_t IDLE_US = 3000;
+    // margin either side of a frame we expect
+    static const uint32_t GUARD_US = 2000;
+    static const uint32_t BACKOFF_BASE_US = 5000;
+    static const uint32_t BACKOFF_MAX_US = 160000;
+    // a frame this soon after ours is taken to be the reply
+    static const uint32_t REPLY_WINDOW_US = 100000;
+    // longest a frame waits on predictions
+    static const uint32_t MAX_DEFER_US = 250000;
+    // frames further apart than this are not a run
+    static const uint32_t PERIOD_MAX_US = 1000000;
+    // senders whose period is tracked
+    static const size_t SOURCES = 4;
+    // retry counts 0, 1, 2, 3 and more
+    static const size_t RETRY_BUCKETS = 5;
+
+    // Bytes on the bus now, ours included
+    void heard(uint32_t now)
+    {
+        m_last_heard = now;
+        m_heard_any = true;
+    }
+
+    // A whole frame from someone else, client ID id, decoded now
+    void frame(uint32_t now, uint32_t id)
+    {
+        heard(now);
+        Source &src = source(id, now);
+        // a sender keeping to its own period is not answering us
+        if (!src.steady() && m_expect_reply && now - m_tx_end < REPLY_WINDOW_US)
+        {
+            uint32_t delay = now - m_tx_end;
+            m_reply_us = m_reply_us ? (3 * m_reply_us + delay) / 4 : delay;
+        }
+        m_expect_reply = false;
+
+        uint32_t interval = now - src.last;
+        if (src.frames && interval < PERIOD_MAX_US)
+        {
+            uint32_t diff = (interval > src.period_us) ? interval - src.period_us : src.period_us - interval;
+            src.in_step = (src.period_us && diff <= src.period_us / 8) ? src.in_step + 1 : 0;
+            src.period_us = src.period_us ? (3 * src.period_us + interval) / 4 : interval;
+        }
+        else
+        {
+            src.in_step = 0;
+            src.period_us = 0;
+        }
+        src.last = now;
+        src.frames++;
+    }
+
+    // A frame is waiting to go, starts the clock on it if not already
+    void ready(uint32_t now)
+    {
+        if (!m_pending)
+        {
+            m_pending = true;
+            m_ready_at = now;
+        }
+    }
+
+    // Whether to start sending now
+    bool clear(uint32_t now)
+    {
+        if (m_backing_off)
+        {
+            if ((int32_t)(now - m_hold_until) < 0)
+                return false;
+            m_backing_off = false;
+        }
+        if (m_heard_any && now - m_last_heard < IDLE_US)
+            return false;
+        if (m_pending && now - m_ready_at >= MAX_DEFER_US)
+            return true;
+        if (m_expect_reply && m_reply_us && now - m_tx_end < REPLY_WINDOW_US &&
+            collides(now, m_tx_end + m_reply_us))
+            return false;
+        for (const Source &src : m_sources)
+        {
+            if (!src.steady() || now - src.last >= PERIOD_MAX_US)
+                continue;
+            if (collides(now, src.last + src.period_us))
+                return false;
+        }
+        return true;
+    }
+
+    // Someone else had the bus, rnd is any random number
+    void collided(uint32_t now, uint32_t rnd)
+    {
+        m_attempts++;
+        m_collisions++;
+        uint32_t window = BACKOFF_MAX_US;
+        if (m_attempts <= 6 && (BACKOFF_BASE_US << (m_attempts - 1)) < BACKOFF_MAX_US)
+            window = BACKOFF_BASE_US << (m_attempts - 1);
+        m_hold_until = now + window / 2 + rnd % (window / 2 + 1);
+        m_backing_off = true;
+        heard(now);
+    }
+
+    // Our frame finished going out now
+    void sent(uint32_t now)
+    {
+        m_retries[(m_attempts < RETRY_BUCKETS - 1) ? m_attempts : RETRY_BUCKETS - 1]++;
+        uint32_t wait = now - m_ready_at;
+        m_wait_total += wait;
+        if (wait > m_wait_max)
+            m_wait_max = wait;
+        m_sent++;
+        m_tx_end = now;
+        m_expect_reply = true;
+        heard(now);
+        m_attempts = 0;
+        m_pending = false;
+    }
+
+    // Too many collisions, the frame is dropped
+    void gave_up(void)
+    {
+        m_gave_up++;
+        m_attempts = 0;
+        m_pending = false;
+    }
+
+    // Collisions for the frame waiting to go
+    uint32_t attempts(void) const { return m_attempts; }
+    uint32_t collisions(void) const { return m_collisions; }
+    uint32_t given_up(void) const { return m_gave_up; }
+    uint32_t sent_count(void) const { return m_sent; }
+    // Frames that went out after i collisions, the last bucket is that many or more
+    uint32_t retries(size_t i) const { return (i < RETRY_BUCKETS) ? m_retries[i] : 0; }
+    uint32_t wait_avg_us(void) const { return m_sent ? (uint32_t)(m_wait_total / m_sent) : 0; }
+    uint32_t wait_max_us(void) const { return m_wait_max; }
+    // What has been learned, 0 if nothing yet
+    uint32_t reply_us(void) const { return m_reply_us; }
+    // Shortest steady period of any sender
+    uint32_t period_us(void) const
+    {
+        uint32_t period = 0;
+        for (const Source &src : m_sources)
+        {
+            if (src.steady() && (!period || src.period_us < period))
+                period = src.period_us;
+        }
+        return period;
+    }
+
+private:
+    struct Source
+    {
+        uint32_t id = 0;
+        uint32_t frames = 0; // 0 if the slot is free
+        uint32_t last = 0;
+        uint32_t period_us = 0;
+        uint32_t in_step = 0; // intervals in a row close to the period
+
+        bool steady(void) const { return in_step >= 2; }
+    };
+
+    uint32_t m_last_heard = 0;
+    bool m_heard_any = false;
+
+    uint32_t m_tx_end = 0;
+    bool m_expect_reply = false;
+    uint32_t m_reply_us = 0;
+
+    Source m_sources[SOURCES];
+
+    bool m_pending = false;
+    uint32_t m_ready_at = 0;
+    uint32_t m_attempts = 0;
+    bool m_backing_off = false;
+    uint32_t m_hold_until = 0;
+
+    uint32_t m_collisions = 0;
+    uint32_t m_gave_up = 0;
+    uint32_t m_sent = 0;
+    uint32_t m_retries[RETRY_BUCKETS] = {};
+    uint64_t m_wait_total = 0;
+    uint32_t m_wait_max = 0;
+
+    // The slot for id, or the one heard from longest ago
+    Source &source(uint32_t id, uint32_t now)
+    {
+        Source *oldest = &m_sources[0];
+        for (Source &src : m_sources)
+        {
+            if (src.frames && src.id == id)
+                return src;
+            if (!src.frames || (oldest->frames && now - src.last > now - oldest->last))
+                oldest = &src;
+        }
+        *oldest = Source();
+        oldest->id = id;
+        return *oldest;
+    }
+
+    // Would our frame, starting now, overlap one expected to finish at end
+    static bool collides(uint32_t now, uint32_t end)
+    {
+        // already past it, whether it came or not
+        if ((int32_t)(now - (end + GUARD_US)) >= 0)
+            return false;
+        return (int32_t)(now + TX_US + GUARD_US - (end - RX_FRAME_US)) > 0;
+    }
+};
@@ -0,0 +1,104 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include "Packet.h"
+
+// What HomeKit is shown for the door, in HomeKit's CurrentDoorState and
+// TargetDoorState numbering (GarageDoorCurrentState and GarageDoorTargetState
+// in ratgdo.h, which needs HomeSpan).  Not active until the first known state.
+struct DoorView
+{
+    bool active;
+    uint8_t current;
+    uint8_t target;
+};
+
+// Turns a door state reported by the opener, by any protocol, into what HomeKit
+// is shown, and says what changed so that only real changes are notified.
+class DoorReducer
+{
+public:
+    static constexpr uint8_t CURR_OPEN = 0;
+    static constexpr uint8_t CURR_CLOSED = 1;
+    static constexpr uint8_t CURR_OPENING = 2;
+    static constexpr uint8_t CURR_CLOSING = 3;
+    static constexpr uint8_t CURR_STOPPED = 4;
+    static constexpr uint8_t TGT_OPEN = 0;
+    static constexpr uint8_t TGT_CLOSED = 1;
+
+    // Bits of Result::changed
+    static constexpr uint8_t CURRENT = 0x01;
+    static constexpr uint8_t TARGET = 0x02;
+    static constexpr uint8_t ACTIVATED = 0x04;
+
+    struct Result
+    {
+        DoorView door;
+        uint8_t changed;
+    };
+
+    static constexpr Result reduce(const DoorView &door, DoorState state)
+    {
+        const Transition &t = table(state);
+        if (!t.known)
+            return {door, 0};
+        DoorView next = {true, t.current, t.target};
+        uint8_t changed = 0;
+        if (!door.active)
+            changed |= ACTIVATED | CURRENT | TARGET;
+        else
+        {
+            if (next.current != door.current)
+                changed |= CURRENT;
+            if (next.target != door.target)
+                changed |= TARGET;
+        }
+        return {next, changed};
+    }
+
+private:
+    struct Transition
+    {
+        bool known;
+        uint8_t current;
+        uint8_t target;
+    };
+
+    // Indexed by DoorState
+    static constexpr Transition TABLE[] = {
+        {false, 0, 0},                    // Unknown
+        {true, CURR_OPEN, TGT_OPEN},      // Open
+        {true, CURR_CLOSED, TGT_CLOSED},  // Closed
+        {true, CURR_STOPPED, TGT_OPEN},   // Stopped
+        {true, CURR_OPENING, TGT_OPEN},   // Opening
+        {true, CURR_CLOSING, TGT_CLOSED}, // Closing
+    };
+
+    static constexpr const Transition &table(DoorState state)
+    {
+        return ((uint8_t)state < sizeof(TABLE) / sizeof(TABLE[0])) ? TABLE[(uint8_t)state] : TABLE[0];
+    }
+};
+
+static_assert(DoorReducer::reduce({false, 0, 0}, DoorState::Unknown).changed == 0, "unknown state changes nothing");
+static_assert(DoorReducer::reduce({false, 0, 0}, DoorState::Closed).changed ==
+                  (DoorReducer::ACTIVATED | DoorReducer::CURRENT | DoorReducer::TARGET),
+              "first known state activates the door");
+static_assert(DoorReducer::reduce({true, DoorReducer::CURR_OPENING, DoorReducer::TGT_OPEN}, DoorState::Opening).changed == 0,
+              "repeated state changes nothing");
+static_assert(DoorReducer::reduce({true, DoorReducer::CURR_OPEN, DoorReducer::TGT_OPEN}, DoorState::Closing).changed ==
+                  (DoorReducer::CURRENT | DoorReducer::TARGET),
+              "closing an open door changes current and target");
+static_assert(DoorReducer::reduce({true, DoorReducer::CURR_OPENING, DoorReducer::TGT_OPEN}, DoorState::Stopped).changed ==
+                  DoorReducer::CURRENT,
+              "stopping while opening keeps the target");
@@ -0,0 +1,112 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+#pragma once
+
+#include <string.h>
+#include "log.h"
+#include "Packet.h"
+
+// Security+2.0 frames encoded ahead of time for the packets we are most likely to
+// send next, so that transmitting one is a copy rather than a call to encode_wireline().
+//
+// Candidates are registered once with add(), each at an offset from the current
+// rolling code (a door button press and release share a rolling code, the get status
+// that follows uses the next).  While the bus is idle fill_one() encodes one missing
+// candidate per call.  Each entry is tagged with the exact rolling, fixed and data
+// words it was encoded from and is only used on an exact match, so it can never go
+// out with a stale rolling code; set_rolling() drops everything once the code moves.
+template <size_t N>
+class SecPlus2FrameCache
+{
+private:
+    struct Entry
+    {
+        uint64_t fixed;
+        uint32_t data;
+        uint8_t rolling_offset;
+        bool encoded;
+        uint8_t frame[SECPLUS2_CODE_LEN];
+    };
+
+    Entry m_entries[N];
+    size_t m_count = 0;
+    uint32_t m_rolling = 0;
+    uint32_t m_hits = 0;
+    uint32_t m_misses = 0;
+    const char *TAG = "ratgdo-frames";
+
+public:
+    SecPlus2FrameCache() = default;
+
+    // Register a packet to keep pre-encoded at rolling code + rolling_offset
+    bool add(const Packet &pkt, uint8_t rolling_offset = 0)
+    {
+        if (m_count >= N)
+            return false;
+        Entry &e = m_entries[m_count++];
+        pkt.wire_words(e.fixed, e.data);
+        e.rolling_offset = rolling_offset;
+        e.encoded = false;
+        return true;
+    }
+
+    // Call with the current rolling code, drops every entry if it has moved on
+    void set_rolling(uint32_t rolling)
+    {
+        if (rolling == m_rolling)
+            return;
+        m_rolling = rolling;
+        for (size_t i = 0; i < m_count; i++)
+            m_entries[i].encoded = false;
+    }
+
+    // Encode one candidate not yet encoded for the current rolling code.
+    // Returns false when there is nothing left to do.
+    bool fill_one(void)
+    {
+        for (size_t i = 0; i < m_count; i++)
+        {
+            Entry &e = m_entries[i];
+            if (e.encoded)
+                continue;
+            uint32_t rolling = (m_rolling + e.rolling_offset) & 0xFFFFFFF;
+            e.encoded = (encode_wireline(rolling, e.fixed, e.data, e.frame) == 0);
+            return true;
+        }
+        return false;
+    }
+
+    // Same as pkt.encode(rolling, out_pktbuf), from the cache when possible
+    int8_t encode(Packet &pkt, uint32_t rolling, uint8_t *out_pktbuf)
+    {
+        uint64_t fixed;
+        uint32_t data;
+        pkt.wire_words(fixed, data);
+        uint32_t offset = (rolling - m_rolling) & 0xFFFFFFF;
+        for (size_t i = 0; i < m_count; i++)
+        {
+            const Entry &e = m_entries[i];
+            if (e.encoded && e.rolling_offset == offset && e.fixed == fixed && e.data == data)
+            {
+                pkt.m_rolling = rolling;
+                memcpy(out_pktbuf, e.frame, SECPLUS2_CODE_LEN);
+                m_hits++;
+                RDEBUG(TAG, "pre-encoded %08lX %016" PRIX64 " %08lX", rolling, fixed, data);
+                return 0;
+            }
+        }
+        m_misses++;
+        return pkt.encode(rolling, out_pktbuf);
+    }
+
+    uint32_t hits(void) const { return m_hits; }
+    uint32_t misses(void) const { return m_misses; }
+};
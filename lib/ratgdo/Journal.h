@@ -0,0 +1,193 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Raw NOR flash for a Journal, the "rolling" partition on the ESP32
+// (src/journal.cpp) and RAM on the host (host/sim/Flash.h).  Writes can only
+// clear bits, erase sets a whole sector back to 0xFF.
+class JournalFlash
+{
+public:
+    static const size_t SECTOR_SIZE = 4096;
+
+    virtual ~JournalFlash() = default;
+
+    // False if there is no flash to use
+    virtual bool begin(void) = 0;
+    virtual size_t sectors(void) = 0;
+    virtual bool read(size_t offset, void *buf, size_t len) = 0;
+    virtual bool write(size_t offset, const void *buf, size_t len) = 0;
+    virtual bool erase(size_t sector) = 0;
+};
+
+// Append only log of one 32 bit value, for checkpoints that change often (the
+// rolling code) where a key-value store would rewrite and commit every time.
+//
+// Records are 16 bytes, written one after another round the sectors, each with a
+// sequence number and CRC.  begin() scans them all and takes the valid record
+// with the highest sequence, so a write cut short by losing power is skipped and
+// the one before it stands.  A sector is erased only when appending reaches it,
+// by which time it holds the oldest records and the newest are in the sector
+// before, so an erase cut short loses nothing.  Needs at least two sectors.  Not
+// thread safe.
+class Journal
+{
+private:
+    static const uint32_t MAGIC = 0x43524752; // "RGRC"
+
+    struct Record
+    {
+        uint32_t magic;
+        uint32_t seq;
+        uint32_t value;
+        uint32_t crc;
+    };
+    static const size_t PER_SECTOR = JournalFlash::SECTOR_SIZE / sizeof(Record);
+
+    JournalFlash &m_flash;
+    size_t m_slots = 0;
+    size_t m_next = 0; // slot the next record goes in
+    uint32_t m_seq = 0;
+    uint32_t m_value = 0;
+    bool m_empty = true;
+    bool m_ready = false;
+    uint32_t m_appends = 0;
+    uint32_t m_erases = 0;
+    uint32_t m_skipped = 0;
+
+    static uint32_t crc32(const void *data, size_t len)
+    {
+        const uint8_t *p = (const uint8_t *)data;
+        uint32_t crc = 0xFFFFFFFF;
+        while (len--)
+        {
+            crc ^= *p++;
+            for (int k = 0; k < 8; k++)
+                crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+        return ~crc;
+    }
+
+    static uint32_t record_crc(const Record &r)
+    {
+        return crc32(&r, offsetof(Record, crc));
+    }
+
+    static bool blank(const Record &r)
+    {
+        return r.magic == 0xFFFFFFFF && r.seq == 0xFFFFFFFF && r.value == 0xFFFFFFFF && r.crc == 0xFFFFFFFF;
+    }
+
+public:
+    explicit Journal(JournalFlash &flash) : m_flash(flash) {}
+
+    // Find the latest record.  Returns false if there is no flash, in which case
+    // nothing else does anything.
+    bool begin(void)
+    {
+        m_ready = false;
+        m_empty = true;
+        if (!m_flash.begin() || m_flash.sectors() < 2)
+            return false;
+        m_slots = m_flash.sectors() * PER_SECTOR;
+
+        size_t latest = 0;
+        for (size_t i = 0; i < m_slots; i++)
+        {
+            Record r;
+            if (!m_flash.read(i * sizeof(Record), &r, sizeof(r)))
+                return false;
+            if (r.magic != MAGIC || r.crc != record_crc(r))
+            {
+                if (!blank(r))
+                    m_skipped++;
+                continue;
+            }
+            if (m_empty || (int32_t)(r.seq - m_seq) > 0)
+            {
+                m_empty = false;
+                m_seq = r.seq;
+                m_value = r.value;
+                latest = i;
+            }
+        }
+        m_next = m_empty ? 0 : (latest + 1) % m_slots;
+        m_ready = true;
+        return true;
+    }
+
+    bool ready(void) const { return m_ready; }
+    bool empty(void) const { return m_empty; }
+    // Value of the latest record
+    uint32_t last(void) const { return m_value; }
+
+    bool append(uint32_t value)
+    {
+        if (!m_ready)
+            return false;
+        Record r = {MAGIC, m_seq + 1, value, 0};
+        r.crc = record_crc(r);
+        // a slot is only skipped if an earlier write to it was cut short, so
+        // there is no need to go round more than once
+        for (size_t tries = 0; tries < m_slots; tries++)
+        {
+            size_t slot = m_next;
+            m_next = (m_next + 1) % m_slots;
+            if (slot % PER_SECTOR == 0)
+            {
+                if (!m_flash.erase(slot / PER_SECTOR))
+                    return false;
+                m_erases++;
+            }
+            else
+            {
+                Record old;
+                if (!m_flash.read(slot * sizeof(Record), &old, sizeof(old)) || !blank(old))
+                    continue;
+            }
+            Record check;
+            if (!m_flash.write(slot * sizeof(Record), &r, sizeof(r)) ||
+                !m_flash.read(slot * sizeof(Record), &check, sizeof(check)) ||
+                check.crc != r.crc || check.value != value || check.seq != r.seq)
+                continue;
+            m_seq = r.seq;
+            m_value = value;
+            m_empty = false;
+            m_appends++;
+            return true;
+        }
+        return false;
+    }
+
+    // Forget everything
+    bool clear(void)
+    {
+        if (!m_ready)
+            return false;
+        for (size_t s = 0; s < m_slots / PER_SECTOR; s++)
+        {
+            if (!m_flash.erase(s))
+                return false;
+            m_erases++;
+        }
+        m_next = 0;
+        m_empty = true;
+        return true;
+    }
+
+    uint32_t appends(void) const { return m_appends; }
+    uint32_t erases(void) const { return m_erases; }
+    // Records that failed their CRC when scanned, writes cut short
+    uint32_t skipped(void) const { return m_skipped; }
+};
@@ -0,0 +1,156 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum class LinkHealth : uint8_t
+{
+    Unknown, // no ping answered or missed yet
+    Good,
+    Degraded, // last ping not answered
+    Offline,  // OFFLINE_MISSES in a row not answered
+};
+
+// Health of the Security+2.0 link to the opener, from Ping and PingResp.
+//
+// A ping is due every PING_US while the link is good, and every RETRY_US after
+// one goes unanswered, so that a dead bus is noticed quickly without pinging a
+// healthy one much.  The round trip, from our Ping going out to the PingResp
+// being decoded, goes into a histogram of power of 2 buckets from 8ms up.
+//
+// Times are micros(), wrapping.  Not thread safe, only the comms loop uses it.
+class LinkMonitor
+{
+public:
+    static const uint32_t PING_US = 60000000;
+    static const uint32_t RETRY_US = 5000000;
+    static const uint32_t TIMEOUT_US = 1000000;
+    static const uint32_t OFFLINE_MISSES = 3;
+    // bucket i holds round trips below 8ms << i, the last anything longer
+    static const size_t BUCKETS = 8;
+    static const uint32_t BUCKET_BASE_US = 8000;
+
+    // Whether to queue a ping now
+    bool due(uint32_t now) const
+    {
+        if (m_outstanding || m_queued)
+            return false;
+        if (!m_started)
+            return true;
+        return now - m_last_ping >= ((m_misses ? RETRY_US : PING_US));
+    }
+
+    // A ping has been queued, it counts as sent from when it goes out
+    void queued(uint32_t now)
+    {
+        m_queued = true;
+        m_started = true;
+        m_last_ping = now;
+    }
+
+    // Our ping finished going out
+    void sent(uint32_t now)
+    {
+        m_queued = false;
+        m_outstanding = true;
+        m_sent_at = now;
+        m_last_ping = now;
+        m_sent++;
+    }
+
+    // Ping not sent after all, dropped by the transmit queue
+    void dropped(void) { m_queued = false; }
+
+    // PingResp from the opener.  Returns true if the health changed.
+    bool response(uint32_t now)
+    {
+        if (!m_outstanding)
+            return false;
+        m_outstanding = false;
+        uint32_t rtt = now - m_sent_at;
+        size_t i = 0;
+        while (i < BUCKETS - 1 && rtt >= (BUCKET_BASE_US << i))
+            i++;
+        m_histogram[i]++;
+        m_answered++;
+        m_rtt_total += rtt;
+        m_rtt_last = rtt;
+        if (rtt > m_rtt_max)
+            m_rtt_max = rtt;
+        if (!m_rtt_min || rtt < m_rtt_min)
+            m_rtt_min = rtt;
+        m_misses = 0;
+        return set(LinkHealth::Good);
+    }
+
+    // Called often.  Returns true if the health changed.
+    bool poll(uint32_t now)
+    {
+        if (!m_outstanding || now - m_sent_at < TIMEOUT_US)
+            return false;
+        m_outstanding = false;
+        m_lost++;
+        m_misses++;
+        return set((m_misses >= OFFLINE_MISSES) ? LinkHealth::Offline : LinkHealth::Degraded);
+    }
+
+    LinkHealth health(void) const { return m_health; }
+    static const char *name(LinkHealth h)
+    {
+        switch (h)
+        {
+        case LinkHealth::Good:
+            return "good";
+        case LinkHealth::Degraded:
+            return "degraded";
+        case LinkHealth::Offline:
+            return "offline";
+        default:
+            return "unknown";
+        }
+    }
+
+    uint32_t pings_sent(void) const { return m_sent; }
+    uint32_t pings_lost(void) const { return m_lost; }
+    uint32_t rtt_last_us(void) const { return m_rtt_last; }
+    uint32_t rtt_min_us(void) const { return m_rtt_min; }
+    uint32_t rtt_max_us(void) const { return m_rtt_max; }
+    uint32_t rtt_avg_us(void) const { return m_answered ? (uint32_t)(m_rtt_total / m_answered) : 0; }
+    uint32_t histogram(size_t i) const { return (i < BUCKETS) ? m_histogram[i] : 0; }
+
+private:
+    LinkHealth m_health = LinkHealth::Unknown;
+    bool m_started = false;
+    bool m_queued = false;
+    bool m_outstanding = false;
+    uint32_t m_last_ping = 0;
+    uint32_t m_sent_at = 0;
+    uint32_t m_misses = 0;
+
+    uint32_t m_sent = 0;
+    uint32_t m_answered = 0;
+    uint32_t m_lost = 0;
+    uint64_t m_rtt_total = 0;
+    uint32_t m_rtt_last = 0;
+    uint32_t m_rtt_min = 0;
+    uint32_t m_rtt_max = 0;
+    uint32_t m_histogram[BUCKETS] = {};
+
+    bool set(LinkHealth h)
+    {
+        if (h == m_health)
+            return false;
+        m_health = h;
+        return true;
+    }
+};
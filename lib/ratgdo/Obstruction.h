@@ -0,0 +1,197 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// An edge on the obstruction sensor line, the level after it and when
+struct ObstructionEdge
+{
+    uint32_t micros;
+    uint8_t level;
+};
+
+// Edges from the obstruction ISR to the comms loop.  One writer (the ISR) and one
+// reader, no locks; when full new edges are dropped and counted.  N is a power of 2.
+template <size_t N>
+class ObstructionEdgeRing
+{
+    static_assert((N & (N - 1)) == 0, "ring size must be a power of 2");
+
+public:
+    // From the ISR only
+    bool push(uint32_t micros, uint8_t level)
+    {
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) == N)
+        {
+            m_dropped++;
+            return false;
+        }
+        m_ring[head & (N - 1)] = {micros, level};
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // From the loop only
+    bool pop(ObstructionEdge &edge)
+    {
+        uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire))
+            return false;
+        edge = m_ring[tail & (N - 1)];
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    uint32_t dropped(void) const { return m_dropped; }
+
+private:
+    ObstructionEdge m_ring[N];
+    std::atomic<uint32_t> m_head{0};
+    std::atomic<uint32_t> m_tail{0};
+    volatile uint32_t m_dropped = 0;
+};
+
+enum class ObstructionState : uint8_t
+{
+    Unknown,
+    Clear,      // low pulse about every 7ms
+    Obstructed, // steady high
+    Asleep,     // steady low, the opener powers the sensor down
+};
+
+// Works out the obstruction sensor state from the edges on its line.
+//
+// A pulse, falling edge to falling edge, counts if its period is near the
+// sensor's 7ms and the line was low for longer than a glitch but not most of it.
+// One such pulse is enough for Clear.  A line that has not changed for STEADY_US,
+// two periods, is Obstructed if high and Asleep if low.  A sensor
+// waking up holds the line high for a while before it starts pulsing, so a high
+// line within WAKE_US of being Asleep is left as Asleep rather than reported as
+// an obstruction.
+//
+// Times are micros(), wrapping.  Not thread safe, edges come in through an
+// ObstructionEdgeRing.
+class ObstructionClassifier
+{
+public:
+    static const uint32_t PERIOD_MIN_US = 4000;
+    static const uint32_t PERIOD_MAX_US = 12000;
+    // shorter lows are noise
+    static const uint32_t LOW_MIN_US = 20;
+    // most a pulse may be low, percent of its period
+    static const uint32_t DUTY_MAX = 90;
+    static const uint32_t STEADY_US = 14000;
+    static const uint32_t WAKE_US = 700000;
+
+    // An edge to level at us
+    void edge(uint32_t us, uint8_t level)
+    {
+        if (m_have_edge && level == m_level)
+            return; // missed the one in between, nothing to measure
+        if (!level)
+        {
+            if (m_have_fall && m_have_rise && (int32_t)(m_rise - m_fall) > 0)
+                pulse(us - m_fall, m_rise - m_fall);
+            m_fall = us;
+            m_have_fall = true;
+        }
+        else
+        {
+            if (m_state == ObstructionState::Asleep)
+                m_woke = us;
+            m_rise = us;
+            m_have_rise = true;
+        }
+        m_level = level;
+        m_last_edge = us;
+        m_have_edge = true;
+    }
+
+    // Called often, with the line as it reads now.  Returns the state.
+    ObstructionState poll(uint32_t now, uint8_t level)
+    {
+        if (m_have_edge && level != m_level)
+        {
+            // an edge still on its way, or one the ring dropped, in which case
+            // take it as happening now
+            if (now - m_last_edge < STEADY_US)
+                return m_state;
+            edge(now, level);
+            m_have_fall = false;
+            return m_state;
+        }
+        if (!m_have_edge)
+        {
+            // nothing since power up, time it from now
+            m_level = level;
+            m_last_edge = now;
+            m_have_edge = true;
+            m_woke = now;
+            return m_state;
+        }
+        if (now - m_last_edge < STEADY_US)
+            return m_state;
+        m_have_fall = false;
+        if (!level)
+        {
+            m_state = ObstructionState::Asleep;
+        }
+        else if (m_state != ObstructionState::Asleep && m_state != ObstructionState::Unknown)
+        {
+            m_state = ObstructionState::Obstructed;
+        }
+        else if (now - m_woke >= WAKE_US)
+        {
+            // high since waking and still no pulses
+            m_state = ObstructionState::Obstructed;
+        }
+        return m_state;
+    }
+
+    ObstructionState state(void) const { return m_state; }
+    // Last good pulse, duty is percent of the period low
+    uint32_t period_us(void) const { return m_period_us; }
+    uint32_t duty(void) const { return m_duty; }
+    // Pulses that were not near the sensor's, glitches or a sensor going to sleep
+    uint32_t bad_pulses(void) const { return m_bad; }
+
+private:
+    ObstructionState m_state = ObstructionState::Unknown;
+    uint8_t m_level = 0;
+    bool m_have_edge = false;
+    uint32_t m_last_edge = 0;
+    bool m_have_fall = false;
+    uint32_t m_fall = 0;
+    bool m_have_rise = false;
+    uint32_t m_rise = 0;
+    uint32_t m_woke = 0;
+
+    uint32_t m_period_us = 0;
+    uint32_t m_duty = 0;
+    uint32_t m_bad = 0;
+
+    void pulse(uint32_t period, uint32_t low)
+    {
+        uint32_t duty = (uint32_t)((uint64_t)low * 100 / period);
+        if (period < PERIOD_MIN_US || period > PERIOD_MAX_US || low < LOW_MIN_US || duty > DUTY_MAX)
+        {
+            m_bad++;
+            return;
+        }
+        m_period_us = period;
+        m_duty = duty;
+        m_state = ObstructionState::Clear;
+    }
+};
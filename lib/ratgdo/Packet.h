@@ -11,7 +11,13 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include "log.h"
+#include "BitField.h"
 #include "secplus2.h"
+// The wireline codec is the secplus library's.  It is not replaced in tree,
+// an alternative has to be checked bit for bit against this library first.
 #include <secplus.h>
 
 // Chamberlain security+ 2.0 wireline packets (i.e. 0x55, 0x10, 0x00, ...) all decode (using
@@ -59,7 +65,8 @@
 //
 //   Because C++ is a garbage language, bitfields are broken by design, so the elegant method of
 //   specifying bit layout in order to show which bits do which things doesn't work portably. As
-//   such, we get to use mask-and-shift values.
+//   such, each field is declared once as a BitField (see BitField.h) giving its shift and width,
+//   from which the mask-and-shift code is generated.
 //
 //
 // A note on unknowns:
@@ -86,11 +93,10 @@ enum class PacketDataType
 };
 
 // Parity is applicable to all incoming packets; outgoing packets leave this unset
-const uint8_t COMMAND_PARITY_MASK = 0b1111;
-const uint8_t COMMAND_PARITY_SHIFT = 12;
+using COMMAND_PARITY = BitField<12, 4, uint8_t>;
+// Low byte of the data word is the low byte of the 12-bit command, set by Packet
+using COMMAND_BYTE = BitField<0, 8, uint8_t>;
 
-const uint8_t DOOR_ACTION_MASK = 0b11;
-const uint8_t DOOR_ACTION_SHIFT = 8;
 // valid values for DoorActionCommandData
 enum class DoorAction : uint8_t
 {
@@ -100,10 +106,11 @@ enum class DoorAction : uint8_t
     Stop = 3,
 };
 
-const uint8_t DOOR_ACTION_PRESSED_MASK = 0b1;
-const uint8_t DOOR_ACTION_PRESSED_SHIFT = 16;
-const uint8_t DOOR_ACTION_ID_MASK = 0b11; // total guess
-const uint8_t DOOR_ACTION_ID_SHIFT = 24;
+using DOOR_ACTION = BitField<8, 2, DoorAction>;
+using DOOR_ACTION_PRESSED = BitField<16, 1, bool>;
+using DOOR_ACTION_ID = BitField<24, 2, uint8_t>; // total guess
+static_assert(BitLayout<COMMAND_BYTE, DOOR_ACTION, COMMAND_PARITY, DOOR_ACTION_PRESSED, DOOR_ACTION_ID>::disjoint, "DoorAction fields overlap");
+
 // data attached to PacketCommand::DoorAction
 struct DoorActionCommandData
 {
@@ -113,25 +120,21 @@ struct DoorActionCommandData
     uint8_t id;
 
     DoorActionCommandData() = default;
-    DoorActionCommandData(uint32_t pkt_data)
-    {
-        action = static_cast<DoorAction>((pkt_data >> DOOR_ACTION_SHIFT) & DOOR_ACTION_MASK);
-        parity = ((pkt_data >> COMMAND_PARITY_SHIFT) & COMMAND_PARITY_MASK);
-        pressed = ((pkt_data >> DOOR_ACTION_PRESSED_SHIFT) & DOOR_ACTION_PRESSED_MASK);
-        id = ((pkt_data >> DOOR_ACTION_ID_SHIFT) & DOOR_ACTION_ID_MASK);
-    };
+    constexpr DoorActionCommandData(uint32_t pkt_data)
+        : action(DOOR_ACTION::get(pkt_data)),
+          parity(COMMAND_PARITY::get(pkt_data)),
+          pressed(DOOR_ACTION_PRESSED::get(pkt_data)),
+          id(DOOR_ACTION_ID::get(pkt_data)) {};
 
-    uint32_t to_data(void)
+    constexpr uint32_t to_data(void) const
     {
-        uint32_t pkt_data = 0;
-        pkt_data |= static_cast<uint32_t>(action) << DOOR_ACTION_SHIFT;
-        pkt_data |= parity << COMMAND_PARITY_SHIFT;
-        pkt_data |= pressed << DOOR_ACTION_PRESSED_SHIFT;
-        pkt_data |= (id & DOOR_ACTION_ID_MASK) << DOOR_ACTION_ID_SHIFT;
-        return pkt_data;
+        return DOOR_ACTION::put(action) |
+               COMMAND_PARITY::put(parity) |
+               DOOR_ACTION_PRESSED::put(pressed) |
+               DOOR_ACTION_ID::put(id);
     };
 
-    void to_string(char *buf, size_t buflen)
+    void to_string(char *buf, size_t buflen) const
     {
         const char *d = "invalid door action";
         switch (action)
@@ -153,8 +156,6 @@ struct DoorActionCommandData
     };
 };
 
-const uint8_t LOCK_DATA_MASK = 0b11;
-const uint8_t LOCK_DATA_SHIFT = 8;
 // const uint8_t LOCK_DATA_OFF    = 0b00;
 // const uint8_t LOCK_DATA_ON     = 0b01;
 // const uint8_t LOCK_DATA_TOGGLE = 0b10;
@@ -166,6 +167,9 @@ enum class LockState : uint8_t
     Toggle = 2
 };
 
+using LOCK_DATA = BitField<8, 2, LockState>;
+static_assert(BitLayout<COMMAND_BYTE, LOCK_DATA, COMMAND_PARITY>::disjoint, "Lock fields overlap");
+
 // data attached to PacketCommand::Lock
 struct LockCommandData
 {
@@ -174,21 +178,17 @@ struct LockCommandData
     bool pressed;
 
     LockCommandData() = default;
-    LockCommandData(uint32_t pkt_data)
-    {
-        lock = static_cast<LockState>((pkt_data >> LOCK_DATA_SHIFT) & LOCK_DATA_MASK);
-        parity = ((pkt_data >> COMMAND_PARITY_SHIFT) & COMMAND_PARITY_MASK);
-    };
+    constexpr LockCommandData(uint32_t pkt_data)
+        : lock(LOCK_DATA::get(pkt_data)),
+          parity(COMMAND_PARITY::get(pkt_data)),
+          pressed(false) {};
 
-    uint32_t to_data(void)
+    constexpr uint32_t to_data(void) const
     {
-        uint32_t pkt_data = 0;
-        pkt_data |= static_cast<uint32_t>(lock) << LOCK_DATA_SHIFT;
-        pkt_data |= parity << COMMAND_PARITY_SHIFT;
-        return pkt_data;
+        return LOCK_DATA::put(lock) | COMMAND_PARITY::put(parity);
     };
 
-    void to_string(char *buf, size_t buflen)
+    void to_string(char *buf, size_t buflen) const
     {
         const char *l = "invalid lock command";
         switch (lock)
@@ -207,8 +207,6 @@ struct LockCommandData
     };
 };
 
-const uint8_t LIGHT_DATA_MASK = 0b11;
-const uint8_t LIGHT_DATA_SHIFT = 8;
 // const uint8_t LIGHT_DATA_OFF    = 0b00;
 // const uint8_t LIGHT_DATA_ON     = 0b01;
 // const uint8_t LIGHT_DATA_TOGGLE = 0b10;
@@ -222,6 +220,9 @@ enum class LightState : uint8_t
     Toggle2 = 3
 };
 
+using LIGHT_DATA = BitField<8, 2, LightState>;
+static_assert(BitLayout<COMMAND_BYTE, LIGHT_DATA, COMMAND_PARITY>::disjoint, "Light fields overlap");
+
 // data attached to PacketCommand::Light
 struct LightCommandData
 {
@@ -230,21 +231,17 @@ struct LightCommandData
     bool pressed;
 
     LightCommandData() = default;
-    LightCommandData(uint32_t pkt_data)
-    {
-        light = static_cast<LightState>((pkt_data >> LIGHT_DATA_SHIFT) & LIGHT_DATA_MASK);
-        parity = ((pkt_data >> COMMAND_PARITY_SHIFT) & COMMAND_PARITY_MASK);
-    };
+    constexpr LightCommandData(uint32_t pkt_data)
+        : light(LIGHT_DATA::get(pkt_data)),
+          parity(COMMAND_PARITY::get(pkt_data)),
+          pressed(false) {};
 
-    uint32_t to_data(void)
+    constexpr uint32_t to_data(void) const
     {
-        uint32_t pkt_data = 0;
-        pkt_data |= static_cast<uint32_t>(light) << LIGHT_DATA_SHIFT;
-        pkt_data |= parity << COMMAND_PARITY_SHIFT;
-        return pkt_data;
+        return LIGHT_DATA::put(light) | COMMAND_PARITY::put(parity);
     };
 
-    void to_string(char *buf, size_t buflen)
+    void to_string(char *buf, size_t buflen) const
     {
         const char *l = "invalid light command";
         switch (light)
@@ -266,8 +263,6 @@ struct LightCommandData
     };
 };
 
-const uint8_t STATUS_DOOR_STATE_MASK = 0b1111;
-const uint8_t STATUS_DOOR_STATE_SHIFT = 8;
 // valid states for doors in StatusCommandData
 enum class DoorState : uint8_t
 {
@@ -279,16 +274,16 @@ enum class DoorState : uint8_t
     Closing = 5,
 };
 
-const uint8_t STATUS_UNKNOWN1_MASK = 0b1;
-const uint8_t STATUS_UNKNOWN1_SHIFT = 21;
-const uint8_t STATUS_OBSTRUCTION_MASK = 0b1;
-const uint8_t STATUS_OBSTRUCTION_SHIFT = 22;
-const uint8_t STATUS_LOCK_STATE_MASK = 0b1;
-const uint8_t STATUS_LOCK_STATE_SHIFT = 24;
-const uint8_t STATUS_LIGHT_STATE_MASK = 0b1;
-const uint8_t STATUS_LIGHT_STATE_SHIFT = 25;
-const uint8_t STATUS_UNKNOWN2_MASK = 0b1;
-const uint8_t STATUS_UNKNOWN2_SHIFT = 30;
+using STATUS_DOOR_STATE = BitField<8, 4, DoorState>;
+using STATUS_UNKNOWN1 = BitField<21, 1, bool>;
+using STATUS_OBSTRUCTION = BitField<22, 1, bool>;
+using STATUS_LOCK_STATE = BitField<24, 1, bool>;
+using STATUS_LIGHT_STATE = BitField<25, 1, bool>;
+using STATUS_UNKNOWN2 = BitField<30, 1, bool>;
+static_assert(BitLayout<COMMAND_BYTE, STATUS_DOOR_STATE, COMMAND_PARITY, STATUS_UNKNOWN1, STATUS_OBSTRUCTION,
+                        STATUS_LOCK_STATE, STATUS_LIGHT_STATE, STATUS_UNKNOWN2>::disjoint,
+              "Status fields overlap");
+
 // data attached to PacketCommand::Status
 struct StatusCommandData
 {
@@ -302,31 +297,27 @@ struct StatusCommandData
 
     StatusCommandData() = default;
 
-    StatusCommandData(uint32_t pkt_data)
-    {
-        door = static_cast<DoorState>((pkt_data >> STATUS_DOOR_STATE_SHIFT) & STATUS_DOOR_STATE_MASK);
-        parity = ((pkt_data >> COMMAND_PARITY_SHIFT) & COMMAND_PARITY_MASK);
-        unknown1 = ((pkt_data >> STATUS_UNKNOWN1_SHIFT) & STATUS_UNKNOWN1_MASK);
-        obstruction = ((pkt_data >> STATUS_OBSTRUCTION_SHIFT) & STATUS_OBSTRUCTION_MASK);
-        lock = ((pkt_data >> STATUS_LOCK_STATE_SHIFT) & STATUS_LOCK_STATE_MASK);
-        light = ((pkt_data >> STATUS_LIGHT_STATE_SHIFT) & STATUS_LIGHT_STATE_MASK);
-        unknown2 = ((pkt_data >> STATUS_UNKNOWN2_SHIFT) & STATUS_UNKNOWN2_MASK);
-    };
+    constexpr StatusCommandData(uint32_t pkt_data)
+        : door(STATUS_DOOR_STATE::get(pkt_data)),
+          parity(COMMAND_PARITY::get(pkt_data)),
+          unknown1(STATUS_UNKNOWN1::get(pkt_data)),
+          obstruction(STATUS_OBSTRUCTION::get(pkt_data)),
+          lock(STATUS_LOCK_STATE::get(pkt_data)),
+          light(STATUS_LIGHT_STATE::get(pkt_data)),
+          unknown2(STATUS_UNKNOWN2::get(pkt_data)) {};
 
-    uint32_t to_data(void)
+    constexpr uint32_t to_data(void) const
     {
-        uint32_t pkt_data = 0;
-        pkt_data |= static_cast<uint8_t>(door) << STATUS_DOOR_STATE_SHIFT;
-        pkt_data |= parity << COMMAND_PARITY_SHIFT;
-        pkt_data |= unknown1 << STATUS_UNKNOWN1_SHIFT;
-        pkt_data |= obstruction << STATUS_OBSTRUCTION_SHIFT;
-        pkt_data |= lock << STATUS_LOCK_STATE_SHIFT;
-        pkt_data |= light << STATUS_LIGHT_STATE_SHIFT;
-        pkt_data |= unknown2 << STATUS_UNKNOWN2_SHIFT;
-        return pkt_data;
+        return STATUS_DOOR_STATE::put(door) |
+               COMMAND_PARITY::put(parity) |
+               STATUS_UNKNOWN1::put(unknown1) |
+               STATUS_OBSTRUCTION::put(obstruction) |
+               STATUS_LOCK_STATE::put(lock) |
+               STATUS_LIGHT_STATE::put(light) |
+               STATUS_UNKNOWN2::put(unknown2);
     };
 
-    void to_string(char *buf, size_t buflen)
+    void to_string(char *buf, size_t buflen) const
     {
         const char *d = "invalid door state";
         switch (door)
@@ -355,37 +346,29 @@ struct StatusCommandData
     };
 };
 
-const uint8_t GET_OPENINGS_LO_BYTE_MASK = 0xFF;
-const uint8_t GET_OPENINGS_LO_BYTE_SHIFT = 24;
-const uint8_t GET_OPENINGS_HI_BYTE_MASK = 0xFF;
-const uint8_t GET_OPENINGS_HI_BYTE_SHIFT = 16;
+// openings count is sent big endian in the top two bytes, i.e. byte swapped in the word
+using GET_OPENINGS_LO_BYTE = BitField<24, 8, uint8_t>;
+using GET_OPENINGS_HI_BYTE = BitField<16, 8, uint8_t>;
+static_assert(BitLayout<COMMAND_BYTE, COMMAND_PARITY, GET_OPENINGS_HI_BYTE, GET_OPENINGS_LO_BYTE>::disjoint, "Openings fields overlap");
+
 struct OpeningsCommandData
 {
     uint16_t count;
     uint8_t parity;
 
     OpeningsCommandData() = default;
-    OpeningsCommandData(uint32_t pkt_data)
-    {
-        uint8_t lo = ((pkt_data >> GET_OPENINGS_LO_BYTE_SHIFT) & GET_OPENINGS_LO_BYTE_MASK);
-        uint8_t hi = ((pkt_data >> GET_OPENINGS_HI_BYTE_SHIFT) & GET_OPENINGS_HI_BYTE_MASK);
-        parity = ((pkt_data >> COMMAND_PARITY_SHIFT) & COMMAND_PARITY_MASK);
-
-        count = hi << 8 | lo;
-    };
+    constexpr OpeningsCommandData(uint32_t pkt_data)
+        : count(GET_OPENINGS_HI_BYTE::get(pkt_data) << 8 | GET_OPENINGS_LO_BYTE::get(pkt_data)),
+          parity(COMMAND_PARITY::get(pkt_data)) {};
 
-    uint32_t to_data(void)
+    constexpr uint32_t to_data(void) const
     {
-        uint32_t pkt_data = 0;
-        uint8_t lo = count & 0xFF;
-        uint8_t hi = count >> 8;
-        pkt_data |= lo << GET_OPENINGS_LO_BYTE_SHIFT;
-        pkt_data |= hi << GET_OPENINGS_HI_BYTE_SHIFT;
-        pkt_data |= parity << COMMAND_PARITY_SHIFT;
-        return pkt_data;
+        return GET_OPENINGS_LO_BYTE::put(count & 0xFF) |
+               GET_OPENINGS_HI_BYTE::put(count >> 8) |
+               COMMAND_PARITY::put(parity);
     };
 
-    void to_string(char *buf, size_t buflen)
+    void to_string(char *buf, size_t buflen) const
     {
         snprintf(buf, buflen, "Openings %02d", count);
     };
@@ -400,24 +383,49 @@ struct NoData
     uint8_t parity;
 
     NoData() = default;
-    NoData(uint32_t pkt_data)
-    {
-        no_bits_set = pkt_data & ~(COMMAND_PARITY_MASK << COMMAND_PARITY_SHIFT);
-        no_bits_set = no_bits_set & ~0xFF; // skip cmd byte
-        parity = ((pkt_data >> COMMAND_PARITY_SHIFT) & COMMAND_PARITY_MASK);
-    };
+    constexpr NoData(uint32_t pkt_data)
+        : no_bits_set(pkt_data & ~(COMMAND_PARITY::word_mask | COMMAND_BYTE::word_mask)),
+          parity(COMMAND_PARITY::get(pkt_data)) {};
 
-    uint32_t to_data(void)
+    constexpr uint32_t to_data(void) const
     {
-        return no_bits_set | (parity << COMMAND_PARITY_SHIFT);
+        return no_bits_set | COMMAND_PARITY::put(parity);
     };
 
-    void to_string(char *buf, size_t buflen)
+    void to_string(char *buf, size_t buflen) const
     {
-        snprintf(buf, buflen, "Zero: 0x%08lX, Parity: 0x%X", no_bits_set, parity);
+        snprintf(buf, buflen, "Zero: 0x%08" PRIX32 ", Parity: 0x%X", no_bits_set, parity);
     };
 };
 
+// Expected parity nibble of a received packet: the XOR of every nibble of the data word
+// other than the parity nibble itself, and of the command nibble carried in fixed.
+constexpr uint8_t packet_parity(uint64_t fixed, uint32_t pkt_data)
+{
+    uint32_t x = (pkt_data & ~COMMAND_PARITY::word_mask) ^ ((fixed >> 32) & 0xF);
+    x ^= x >> 16;
+    x ^= x >> 8;
+    x ^= x >> 4;
+    return x & 0xF;
+}
+static_assert(packet_parity(0x000000C27594B914, 0x0000F085) == 0xF, "parity of Motion packet in docs/logs/motion.log");
+
+// Round trip every defined bit of each layout through its struct, with the command
+// byte (which belongs to Packet) masked off.
+template <typename Data>
+constexpr bool packet_data_round_trips(uint32_t pkt_data)
+{
+    return Data(pkt_data).to_data() == (pkt_data & ~COMMAND_BYTE::word_mask);
+}
+static_assert(packet_data_round_trips<StatusCommandData>(0x4360F581), "StatusCommandData round trip");
+static_assert(packet_data_round_trips<StatusCommandData>(0x00002281), "StatusCommandData round trip");
+static_assert(packet_data_round_trips<DoorActionCommandData>(0x0301A380), "DoorActionCommandData round trip");
+static_assert(packet_data_round_trips<LockCommandData>(0x0000928C), "LockCommandData round trip");
+static_assert(packet_data_round_trips<LightCommandData>(0x0000F381), "LightCommandData round trip");
+static_assert(packet_data_round_trips<OpeningsCommandData>(0x3412B08C), "OpeningsCommandData round trip");
+static_assert(OpeningsCommandData(0x3412B08C).count == 0x1234, "OpeningsCommandData byte order");
+static_assert(packet_data_round_trips<NoData>(0x0000A080), "NoData round trip");
+
 struct PacketData
 {
     PacketDataType type;
@@ -432,43 +440,99 @@ struct PacketData
         uint32_t cmd;
     } value;
 
-    void to_string(char *buf, size_t buflen)
-    {
-        size_t subbuflen = 128;
-        char subbuf[subbuflen];
-        switch (type)
-        {
-        case PacketDataType::NoData:
-            value.no_data.to_string(subbuf, subbuflen);
-            snprintf(buf, buflen, "NoData: [%s]", subbuf);
-            break;
-        case PacketDataType::Status:
-            value.status.to_string(subbuf, subbuflen);
-            snprintf(buf, buflen, "Status: [%s]", subbuf);
-            break;
-        case PacketDataType::Lock:
-            value.lock.to_string(subbuf, subbuflen);
-            snprintf(buf, buflen, "Lock: [%s]", subbuf);
-            break;
-        case PacketDataType::Light:
-            value.light.to_string(subbuf, subbuflen);
-            snprintf(buf, buflen, "Light: [%s]", subbuf);
-            break;
-        case PacketDataType::DoorAction:
-            value.door_action.to_string(subbuf, subbuflen);
-            snprintf(buf, buflen, "DoorAction: [%s]", subbuf);
-            break;
-        case PacketDataType::Openings:
-            value.openings.to_string(subbuf, subbuflen);
-            snprintf(buf, buflen, "Openings: [%s]", subbuf);
-            break;
-        case PacketDataType::Unknown:
-            snprintf(buf, buflen, "Unknown: [%03lX]", value.cmd);
-            break;
-        }
-    };
+    void to_string(char *buf, size_t buflen) const;
+};
+
+// Per-PacketDataType de/serialization, indexed by PacketDataType.  The decode and
+// encode functions move the command's payload between the union in PacketData and
+// the 32-bit "data" word; the command byte itself is handled by Packet.
+struct PacketDataCodec
+{
+    PacketDataType type;
+    const char *name;
+    void (*decode)(PacketData &data, uint32_t pkt_data);
+    uint32_t (*encode)(const PacketData &data);
+    void (*to_string)(const PacketData &data, char *buf, size_t buflen);
+};
+
+inline constexpr PacketDataCodec PACKET_DATA_CODECS[] = {
+    // NoData is never serialized, outgoing packets of these types carry only the command byte
+    {PacketDataType::NoData, "NoData",
+     [](PacketData &d, uint32_t v)
+     { d.value.no_data = NoData(v); },
+     [](const PacketData &) -> uint32_t
+     { return 0; },
+     [](const PacketData &d, char *buf, size_t buflen)
+     { d.value.no_data.to_string(buf, buflen); }},
+    {PacketDataType::Status, "Status",
+     [](PacketData &d, uint32_t v)
+     { d.value.status = StatusCommandData(v); },
+     [](const PacketData &d) -> uint32_t
+     { return d.value.status.to_data(); },
+     [](const PacketData &d, char *buf, size_t buflen)
+     { d.value.status.to_string(buf, buflen); }},
+    {PacketDataType::Light, "Light",
+     [](PacketData &d, uint32_t v)
+     { d.value.light = LightCommandData(v); },
+     [](const PacketData &d) -> uint32_t
+     { return d.value.light.to_data(); },
+     [](const PacketData &d, char *buf, size_t buflen)
+     { d.value.light.to_string(buf, buflen); }},
+    {PacketDataType::Lock, "Lock",
+     [](PacketData &d, uint32_t v)
+     { d.value.lock = LockCommandData(v); },
+     [](const PacketData &d) -> uint32_t
+     { return d.value.lock.to_data(); },
+     [](const PacketData &d, char *buf, size_t buflen)
+     { d.value.lock.to_string(buf, buflen); }},
+    {PacketDataType::DoorAction, "DoorAction",
+     [](PacketData &d, uint32_t v)
+     { d.value.door_action = DoorActionCommandData(v); },
+     [](const PacketData &d) -> uint32_t
+     { return d.value.door_action.to_data(); },
+     [](const PacketData &d, char *buf, size_t buflen)
+     { d.value.door_action.to_string(buf, buflen); }},
+    {PacketDataType::Openings, "Openings",
+     [](PacketData &d, uint32_t v)
+     { d.value.openings = OpeningsCommandData(v); },
+     [](const PacketData &d) -> uint32_t
+     { return d.value.openings.to_data(); },
+     [](const PacketData &d, char *buf, size_t buflen)
+     { d.value.openings.to_string(buf, buflen); }},
+    // Unknown keeps the raw 12-bit command word, set by Packet, rather than the data word
+    {PacketDataType::Unknown, "Unknown",
+     [](PacketData &, uint32_t) {},
+     [](const PacketData &) -> uint32_t
+     { return 0; },
+     [](const PacketData &d, char *buf, size_t buflen)
+     { snprintf(buf, buflen, "%03" PRIX32, d.value.cmd); }},
 };
 
+constexpr bool packet_data_codecs_in_order()
+{
+    for (size_t i = 0; i < sizeof(PACKET_DATA_CODECS) / sizeof(PACKET_DATA_CODECS[0]); i++)
+    {
+        if (static_cast<size_t>(PACKET_DATA_CODECS[i].type) != i)
+            return false;
+    }
+    return sizeof(PACKET_DATA_CODECS) / sizeof(PACKET_DATA_CODECS[0]) == static_cast<size_t>(PacketDataType::Unknown) + 1;
+}
+static_assert(packet_data_codecs_in_order(), "PACKET_DATA_CODECS must have one entry per PacketDataType, in enum order");
+
+inline const PacketDataCodec &packet_data_codec(PacketDataType type)
+{
+    return PACKET_DATA_CODECS[static_cast<size_t>(type)];
+}
+
+inline void PacketData::to_string(char *buf, size_t buflen) const
+{
+    size_t subbuflen = 128;
+    char subbuf[subbuflen];
+    const PacketDataCodec &codec = packet_data_codec(type);
+    codec.to_string(*this, subbuf, subbuflen);
+    snprintf(buf, buflen, "%s: [%s]", codec.name, subbuf);
+}
+
 class PacketCommand
 {
 public:
@@ -505,117 +569,146 @@ public:
     constexpr operator PacketCommandValue() const { return m_value; };
     explicit operator bool() const = delete;
 
-    static const char *to_string(PacketCommand cmd)
+    static const char *to_string(PacketCommand cmd);
+    static PacketCommand from_word(uint16_t raw);
+    static PacketDataType data_type(PacketCommand cmd);
+
+private:
+    PacketCommandValue m_value;
+};
+
+// Everything known about each command.  To support a new command add its code to
+// PacketCommandValue above and one line here, with the PacketDataType that carries
+// its payload (add a PacketDataType and PACKET_DATA_CODECS entry for a new layout).
+struct PacketCommandInfo
+{
+    PacketCommand::PacketCommandValue value;
+    const char *name;
+    PacketDataType type;
+};
+
+inline constexpr PacketCommandInfo PACKET_COMMANDS[] = {
+    // Unknown must be first, lookups that miss resolve to entry zero
+    {PacketCommand::Unknown, "UNKNOWN", PacketDataType::Unknown},
+    {PacketCommand::GetStatus, "GetStatus", PacketDataType::NoData},
+    {PacketCommand::Status, "Status", PacketDataType::Status},
+    {PacketCommand::Obst1, "Obst1", PacketDataType::NoData},
+    {PacketCommand::Obst2, "Obst2", PacketDataType::NoData},
+    {PacketCommand::Pair3, "Pair3", PacketDataType::NoData},
+    {PacketCommand::Pair3Resp, "Pair3Resp", PacketDataType::NoData},
+    {PacketCommand::Learn2, "Learn2", PacketDataType::NoData},
+    {PacketCommand::Lock, "Lock", PacketDataType::Lock},
+    {PacketCommand::DoorAction, "DoorAction", PacketDataType::DoorAction},
+    {PacketCommand::Light, "Light", PacketDataType::Light},
+    {PacketCommand::MotorOn, "MotorOn", PacketDataType::NoData},
+    {PacketCommand::Motion, "Motion", PacketDataType::NoData},
+    {PacketCommand::Learn1, "Learn1", PacketDataType::NoData},
+    {PacketCommand::Ping, "Ping", PacketDataType::NoData},
+    {PacketCommand::PingResp, "PingResp", PacketDataType::NoData},
+    {PacketCommand::Pair2, "Pair2", PacketDataType::NoData},
+    {PacketCommand::Pair2Resp, "Pair2Resp", PacketDataType::NoData},
+    {PacketCommand::SetTtc, "SetTtc", PacketDataType::NoData},
+    {PacketCommand::CancelTtc, "CancelTtc", PacketDataType::NoData},
+    {PacketCommand::Ttc, "Ttc", PacketDataType::NoData},
+    {PacketCommand::GetOpenings, "GetOpenings", PacketDataType::NoData},
+    {PacketCommand::Openings, "Openings", PacketDataType::Openings},
+};
+
+const size_t PACKET_COMMAND_COUNT = sizeof(PACKET_COMMANDS) / sizeof(PACKET_COMMANDS[0]);
+
+// Command words are 12 bits but sparse, so they are looked up through a minimal
+// multiplicative perfect hash into a 64 entry index.  The multiplier is searched for
+// at compile time, so adding a command to the table above needs no other change.
+const uint8_t PACKET_COMMAND_HASH_BITS = 6;
+const size_t PACKET_COMMAND_HASH_SIZE = 1 << PACKET_COMMAND_HASH_BITS;
+static_assert(PACKET_COMMAND_COUNT < 256, "PacketCommandIndex stores uint8_t table indexes");
+
+constexpr uint8_t packet_command_hash(uint16_t word, uint32_t multiplier)
+{
+    return (uint32_t)(word * multiplier) >> (32 - PACKET_COMMAND_HASH_BITS);
+}
+
+constexpr bool packet_command_hash_is_perfect(uint32_t multiplier)
+{
+    bool used[PACKET_COMMAND_HASH_SIZE] = {};
+    for (size_t i = 0; i < PACKET_COMMAND_COUNT; i++)
     {
-        switch (cmd)
-        {
-        case PacketCommandValue::Unknown:
-            return "UNKNOWN";
-        case PacketCommandValue::GetStatus:
-            return "GetStatus";
-        case PacketCommandValue::Status:
-            return "Status";
-        case PacketCommandValue::Obst1:
-            return "Obst1";
-        case PacketCommandValue::Obst2:
-            return "Obst2";
-        case PacketCommandValue::Pair3:
-            return "Pair3";
-        case PacketCommandValue::Pair3Resp:
-            return "Pair3Resp";
-        case PacketCommandValue::Learn2:
-            return "Learn2";
-        case PacketCommandValue::Lock:
-            return "Lock";
-        case PacketCommandValue::DoorAction:
-            return "DoorAction";
-        case PacketCommandValue::Light:
-            return "Light";
-        case PacketCommandValue::MotorOn:
-            return "MotorOn";
-        case PacketCommandValue::Motion:
-            return "Motion";
-        case PacketCommandValue::Learn1:
-            return "Learn1";
-        case PacketCommandValue::Ping:
-            return "Ping";
-        case PacketCommandValue::PingResp:
-            return "PingResp";
-        case PacketCommandValue::Pair2:
-            return "Pair2";
-        case PacketCommandValue::Pair2Resp:
-            return "Pair2Resp";
-        case PacketCommandValue::SetTtc:
-            return "SetTtc";
-        case PacketCommandValue::CancelTtc:
-            return "CancelTtc";
-        case PacketCommandValue::Ttc:
-            return "Ttc";
-        case PacketCommandValue::GetOpenings:
-            return "GetOpenings";
-        case PacketCommandValue::Openings:
-            return "Openings";
-        }
-        return "Invalid PacketCommandValue";
+        uint8_t slot = packet_command_hash(PACKET_COMMANDS[i].value, multiplier);
+        if (used[slot])
+            return false;
+        used[slot] = true;
     }
+    return true;
+}
 
-    static PacketCommand from_word(uint16_t raw)
+constexpr uint32_t packet_command_find_multiplier()
+{
+    // odd multipliers starting at the golden ratio, stepping by a large even constant so
+    // that successive candidates scatter the (small) command words differently
+    uint32_t multiplier = 0x9E3779B1;
+    for (uint16_t attempt = 0; attempt < 4096; attempt++)
     {
-        switch (raw)
-        {
-        case PacketCommand::GetStatus:
-            return PacketCommand::GetStatus;
-        case PacketCommandValue::Status:
-            return PacketCommandValue::Status;
-        case PacketCommandValue::Obst1:
-            return PacketCommandValue::Obst1;
-        case PacketCommandValue::Obst2:
-            return PacketCommandValue::Obst2;
-        case PacketCommandValue::Pair3:
-            return PacketCommandValue::Pair3;
-        case PacketCommandValue::Pair3Resp:
-            return PacketCommandValue::Pair3Resp;
-        case PacketCommandValue::Learn2:
-            return PacketCommandValue::Learn2;
-        case PacketCommandValue::Lock:
-            return PacketCommandValue::Lock;
-        case PacketCommandValue::DoorAction:
-            return PacketCommandValue::DoorAction;
-        case PacketCommandValue::Light:
-            return PacketCommandValue::Light;
-        case PacketCommandValue::MotorOn:
-            return PacketCommandValue::MotorOn;
-        case PacketCommandValue::Motion:
-            return PacketCommandValue::Motion;
-        case PacketCommandValue::Learn1:
-            return PacketCommandValue::Learn1;
-        case PacketCommandValue::Ping:
-            return PacketCommandValue::Ping;
-        case PacketCommandValue::PingResp:
-            return PacketCommandValue::PingResp;
-        case PacketCommandValue::Pair2:
-            return PacketCommandValue::Pair2;
-        case PacketCommandValue::Pair2Resp:
-            return PacketCommandValue::Pair2Resp;
-        case PacketCommandValue::SetTtc:
-            return PacketCommandValue::SetTtc;
-        case PacketCommandValue::CancelTtc:
-            return PacketCommandValue::CancelTtc;
-        case PacketCommandValue::Ttc:
-            return PacketCommandValue::Ttc;
-        case PacketCommandValue::GetOpenings:
-            return PacketCommandValue::GetOpenings;
-        case PacketCommandValue::Openings:
-            return PacketCommandValue::Openings;
-        default:
-            return PacketCommandValue::Unknown;
-        }
+        if (packet_command_hash_is_perfect(multiplier))
+            return multiplier;
+        multiplier += 0x6A09E668;
     }
+    return 0;
+}
 
-private:
-    PacketCommandValue m_value;
+constexpr uint32_t PACKET_COMMAND_HASH_MULTIPLIER = packet_command_find_multiplier();
+static_assert(PACKET_COMMAND_HASH_MULTIPLIER != 0, "no perfect hash found for PACKET_COMMANDS, increase PACKET_COMMAND_HASH_BITS");
+
+struct PacketCommandIndex
+{
+    uint8_t slot[PACKET_COMMAND_HASH_SIZE];
 };
 
+constexpr PacketCommandIndex packet_command_build_index()
+{
+    PacketCommandIndex index = {};
+    for (size_t i = 0; i < PACKET_COMMAND_COUNT; i++)
+    {
+        index.slot[packet_command_hash(PACKET_COMMANDS[i].value, PACKET_COMMAND_HASH_MULTIPLIER)] = i;
+    }
+    return index;
+}
+
+inline constexpr PacketCommandIndex PACKET_COMMAND_INDEX = packet_command_build_index();
+
+// Returns the PACKET_COMMANDS entry for a 12-bit command word, entry zero (Unknown) if none
+constexpr const PacketCommandInfo &packet_command_info(uint16_t word)
+{
+    const PacketCommandInfo &info = PACKET_COMMANDS[PACKET_COMMAND_INDEX.slot[packet_command_hash(word, PACKET_COMMAND_HASH_MULTIPLIER)]];
+    return (info.value == word) ? info : PACKET_COMMANDS[0];
+}
+
+constexpr bool packet_commands_round_trip()
+{
+    for (size_t i = 0; i < PACKET_COMMAND_COUNT; i++)
+    {
+        if (&packet_command_info(PACKET_COMMANDS[i].value) != &PACKET_COMMANDS[i])
+            return false;
+    }
+    return PACKET_COMMANDS[0].value == PacketCommand::Unknown;
+}
+static_assert(packet_commands_round_trip(), "duplicate command in PACKET_COMMANDS, or Unknown is not first");
+
+inline const char *PacketCommand::to_string(PacketCommand cmd)
+{
+    const PacketCommandInfo &info = packet_command_info(cmd);
+    return (info.value == cmd) ? info.name : "Invalid PacketCommandValue";
+}
+
+inline PacketCommand PacketCommand::from_word(uint16_t raw)
+{
+    return packet_command_info(raw).value;
+}
+
+inline PacketDataType PacketCommand::data_type(PacketCommand cmd)
+{
+    return packet_command_info(cmd).type;
+}
+
 struct Packet
 {
     const char *TAG = "ratgdo-packet";
@@ -630,177 +723,48 @@ struct Packet
         uint32_t pkt_data = 0;
 
         int8_t ret = decode_wireline(pktbuf, &pkt_rolling, &pkt_remote_id, &pkt_data);
-        if (ret < 0)
+        m_decoded = (ret >= 0);
+        m_parity_ok = m_decoded && (COMMAND_PARITY::get(pkt_data) == packet_parity(pkt_remote_id, pkt_data));
+        if (!m_decoded)
         {
-            RERROR(TAG, "Failed to decode packet");
+            RDEBUG(TAG, "Failed to decode packet");
         }
-        RINFO(TAG, "DECODED  %08lX %016" PRIX64 " %08lX", pkt_rolling, pkt_remote_id, pkt_data);
+        RDEBUG(TAG, "DECODED  %08" PRIX32 " %016" PRIX64 " %08" PRIX32, pkt_rolling, pkt_remote_id, pkt_data);
 
         uint16_t cmd = ((pkt_remote_id >> 24) & 0xF00) | (pkt_data & 0xFF);
+        const PacketCommandInfo &info = packet_command_info(cmd);
 
-        m_pkt_cmd = PacketCommand::from_word(cmd);
+        m_pkt_cmd = info.value;
         m_rolling = pkt_rolling;
         m_remote_id = (pkt_remote_id & 0xFFffff);
 
-        switch (m_pkt_cmd)
-        {
-
-        case PacketCommand::Unknown:
-        {
-            m_data.type = PacketDataType::Unknown;
+        m_data.type = info.type;
+        if (info.type == PacketDataType::Unknown)
             m_data.value.cmd = cmd;
-            break;
-        }
-
-        case PacketCommand::GetStatus:
-        {
-            m_data.type = PacketDataType::NoData;
-            m_data.value.no_data = NoData(pkt_data);
-            break;
-        }
-
-        case PacketCommand::Status:
-        {
-            m_data.type = PacketDataType::Status;
-            m_data.value.status = StatusCommandData(pkt_data);
-            break;
-        }
-
-        case PacketCommand::Obst1:
-        case PacketCommand::Obst2:
-        case PacketCommand::Pair3:
-        case PacketCommand::Pair3Resp:
-        case PacketCommand::Learn2:
-            // no data or unimplemented
-            {
-                m_data.type = PacketDataType::NoData;
-                m_data.value.no_data = NoData(pkt_data);
-                break;
-            }
-
-        case PacketCommand::Lock:
-        {
-            m_data.type = PacketDataType::Lock;
-            m_data.value.lock = LockCommandData(pkt_data);
-            break;
-        }
-
-        case PacketCommand::DoorAction:
-        {
-            m_data.type = PacketDataType::DoorAction;
-            m_data.value.door_action = DoorActionCommandData(pkt_data);
-            break;
-        }
+        else
+            packet_data_codec(info.type).decode(m_data, pkt_data);
+    }
 
-        case PacketCommand::Light:
-        {
-            m_data.type = PacketDataType::Light;
-            m_data.value.light = LightCommandData(pkt_data);
-            break;
-        }
+    // The fixed and data words that encode() passes to encode_wireline()
+    void wire_words(uint64_t &fixed, uint32_t &pkt_data) const
+    {
+        auto cmd = static_cast<uint64_t>(m_pkt_cmd);
+        fixed = ((cmd & ~0xff) << 24) | static_cast<uint64_t>(m_remote_id & 0xFFffff);
 
-        case PacketCommand::MotorOn:
-        case PacketCommand::Motion:
-        case PacketCommand::Learn1:
-        case PacketCommand::Ping:
-        case PacketCommand::PingResp:
-        case PacketCommand::Pair2:
-        case PacketCommand::Pair2Resp:
-        case PacketCommand::SetTtc:
-        case PacketCommand::CancelTtc:
-        case PacketCommand::Ttc:
-        case PacketCommand::GetOpenings:
-            // no data or unimplemented
-            {
-                m_data.type = PacketDataType::NoData;
-                m_data.value.no_data = NoData(pkt_data);
-                break;
-            }
-
-        case PacketCommand::Openings:
-        {
-            m_data.type = PacketDataType::Openings;
-            m_data.value.openings = OpeningsCommandData(pkt_data);
-            break;
-        }
-        }
+        // payload layout follows the command, not whatever m_data.type was set to
+        pkt_data = packet_data_codec(PacketCommand::data_type(m_pkt_cmd)).encode(m_data);
+        pkt_data |= (m_pkt_cmd & 0xFF);
     }
 
     int8_t encode(uint32_t rolling, uint8_t *out_pktbuf)
     {
         m_rolling = rolling;
 
-        uint32_t pkt_data = 0;
-        auto cmd = static_cast<uint64_t>(m_pkt_cmd);
-        uint64_t fixed = ((cmd & ~0xff) << 24) | static_cast<uint64_t>(m_remote_id & 0xFFffff);
-
-        switch (m_pkt_cmd)
-        {
-        case PacketCommand::Unknown:
-            // nothing to do?
-            break;
-
-        case PacketCommand::GetStatus:
-            // no data
-            break;
-
-        case PacketCommand::Status:
-        {
-            pkt_data = m_data.value.status.to_data();
-            break;
-        }
-
-        case PacketCommand::Obst1:
-        case PacketCommand::Obst2:
-        case PacketCommand::Pair3:
-        case PacketCommand::Pair3Resp:
-        case PacketCommand::Learn2:
-            // no data or unimplemented
-            break;
-
-        case PacketCommand::Lock:
-        {
-            pkt_data = m_data.value.lock.to_data();
-            break;
-        }
-        break;
-
-        case PacketCommand::DoorAction:
-        {
-            pkt_data = m_data.value.door_action.to_data();
-            break;
-        }
-
-        case PacketCommand::Light:
-        {
-            pkt_data = m_data.value.light.to_data();
-            break;
-        }
-
-        case PacketCommand::MotorOn:
-        case PacketCommand::Motion:
-        case PacketCommand::Learn1:
-        case PacketCommand::Ping:
-        case PacketCommand::PingResp:
-        case PacketCommand::Pair2:
-        case PacketCommand::Pair2Resp:
-        case PacketCommand::SetTtc:
-        case PacketCommand::CancelTtc:
-        case PacketCommand::Ttc:
-        case PacketCommand::GetOpenings:
-            // no data or unimplemented
-            break;
-
-        case PacketCommand::Openings:
-        {
-            pkt_data = m_data.value.openings.to_data();
-            break;
-        }
-        }
-
-        pkt_data |= (m_pkt_cmd & 0xFF);
+        uint64_t fixed;
+        uint32_t pkt_data;
+        wire_words(fixed, pkt_data);
 
-        RINFO(TAG, "ENCODING %08lX %016" PRIX64 " %08lX", m_rolling, fixed, pkt_data);
+        RDEBUG(TAG, "ENCODING %08" PRIX32 " %016" PRIX64 " %08" PRIX32, m_rolling, fixed, pkt_data);
         return encode_wireline(m_rolling, fixed, pkt_data, out_pktbuf);
     }
 
@@ -817,11 +781,18 @@ struct Packet
         char buf[buflen];
         m_data.to_string(buf, buflen);
 
-        RINFO(TAG, "PACKET(0x%lX @ 0x%lX) %s - %s", m_remote_id, m_rolling, PacketCommand::to_string(m_pkt_cmd), buf);
+        RINFO(TAG, "PACKET(0x%" PRIX32 " @ 0x%" PRIX32 ") %s - %s", m_remote_id, m_rolling, PacketCommand::to_string(m_pkt_cmd), buf);
     };
 
+    // decode_wireline() succeeded and the parity nibble matched.  encode_wireline() sets
+    // parity, so this holds for our own frames heard back as for anyone else's.
+    // Packets built locally for sending were never decoded and are always valid.
+    bool valid(void) const { return m_decoded && m_parity_ok; }
+
     PacketCommand m_pkt_cmd;
     PacketData m_data;
     uint32_t m_remote_id; // 3 bytes
     uint32_t m_rolling;
+    bool m_decoded = true;
+    bool m_parity_ok = true;
 };
@@ -0,0 +1,217 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+
+// Numbered as the GDOSecurityType setting
+enum class GdoProtocol : uint8_t
+{
+    Unknown = 0,
+    SecPlus1 = 1,
+    SecPlus2 = 2,
+    DryContact = 3,
+};
+
+// Works out which protocol the door opener speaks, on first boot, by listening
+// only.  Nothing may be sent until it is known: a Security+2.0 sync can look like
+// a button press to a Security+1.0 opener, and with dry contact our TX is the
+// door button.
+//
+// Each round listens at 1200 8E1 for SEC1_LISTEN_MS, then at 9600 8N1 for
+// SEC2_LISTEN_MS, for as many rounds as it takes.  Security+1.0 is settled by
+// SEC1_MESSAGES status replies to a wall panel's polls (a poll byte 0x38 or 0x3A
+// and a plausible answer), or by SEC1_IDLE_STATUS of the same door at rest byte,
+// which an opener with nothing polling it repeats, each alone on the bus for
+// SEC1_IDLE_GAP_MS either side.  Security+2.0 is settled by any valid frame, a
+// wall panel's or the opener's own when the door moves.  Bytes at the wrong speed
+// come in bursts of garbage and look like neither.  Dry contact is settled by a
+// limit switch closed at the end of a round in which nothing was heard at either
+// speed, so a door part way through travelling is found once it gets there.
+//
+// An opener with nothing else on its wires and its door at rest may say nothing
+// at all.  Then this listens until the door is moved with its own button or a
+// remote, or the protocol is chosen in the web page.
+//
+// Times are millis(), wrapping.  Not thread safe, only the comms loop uses it.
+class ProtocolDetector
+{
+public:
+    static const uint32_t SEC1_LISTEN_MS = 4000;
+    static const uint32_t SEC1_MESSAGES = 2;
+    static const uint32_t SEC1_IDLE_STATUS = 3;
+    static const uint32_t SEC1_IDLE_GAP_MS = 400;
+    static const uint32_t SEC2_LISTEN_MS = 3000;
+    // rounds before it is worth saying that nothing has been heard
+    static const uint32_t ROUNDS = 3;
+
+    void begin(uint32_t now)
+    {
+        *this = ProtocolDetector();
+        m_started = now;
+        listen(GdoProtocol::SecPlus1, now);
+    }
+
+    // Speed to listen at, SecPlus1 or SecPlus2, Unknown once done
+    GdoProtocol listening(void) const { return m_listening; }
+    bool done(void) const { return m_done; }
+    GdoProtocol result(void) const { return m_result; }
+    // How long it took, or has taken so far
+    uint32_t elapsed_ms(void) const { return m_took; }
+    // Rounds finished with nothing settled
+    uint32_t rounds(void) const { return m_round; }
+
+    // Any bytes at 9600 baud
+    void sec2_bytes(void)
+    {
+        if (m_listening == GdoProtocol::SecPlus2)
+            m_heard = true;
+    }
+
+    // A valid Security+2.0 frame
+    void sec2_frame(void)
+    {
+        if (m_listening == GdoProtocol::SecPlus2)
+            m_sec2_frames++;
+    }
+
+    // Every byte at 1200 baud
+    void sec1_byte(uint8_t b, uint32_t now)
+    {
+        if (m_listening != GdoProtocol::SecPlus1)
+            return;
+        m_heard = true;
+        bool alone = now - m_last_byte >= SEC1_IDLE_GAP_MS;
+        if (m_candidate)
+            idle_status(alone);
+        m_candidate = alone && (b & 0xF0) == 0x50;
+        m_candidate_byte = b;
+        m_last_byte = now;
+    }
+
+    // A Security+1.0 message, poll byte and answer
+    void sec1_message(uint8_t key, uint8_t val)
+    {
+        if (m_listening == GdoProtocol::SecPlus1 && sec1_status(key, val))
+            m_sec1_messages++;
+    }
+
+    // Either dry contact limit switch closed, right now
+    void dry_contact(bool closed) { m_dry_contact = closed; }
+
+    // Called often.  Returns true when listening() or done() change.
+    bool poll(uint32_t now)
+    {
+        if (m_done)
+            return false;
+        m_took = now - m_started;
+        if (m_listening == GdoProtocol::SecPlus1)
+        {
+            if (m_candidate && now - m_last_byte >= SEC1_IDLE_GAP_MS)
+                idle_status(true);
+            if (m_sec1_messages >= SEC1_MESSAGES || m_sec1_idle >= SEC1_IDLE_STATUS)
+                return finish(GdoProtocol::SecPlus1);
+            if (now - m_since < SEC1_LISTEN_MS)
+                return false;
+            listen(GdoProtocol::SecPlus2, now);
+            return true;
+        }
+        if (m_sec2_frames)
+            return finish(GdoProtocol::SecPlus2);
+        if (now - m_since < SEC2_LISTEN_MS)
+            return false;
+        if (m_dry_contact && !m_heard)
+            return finish(GdoProtocol::DryContact);
+        m_round++;
+        m_heard = false;
+        listen(GdoProtocol::SecPlus1, now);
+        return true;
+    }
+
+    static const char *name(GdoProtocol p)
+    {
+        switch (p)
+        {
+        case GdoProtocol::SecPlus1:
+            return "Security+1.0";
+        case GdoProtocol::SecPlus2:
+            return "Security+2.0";
+        case GdoProtocol::DryContact:
+            return "dry contact";
+        default:
+            return "unknown";
+        }
+    }
+
+    // A plausible Security+1.0 status message, as comms_loop_sec1() checks them
+    static bool sec1_status(uint8_t key, uint8_t val)
+    {
+        switch (key)
+        {
+        case 0x38: // door, 0x0X moving, 0x5X stopped, 0xBX seen at times
+            return (val & 0xF0) == 0x00 || (val & 0xF0) == 0x50 || (val & 0xF0) == 0xB0;
+        case 0x3A: // light and lock
+            return (val & 0xF0) == 0x50;
+        default:
+            return false;
+        }
+    }
+
+private:
+    GdoProtocol m_listening = GdoProtocol::Unknown;
+    GdoProtocol m_result = GdoProtocol::Unknown;
+    bool m_done = false;
+    uint32_t m_started = 0;
+    uint32_t m_since = 0;
+    uint32_t m_took = 0;
+    uint32_t m_round = 0;
+    uint32_t m_sec2_frames = 0;
+    uint32_t m_sec1_messages = 0;
+    uint32_t m_sec1_idle = 0;
+    uint32_t m_last_byte = 0;
+    bool m_candidate = false; // last byte a door state at rest, alone so far
+    uint8_t m_candidate_byte = 0;
+    uint8_t m_idle_byte = 0;
+    bool m_heard = false; // anything at either speed this round
+    bool m_dry_contact = false;
+
+    void listen(GdoProtocol protocol, uint32_t now)
+    {
+        m_listening = protocol;
+        m_since = now;
+        m_sec2_frames = 0;
+        m_sec1_messages = 0;
+        m_sec1_idle = 0;
+        // as if a byte had just been heard, one may have been cut off by the change
+        m_last_byte = now;
+        m_candidate = false;
+    }
+
+    // The door state byte before this one, counted if nothing came close after it
+    void idle_status(bool alone)
+    {
+        m_candidate = false;
+        if (!alone)
+            return;
+        if (m_sec1_idle && m_candidate_byte != m_idle_byte)
+            m_sec1_idle = 0;
+        m_idle_byte = m_candidate_byte;
+        m_sec1_idle++;
+    }
+
+    bool finish(GdoProtocol result)
+    {
+        m_result = result;
+        m_listening = GdoProtocol::Unknown;
+        m_done = true;
+        return true;
+    }
+};
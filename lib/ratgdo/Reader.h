@@ -10,7 +10,10 @@
  */
 #pragma once
 
-#include <secplus2.h>
+#include <string.h>
+#include <inttypes.h>
+#include "log.h"
+#include "secplus2.h"
 
 enum SecPlus2ReaderMode : uint8_t
 {
@@ -26,23 +29,149 @@ private:
     size_t m_byte_count = 0;
     uint8_t m_rx_buf[SECPLUS2_CODE_LEN] = {0x55, 0x01, 0x00};
     SecPlus2ReaderMode m_mode = SCANNING;
+    uint32_t m_gap_timeout = SECPLUS2_GAP_TIMEOUT_MS;
+    uint32_t m_last_byte_at = 0;
+    uint32_t m_lost_count = 0;
+    uint32_t m_resync_count = 0;
     const char *TAG = "ratgdo-reader";
 
+    // Shift one byte into the 24-bit window, true if it now holds the preamble
+    bool shift_window(uint8_t inp)
+    {
+        m_msg_start = ((m_msg_start << 8) | inp) & 0x00FFFFFF;
+        return m_msg_start == SECPLUS2_PREAMBLE;
+    }
+
+    // Returns pointer to the first complete preamble (0x55 0x01 0x00) that lies wholly
+    // within [p, end), or NULL.  Skips four bytes at a time while none of them is 0x55.
+    static const uint8_t *find_preamble(const uint8_t *p, const uint8_t *end)
+    {
+        const uint32_t ones = 0x01010101;
+        const uint32_t highs = 0x80808080;
+        while (end - p >= 3)
+        {
+            if (end - p >= 4)
+            {
+                uint32_t word;
+                memcpy(&word, p, sizeof(word));
+                word ^= 0x55555555;
+                // high bit set in each byte that was 0x55, lowest one is exact
+                uint32_t found = (word - ones) & ~word & highs;
+                if (!found)
+                {
+                    p += 4;
+                    continue;
+                }
+                p += __builtin_ctz(found) >> 3; // little endian: lowest set bit is first byte
+            }
+            else if (p[0] != 0x55)
+            {
+                p++;
+                continue;
+            }
+            if (end - p >= 3 && p[1] == 0x01 && p[2] == 0x00)
+                return p;
+            p++;
+        }
+        return NULL;
+    }
+
+    // Scan for the preamble, switching to RECEIVING and returning the byte after it when
+    // found.  Otherwise returns end with the window holding the last bytes seen.
+    const uint8_t *scan(const uint8_t *p, const uint8_t *end)
+    {
+        const uint8_t *start = p;
+        // a preamble that started in an earlier buffer completes within the first two bytes
+        for (; p < end && p < start + 2; p++)
+        {
+            if (shift_window(*p))
+            {
+                m_byte_count = 3;
+                m_mode = RECEIVING;
+                return p + 1;
+            }
+        }
+        // any other preamble lies wholly within this buffer
+        const uint8_t *found = find_preamble(start, end);
+        if (found)
+        {
+            m_byte_count = 3;
+            m_mode = RECEIVING;
+            return found + 3;
+        }
+        for (p = (end - p > 2) ? end - 2 : p; p < end; p++)
+            shift_window(*p);
+        return end;
+    }
+
+    // The partial frame is being thrown away.  Rescan the bytes taken into it after the
+    // preamble, if they hold a fresh preamble then restart the frame from there, otherwise
+    // go back to scanning with the last of those bytes in the window.
+    void resync(void)
+    {
+        const uint8_t *end = &m_rx_buf[m_byte_count];
+        const uint8_t *found = find_preamble(&m_rx_buf[3], end);
+        if (found)
+        {
+            m_byte_count = end - found;
+            memmove(m_rx_buf, found, m_byte_count);
+            m_resync_count++;
+            RDEBUG(TAG, "reader resynced on preamble in discarded bytes");
+            return;
+        }
+        m_mode = SCANNING;
+        m_msg_start = 0;
+        for (size_t n = (m_byte_count > 5) ? m_byte_count - 2 : 3; n < m_byte_count; n++)
+            shift_window(m_rx_buf[n]);
+    }
+
+    // Called with the time that bytes about to be pushed were received.  A gap within a
+    // frame means bytes were lost, so the partial frame would only swallow the next one.
+    void check_gap(uint32_t now)
+    {
+        if (m_mode == RECEIVING && m_gap_timeout && (now - m_last_byte_at) > m_gap_timeout)
+        {
+            RDEBUG(TAG, "reader abandoned partial packet of %zu bytes after %" PRIu32 " ms gap", m_byte_count, now - m_last_byte_at);
+            m_lost_count++;
+            resync();
+        }
+        m_last_byte_at = now;
+    }
+
+    // Frame buffer is full, returns true if it should be delivered.  A preamble within
+    // the body means bytes were dropped and the next frame has already started.
+    bool complete_frame(void)
+    {
+        if (find_preamble(&m_rx_buf[3], &m_rx_buf[SECPLUS2_CODE_LEN]))
+        {
+            RDEBUG(TAG, "reader found preamble inside packet, discarding");
+            m_lost_count++;
+            resync();
+            return false;
+        }
+        m_mode = SCANNING;
+        // keep the tail in the window in case the frame was short and the next preamble
+        // began in its last bytes
+        m_msg_start = 0;
+        shift_window(m_rx_buf[SECPLUS2_CODE_LEN - 2]);
+        shift_window(m_rx_buf[SECPLUS2_CODE_LEN - 1]);
+        RDEBUG(TAG, "reader completed packet");
+        return true;
+    }
+
 public:
     SecPlus2Reader() = default;
 
-    bool push_byte(uint8_t inp)
+    // Push one byte received at time now (milliseconds, any monotonic clock).
+    // Returns true when a frame is ready in fetch_buf().
+    bool push_byte(uint8_t inp, uint32_t now)
     {
-        bool msg_ready = false;
+        check_gap(now);
 
         switch (m_mode)
         {
         case SCANNING:
-            m_msg_start <<= 8;
-            m_msg_start |= inp;
-            m_msg_start &= 0x00FFFFFF;
-
-            if (m_msg_start == SECPLUS2_PREAMBLE)
+            if (shift_window(inp))
             {
                 m_byte_count = 3;
                 m_mode = RECEIVING;
@@ -54,23 +183,187 @@ public:
             m_byte_count += 1;
 
             if (m_byte_count == SECPLUS2_CODE_LEN)
-            {
-                m_mode = SCANNING;
-                m_msg_start = 0;
-                msg_ready = true;
-            }
+                return complete_frame();
             break;
         }
+        return false;
+    };
 
-        if (msg_ready)
+    // Feed a whole buffer of bytes received at time now, calling on_frame(fetch_buf())
+    // for every frame completed within it.  Equivalent to calling push_byte() for each
+    // byte, but searches for the preamble a word at a time and copies frame bodies in
+    // bulk.  The frame passed to on_frame is only valid until it returns.  Returns
+    // frame count.
+    template <typename F>
+    size_t push_bytes(const uint8_t *buf, size_t len, uint32_t now, F &&on_frame)
+    {
+        const uint8_t *p = buf;
+        const uint8_t *end = buf + len;
+        size_t frames = 0;
+
+        if (len)
+            check_gap(now);
+
+        while (p < end)
         {
-            RINFO(TAG, "reader completed packet");
+            if (m_mode == SCANNING)
+            {
+                p = scan(p, end);
+                continue;
+            }
+
+            size_t n = SECPLUS2_CODE_LEN - m_byte_count;
+            if (n > (size_t)(end - p))
+                n = end - p;
+            memcpy(&m_rx_buf[m_byte_count], p, n);
+            m_byte_count += n;
+            p += n;
+
+            if (m_byte_count == SECPLUS2_CODE_LEN && complete_frame())
+            {
+                frames++;
+                on_frame(m_rx_buf);
+            }
         }
-        return msg_ready;
-    };
+        return frames;
+    }
 
     uint8_t *fetch_buf(void)
     {
         return m_rx_buf;
     }
+
+    // Longest silence allowed within a frame before it is abandoned, 0 to disable
+    void set_gap_timeout(uint32_t ms)
+    {
+        m_gap_timeout = ms;
+    }
+
+    // Partial or damaged frames thrown away
+    uint32_t lost_count(void) const
+    {
+        return m_lost_count;
+    }
+
+    // Frames recovered by finding their preamble in bytes already thrown away
+    uint32_t resync_count(void) const
+    {
+        return m_resync_count;
+    }
+};
+
+// Security+1.0 messages are single bytes 0x30-0x3A at 1200 baud.  0x30-0x37 are button
+// presses and releases from the wall panel and stand alone, 0x38-0x3A are status polls
+// and are followed by the opener's one byte reply.
+const uint8_t SECPLUS1_FIRST_CODE = 0x30;
+const uint8_t SECPLUS1_LAST_BUTTON = 0x37;
+const uint8_t SECPLUS1_LAST_CODE = 0x3A;
+const uint8_t SECPLUS1_MSG_LEN = 2;
+// a full message arrives in about 20ms, a reply later than this is not coming
+const uint32_t SECPLUS1_GAP_TIMEOUT_MS = 100;
+
+// Message length by first byte, from SECPLUS1_FIRST_CODE
+constexpr uint8_t SECPLUS1_FRAME_LEN[SECPLUS1_LAST_CODE - SECPLUS1_FIRST_CODE + 1] = {
+    1, 1, 1, 1, 1, 1, 1, 1, // 0x30-0x37 buttons
+    2, 2, 2,                // 0x38-0x3A status polls
+};
+
+// The same for every byte value, 0 for a byte that cannot start a message, so that
+// framing a byte is one load with no range checks
+struct SecPlus1FrameLens
+{
+    uint8_t len[256];
+};
+constexpr SecPlus1FrameLens secplus1_frame_lens(void)
+{
+    SecPlus1FrameLens t = {};
+    for (int code = SECPLUS1_FIRST_CODE; code <= SECPLUS1_LAST_CODE; code++)
+        t.len[code] = SECPLUS1_FRAME_LEN[code - SECPLUS1_FIRST_CODE];
+    return t;
+}
+inline constexpr SecPlus1FrameLens SECPLUS1_FRAME_LENS = secplus1_frame_lens();
+
+constexpr uint8_t secplus1_frame_len(uint8_t code)
+{
+    return SECPLUS1_FRAME_LENS.len[code];
+}
+static_assert(secplus1_frame_len(0x2F) == 0 && secplus1_frame_len(SECPLUS1_LAST_BUTTON) == 1 &&
+                  secplus1_frame_len(SECPLUS1_LAST_BUTTON + 1) == SECPLUS1_MSG_LEN &&
+                  secplus1_frame_len(SECPLUS1_LAST_CODE) == SECPLUS1_MSG_LEN && secplus1_frame_len(0x3B) == 0,
+              "buttons stand alone, polls take a reply");
+
+class SecPlus1Reader
+{
+private:
+    uint8_t m_byte_count = 0;
+    uint8_t m_need = 0; // bytes still to come of the message in m_rx_buf
+    uint8_t m_rx_buf[SECPLUS1_MSG_LEN] = {0};
+    uint32_t m_last_byte_at = 0;
+    uint32_t m_lost_count = 0;
+    const char *TAG = "ratgdo-reader";
+
+    void lost(void)
+    {
+        RINFO(TAG, "RX message timeout");
+        m_need = 0;
+        m_lost_count++;
+    }
+
+public:
+    SecPlus1Reader() = default;
+
+    // Push one byte received at time now (milliseconds).  Returns true when a
+    // message is ready in fetch_buf(), key in [0] and value (0 for buttons) in [1].
+    bool push_byte(uint8_t inp, uint32_t now)
+    {
+        uint32_t gap = now - m_last_byte_at;
+        m_last_byte_at = now;
+
+        if (m_need)
+        {
+            if (gap <= SECPLUS1_GAP_TIMEOUT_MS)
+            {
+                m_rx_buf[m_byte_count++] = inp;
+                return --m_need == 0;
+            }
+            // overdue, this byte is read as the start of the next message
+            lost();
+        }
+
+        uint8_t len = secplus1_frame_len(inp);
+        if (!len)
+            return false;
+        m_rx_buf[0] = inp;
+        m_rx_buf[1] = 0;
+        m_byte_count = 1;
+        m_need = len - 1;
+        return m_need == 0;
+    }
+
+    // Throw away a partial message whose reply is overdue at time now, whether or
+    // not another byte has arrived.  Returns true if there was one.
+    bool expire(uint32_t now)
+    {
+        if (!m_need || (now - m_last_byte_at) <= SECPLUS1_GAP_TIMEOUT_MS)
+            return false;
+        lost();
+        return true;
+    }
+
+    // Part way through a message
+    bool pending(void) const
+    {
+        return m_need != 0;
+    }
+
+    const uint8_t *fetch_buf(void) const
+    {
+        return m_rx_buf;
+    }
+
+    // Partial messages thrown away
+    uint32_t lost_count(void) const
+    {
+        return m_lost_count;
+    }
 };
@@ -0,0 +1,244 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Lanes in priority order, a lane is only sent from when those above it are empty
+enum class CommandLane : uint8_t
+{
+    Door,    // door button press and release
+    Control, // light and lock
+    Poll,    // get status, and wall panel emulation polls
+};
+const size_t COMMAND_LANES = 3;
+
+// Transmit scheduler for what we send to the door opener, in place of a single FIFO.
+//
+// Everything one command needs (a button press and its releases, say) is pushed as
+// a group that is accepted whole or not at all and carries one sequence ID.  pop()
+// takes from the highest priority lane that has anything waiting, except that once
+// a group has started going out the rest of it follows before anything else, so a
+// press is never parted from its release.  A push with a coalesce key that matches
+// one already waiting in the lane is a duplicate (another get status, the same
+// poll) and is dropped, returning the ID of the one waiting.  Each lane holds N
+// items.  Not thread safe, callers serialize access.
+template <typename T, size_t N>
+class CommandScheduler
+{
+private:
+    struct Entry
+    {
+        T item;
+        uint32_t seq;
+        uint32_t key;
+    };
+
+    struct Lane
+    {
+        Entry ring[N];
+        size_t head = 0;
+        size_t count = 0;
+        size_t high_water = 0;
+        uint32_t dropped = 0;
+
+        Entry &at(size_t i) { return ring[(head + i) % N]; }
+        const Entry &at(size_t i) const { return ring[(head + i) % N]; }
+    };
+
+    Lane m_lanes[COMMAND_LANES];
+    uint32_t m_next_seq = 1;
+    size_t m_high_water = 0;
+    uint32_t m_coalesced = 0;
+    uint32_t m_retries = 0;
+    // where the last item popped came from, to keep its group together and for retry()
+    size_t m_last_lane = COMMAND_LANES;
+    uint32_t m_last_seq = 0;
+    uint32_t m_last_key = 0;
+
+    void note_depth(Lane &lane)
+    {
+        if (lane.count > lane.high_water)
+            lane.high_water = lane.count;
+        size_t total = depth();
+        if (total > m_high_water)
+            m_high_water = total;
+    }
+
+public:
+    CommandScheduler() = default;
+
+    // Queue count items as one command.  Returns its sequence ID, or 0 if the lane
+    // does not have room for all of them.
+    uint32_t push(CommandLane which, const T *items, size_t count, uint32_t coalesce_key = 0)
+    {
+        Lane &lane = m_lanes[static_cast<size_t>(which)];
+        if (coalesce_key)
+        {
+            for (size_t i = 0; i < lane.count; i++)
+            {
+                if (lane.at(i).key == coalesce_key)
+                {
+                    m_coalesced++;
+                    return lane.at(i).seq;
+                }
+            }
+        }
+        if (count == 0 || lane.count + count > N)
+        {
+            lane.dropped++;
+            return 0;
+        }
+
+        uint32_t seq = m_next_seq++;
+        if (m_next_seq == 0)
+            m_next_seq = 1;
+        for (size_t i = 0; i < count; i++)
+        {
+            Entry &e = lane.at(lane.count++);
+            e.item = items[i];
+            e.seq = seq;
+            e.key = coalesce_key;
+        }
+        note_depth(lane);
+        return seq;
+    }
+
+    uint32_t push(CommandLane which, const T &item, uint32_t coalesce_key = 0)
+    {
+        return push(which, &item, 1, coalesce_key);
+    }
+
+    // Take the next item to send.  seq, if given, is set to its command's ID.
+    bool pop(T &item, uint32_t *seq = nullptr)
+    {
+        size_t from = COMMAND_LANES;
+        // finish the group already started
+        if (m_last_lane < COMMAND_LANES)
+        {
+            const Lane &last = m_lanes[m_last_lane];
+            if (last.count && last.at(0).seq == m_last_seq)
+                from = m_last_lane;
+        }
+        for (size_t i = 0; from == COMMAND_LANES && i < COMMAND_LANES; i++)
+        {
+            if (m_lanes[i].count)
+                from = i;
+        }
+        if (from == COMMAND_LANES)
+            return false;
+
+        Lane &lane = m_lanes[from];
+        Entry &e = lane.at(0);
+        item = e.item;
+        m_last_lane = from;
+        m_last_seq = e.seq;
+        m_last_key = e.key;
+        if (seq)
+            *seq = e.seq;
+        lane.head = (lane.head + 1) % N;
+        lane.count--;
+        return true;
+    }
+
+    // Take the next item from one lane only, out of turn.  The group in progress and
+    // retry() are left as they were, so what comes out this way cannot be retried.
+    bool pop(CommandLane which, T &item)
+    {
+        Lane &lane = m_lanes[static_cast<size_t>(which)];
+        if (!lane.count)
+            return false;
+        item = lane.at(0).item;
+        lane.head = (lane.head + 1) % N;
+        lane.count--;
+        return true;
+    }
+
+    // Put back the item just popped, to be the next one out.  Fails if its lane
+    // filled up meanwhile.
+    bool retry(const T &item)
+    {
+        if (m_last_lane >= COMMAND_LANES)
+            return false;
+        Lane &lane = m_lanes[m_last_lane];
+        if (lane.count == N)
+        {
+            lane.dropped++;
+            return false;
+        }
+        lane.head = (lane.head + N - 1) % N;
+        lane.count++;
+        Entry &e = lane.at(0);
+        e.item = item;
+        e.seq = m_last_seq;
+        e.key = m_last_key;
+        m_retries++;
+        note_depth(lane);
+        return true;
+    }
+
+    // Forget everything waiting, statistics are kept
+    void clear(void)
+    {
+        for (Lane &lane : m_lanes)
+            lane.head = lane.count = 0;
+        m_last_lane = COMMAND_LANES;
+    }
+
+    size_t depth(void) const
+    {
+        size_t total = 0;
+        for (const Lane &lane : m_lanes)
+            total += lane.count;
+        return total;
+    }
+
+    size_t depth(CommandLane which) const
+    {
+        return m_lanes[static_cast<size_t>(which)].count;
+    }
+
+    // Most items waiting at once, in total or in one lane
+    size_t high_water(void) const
+    {
+        return m_high_water;
+    }
+
+    size_t high_water(CommandLane which) const
+    {
+        return m_lanes[static_cast<size_t>(which)].high_water;
+    }
+
+    // Commands refused for lack of room
+    uint32_t dropped(void) const
+    {
+        uint32_t total = 0;
+        for (const Lane &lane : m_lanes)
+            total += lane.dropped;
+        return total;
+    }
+
+    uint32_t dropped(CommandLane which) const
+    {
+        return m_lanes[static_cast<size_t>(which)].dropped;
+    }
+
+    uint32_t coalesced(void) const
+    {
+        return m_coalesced;
+    }
+
+    uint32_t retries(void) const
+    {
+        return m_retries;
+    }
+};
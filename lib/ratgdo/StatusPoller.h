@@ -0,0 +1,76 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+
+// When to ask a Security+2.0 opener for its status.  It reports changes
+// unprompted, but a missed report leaves the door shown as moving after it
+// stopped.
+//
+// While busy (the door moving or a command waiting on the opener) a status is
+// asked for every FAST_MS.  Once no longer busy, or while the opener is not
+// answering, the interval doubles after each poll until it passes IDLE_MS, and
+// polling stops until busy again.  Any status, asked for or not, pushes the next
+// poll back a whole interval, so an opener that keeps us informed is not polled.
+//
+// Times are millis(), wrapping.  Not thread safe, only the comms loop uses it.
+class StatusPoller
+{
+public:
+    static const uint32_t FAST_MS = 500;
+    static const uint32_t IDLE_MS = 8000;
+
+    // Called often, with whether the door is busy.  True if a status should be
+    // asked for now.
+    bool due(uint32_t now, bool busy)
+    {
+        if (busy && !m_busy)
+        {
+            // the command, or the status that showed the door moving, is recent
+            m_interval = FAST_MS;
+            m_next = now + FAST_MS;
+            m_active = true;
+            m_answered = true;
+        }
+        m_busy = busy;
+        if (!m_active || (int32_t)(now - m_next) < 0)
+            return false;
+
+        if (!busy || !m_answered)
+            m_interval *= 2;
+        if (m_interval > IDLE_MS)
+            m_active = false;
+        m_next = now + m_interval;
+        m_answered = false;
+        m_polls++;
+        return true;
+    }
+
+    // Status from the opener
+    void status(uint32_t now)
+    {
+        m_answered = true;
+        if (m_active)
+            m_next = now + m_interval;
+    }
+
+    bool active(void) const { return m_active; }
+    uint32_t polls(void) const { return m_polls; }
+
+private:
+    bool m_busy = false;
+    bool m_active = false;
+    bool m_answered = false;
+    uint32_t m_interval = FAST_MS;
+    uint32_t m_next = 0;
+    uint32_t m_polls = 0;
+};
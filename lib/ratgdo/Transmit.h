@@ -0,0 +1,145 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include "Packet.h"
+
+#include "Bus.h"
+
+class SecPlus2Transmitter;
+
+// One shot timer for SecPlus2Transmitter, an esp_timer on the ESP32
+// (src/transmit.cpp) and simulated time on the host (host/sim/firmware.cpp).
+class SecPlus2TxTimer
+{
+public:
+    virtual ~SecPlus2TxTimer() = default;
+
+    // Set up, the timer calls owner->on_timer() when it expires
+    virtual void begin(SecPlus2Transmitter *owner) = 0;
+    // May call back from a timer task or interrupt
+    virtual void start(uint32_t us) = 0;
+};
+
+// Sends one Security+2.0 frame without waiting on any of it.  start() asserts the
+// bus for WAKE_US to wake the opener, SETTLE_US after releasing it the timer checks
+// that nobody else is holding it and, if so, starts the frame.  The comms loop
+// calls poll() to learn how that went, Busy until the last byte is out.  Only
+// start() and poll() are called from the loop and only on_timer() from the timer,
+// state is handed over through m_state.  On a bus whose write() waits for the
+// bytes, software serial, on_timer() holds the timer task for the whole frame.
+class SecPlus2Transmitter
+{
+public:
+    enum class Result : uint8_t
+    {
+        Idle,      // nothing started
+        Busy,      // still waking the bus or sending
+        Sent,      // frame has gone
+        Collision, // someone else had the bus, nothing was sent
+        Failed,    // the bus would not take the frame, nothing was sent
+    };
+
+    static const uint32_t WAKE_US = 1300;
+    static const uint32_t SETTLE_US = 130;
+
+    SecPlus2Transmitter(GdoBus &bus, SecPlus2TxTimer &timer) : m_bus(bus), m_timer(timer) {}
+
+    void begin(void)
+    {
+        m_timer.begin(this);
+    }
+
+    // Returns false if a frame is already on its way or the bus could not be woken
+    bool start(const uint8_t frame[SECPLUS2_CODE_LEN])
+    {
+        if (m_state.load() != State::Idle)
+            return false;
+        memcpy(m_frame, frame, SECPLUS2_CODE_LEN);
+        if (!m_bus.pulse(WAKE_US))
+            return false;
+        m_state.store(State::Waking);
+        m_timer.start(WAKE_US + SETTLE_US);
+        return true;
+    }
+
+    void on_timer(void)
+    {
+        if (m_state.load() != State::Waking)
+            return;
+        // check to see if anyone else is continuing to assert the bus after we have released it
+        if (m_bus.line_busy())
+        {
+            m_state.store(State::Collided);
+            return;
+        }
+        // started before saying so, or poll() could see write_done() from the last one
+        if (!m_bus.write(m_frame, SECPLUS2_CODE_LEN))
+        {
+            m_state.store(State::Failed);
+            return;
+        }
+        m_state.store(State::Writing);
+    }
+
+    // Sent, Collision and Failed are reported once, after which the transmitter is Idle
+    Result poll(void)
+    {
+        switch (m_state.load())
+        {
+        case State::Idle:
+            return Result::Idle;
+        case State::Writing:
+            if (!m_bus.write_done())
+                return Result::Busy;
+            m_state.store(State::Idle);
+            return Result::Sent;
+        case State::Collided:
+            m_state.store(State::Idle);
+            return Result::Collision;
+        case State::Failed:
+            m_state.store(State::Idle);
+            return Result::Failed;
+        default:
+            return Result::Busy;
+        }
+    }
+
+    // Started and not yet reported by poll()
+    bool busy(void) const
+    {
+        return m_state.load() != State::Idle;
+    }
+
+    // The frame last started
+    const uint8_t *frame(void) const
+    {
+        return m_frame;
+    }
+
+private:
+    enum class State : uint8_t
+    {
+        Idle,
+        Waking,
+        Writing,
+        Collided,
+        Failed,
+    };
+
+    GdoBus &m_bus;
+    SecPlus2TxTimer &m_timer;
+    std::atomic<State> m_state{State::Idle};
+    uint8_t m_frame[SECPLUS2_CODE_LEN];
+};
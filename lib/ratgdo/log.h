@@ -15,12 +15,17 @@
 #pragma once
 
 // C/C++ language includes
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
 
+#ifndef UNIT_TEST
 // Arduino includes
 #include <Arduino.h>
 
 // RATGDO project includes
 #include "HomeSpan.h"
+#endif // UNIT_TEST
 
 void print_packet(uint8_t *pkt);
 
@@ -82,21 +87,142 @@ extern LOG *ratgdoLogger;
 
 #define RATGDO_PRINTF(message, ...) ratgdoLogger->logToBuffer(PSTR(message), ##__VA_ARGS__)
 
-#define RINFO(tag, message, ...) RATGDO_PRINTF(">>> [%7lu] %s: " message "\n", millis(), tag, ##__VA_ARGS__)
-#define RERROR(tag, message, ...) RATGDO_PRINTF("!!! [%7lu] %s: " message "\n", millis(), tag, ##__VA_ARGS__)
+#define RATGDO_LOG_OUT(prefix, tag, message, ...) RATGDO_PRINTF(prefix " [%7lu] %s: " message "\n", (unsigned long)millis(), tag, ##__VA_ARGS__)
 #else // LOG_MSG_BUFFER
 
 #ifndef UNIT_TEST
 
-#define RINFO(tag, message, ...) LOG0(">>> [%7lu] %s: " message "\n", millis(), tag, ##__VA_ARGS__)
-#define RERROR(tag, message, ...) LOG0("!!! [%7lu] %s: " message "\n", millis(), tag, ##__VA_ARGS__)
+#define RATGDO_LOG_OUT(prefix, tag, message, ...) LOG0(prefix " [%7lu] %s: " message "\n", (unsigned long)millis(), tag, ##__VA_ARGS__)
 
 #else // UNIT_TEST
 
 #include <stdio.h>
-#define RINFO(tag, message, ...) printf(">>> %s: " message "\n", tag, ##__VA_ARGS__)
-#define RERROR(tag, message, ...) printf("!!! %s: " message "\n", tag, ##__VA_ARGS__)
+#define RATGDO_LOG_OUT(prefix, tag, message, ...) printf(prefix " %s: " message "\n", tag, ##__VA_ARGS__)
 
 #endif // UNIT_TEST
 
 #endif // LOG_MSG_BUFFER
+
+/****************************************************************************
+ * Log levels
+ *
+ * RATGDO_LOG_LEVEL (set in platformio.ini) is the most verbose level compiled
+ * into the firmware.  Anything above it expands to nothing, so its format
+ * string and arguments cost neither flash nor CPU.  Messages that are compiled
+ * in are further filtered at runtime against a default threshold, which can be
+ * overridden for individual tags, see LogLevels below.
+ *
+ * RDEBUG is for diagnostics on hot paths (e.g. every packet decoded), these
+ * are excluded from production builds.
+ */
+#define RATGDO_LOG_NONE 0
+#define RATGDO_LOG_ERROR 1
+#define RATGDO_LOG_INFO 2
+#define RATGDO_LOG_DEBUG 3
+
+#ifndef RATGDO_LOG_LEVEL
+#define RATGDO_LOG_LEVEL RATGDO_LOG_INFO
+#endif
+
+class LogLevels
+{
+public:
+    static const uint8_t MAX_TAGS = 8;
+    static const uint8_t MAX_TAG_LEN = 24;
+
+    // Is a message at level from tag to be output?  Without any per-tag
+    // overrides this is a single compare.
+    bool enabled(const char *tag, uint8_t level) const
+    {
+        // pairs with the release in set(), entries below n are written in full
+        uint8_t n = count.load(std::memory_order_acquire);
+        for (uint8_t i = 0; i < n; i++)
+        {
+            if (!strcmp(tags[i].tag, tag))
+                return level <= tags[i].level.load(std::memory_order_relaxed);
+        }
+        return level <= threshold.load(std::memory_order_relaxed);
+    }
+
+    // Set threshold for tag, or the default for all tags if tag is NULL.
+    // Returns false if the table of per-tag overrides is full.  Called from one
+    // task only, enabled() may be called from any.
+    bool set(const char *tag, uint8_t level)
+    {
+        if (!tag)
+        {
+            threshold.store(level, std::memory_order_relaxed);
+            return true;
+        }
+        uint8_t n = count.load(std::memory_order_relaxed);
+        for (uint8_t i = 0; i < n; i++)
+        {
+            if (!strcmp(tags[i].tag, tag))
+            {
+                tags[i].level.store(level, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        if (n >= MAX_TAGS)
+            return false;
+        strncpy(tags[n].tag, tag, MAX_TAG_LEN - 1);
+        tags[n].tag[MAX_TAG_LEN - 1] = 0;
+        tags[n].level.store(level, std::memory_order_relaxed);
+        // publish the new entry last, readers in other tasks only look at [0..count)
+        count.store(n + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Remove all per-tag overrides and reset default threshold.  Not while
+    // another task may be logging, the entries are reused.
+    void reset(uint8_t level = RATGDO_LOG_LEVEL)
+    {
+        count.store(0, std::memory_order_release);
+        threshold.store(level, std::memory_order_relaxed);
+    }
+
+private:
+    struct
+    {
+        char tag[MAX_TAG_LEN];
+        std::atomic<uint8_t> level;
+    } tags[MAX_TAGS];
+    std::atomic<uint8_t> count{0};
+    std::atomic<uint8_t> threshold{RATGDO_LOG_LEVEL};
+};
+
+inline LogLevels ratgdoLogLevels;
+
+#define RLOG(level, prefix, tag, message, ...)                     \
+    do                                                             \
+    {                                                              \
+        if (ratgdoLogLevels.enabled(tag, level))                   \
+            RATGDO_LOG_OUT(prefix, tag, message, ##__VA_ARGS__);   \
+    } while (0)
+
+#if RATGDO_LOG_LEVEL >= RATGDO_LOG_ERROR
+#define RERROR(tag, message, ...) RLOG(RATGDO_LOG_ERROR, "!!!", tag, message, ##__VA_ARGS__)
+#else
+#define RERROR(tag, message, ...) \
+    do                            \
+    {                             \
+    } while (0)
+#endif
+
+#if RATGDO_LOG_LEVEL >= RATGDO_LOG_INFO
+#define RINFO(tag, message, ...) RLOG(RATGDO_LOG_INFO, ">>>", tag, message, ##__VA_ARGS__)
+#else
+#define RINFO(tag, message, ...) \
+    do                           \
+    {                            \
+    } while (0)
+#endif
+
+#if RATGDO_LOG_LEVEL >= RATGDO_LOG_DEBUG
+#define RDEBUG(tag, message, ...) RLOG(RATGDO_LOG_DEBUG, ">>>", tag, message, ##__VA_ARGS__)
+#else
+#define RDEBUG(tag, message, ...) \
+    do                            \
+    {                             \
+    } while (0)
+#endif
@@ -10,5 +10,10 @@
  */
 #pragma once
 
+#include <stdint.h>
+
 const uint8_t SECPLUS2_CODE_LEN = 19;
 const uint32_t SECPLUS2_PREAMBLE = 0x00550100;
+// A frame takes 20ms at 9600 baud, sent back-to-back.  Allow for loop() latency
+// between reads of sw_serial before deciding bytes were lost.
+const uint32_t SECPLUS2_GAP_TIMEOUT_MS = 100;
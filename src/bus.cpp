@@ -0,0 +1,397 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+
+// C/C++ language includes
+// none
+
+// Arduino includes
+#include <Arduino.h>
+
+// ESP system includes
+#include <driver/gpio.h>
+#include <driver/uart.h>
+#include <esp_rom_gpio.h>
+#include <esp_timer.h>
+#include <soc/gpio_sig_map.h>
+#include <soc/uart_periph.h>
+
+// RATGDO project includes
+#include "SoftwareSerial.h"
+#include "ratgdo.h"
+#include "log.h"
+#include "Bus.h"
+
+// Logger tag
+static const char *TAG = "ratgdo-bus";
+
+#if defined(GDO_BUS_UART) && defined(GDO_BUS_RMT)
+#error "GDO_BUS_UART and GDO_BUS_RMT each pick a bus backend, define only one"
+#endif
+
+#if !defined(GDO_BUS_UART) && !defined(GDO_BUS_RMT)
+/****************************************************************************
+ * Software serial.  write() bit-bangs the bytes and returns once they are out,
+ * 20ms for a SECURITY2.0 frame, in whatever task calls it.  The wake pulse is
+ * the TX pin driven directly and released by a timer.
+ */
+class SoftwareSerialBus : public GdoBus
+{
+public:
+    void begin(uint32_t baud, BusParity parity) override
+    {
+        m_serial.begin(baud, (parity == BusParity::Even) ? SWSERIAL_8E1 : SWSERIAL_8N1, UART_RX_PIN, UART_TX_PIN, true);
+        if (parity == BusParity::None)
+        {
+            m_serial.enableIntTx(false);
+            m_serial.enableAutoBaud(true); // found in ratgdo/espsoftwareserial branch autobaud
+        }
+        else
+        {
+            // protocol detection may have been listening at 9600
+            m_serial.enableIntTx(true);
+        }
+        if (!m_release)
+        {
+            esp_timer_create_args_t args = {};
+            args.callback = [](void *)
+            { digitalWrite(UART_TX_PIN, LOW); };
+            args.name = "gdo_bus";
+            esp_timer_create(&args, &m_release);
+        }
+    }
+
+    size_t available(void) override
+    {
+        return m_serial.available();
+    }
+
+    size_t read(uint8_t *buf, size_t len) override
+    {
+        return m_serial.read(buf, len);
+    }
+
+    bool write(const uint8_t *buf, size_t len) override
+    {
+        return m_serial.write(buf, len) == len;
+    }
+
+    bool write_done(void) override
+    {
+        return true;
+    }
+
+    void flush(void) override
+    {
+        // write() has already waited
+    }
+
+    bool pulse(uint32_t us) override
+    {
+        // inverted logic, so this pulls the bus low to assert it
+        digitalWrite(UART_TX_PIN, HIGH);
+        if (esp_timer_start_once(m_release, us) != ESP_OK)
+        {
+            // last pulse not yet released, or no timer
+            digitalWrite(UART_TX_PIN, LOW);
+            return false;
+        }
+        return true;
+    }
+
+    bool line_busy(void) override
+    {
+        return digitalRead(UART_RX_PIN);
+    }
+
+    void enable_rx(bool on) override
+    {
+        m_serial.enableRx(on);
+    }
+
+    // on_receive() not supported, EspSoftwareSerial only calls its receive handler
+    // from perform_work(), which would need polling anyway
+
+private:
+    SoftwareSerial m_serial;
+    esp_timer_handle_t m_release = NULL;
+};
+
+static SoftwareSerialBus software_serial_bus;
+GdoBus &gdo_bus = software_serial_bus;
+
+#elif defined(GDO_BUS_RMT)
+/****************************************************************************
+ * Software serial receive, RMT transmit.  The RMT plays each write out of a
+ * table of bit durations so that nothing waits on it, and holds the wake pulse.
+ * Not yet checked against an opener, build with GDO_BUS_RMT to try it.
+ */
+class RmtBus : public GdoBus
+public:
+    void begin(uint32_t baud, BusParity parity) override
+    {
+        m_baud = baud;
+        m_parity = parity;
+        // receive only, TX belongs to the RMT
+        m_serial.begin(baud, (parity == BusParity::Even) ? SWSERIAL_8E1 : SWSERIAL_8N1, UART_RX_PIN, -1, true);
+        if (parity == BusParity::None)
+        {
+            m_serial.enableAutoBaud(true); // found in ratgdo/espsoftwareserial branch autobaud
+        }
+        if (!m_rmt_ready)
+        {
+            if (!rmtInit(UART_TX_PIN, RMT_TX_MODE, RMT_MEM_NUM_BLOCKS_1, RMT_HZ))
+            {
+                RERROR(TAG, "Could not set up RMT on pin %d", UART_TX_PIN);
+            }
+            // line released between writes
+            rmtSetEOT(UART_TX_PIN, LOW);
+            m_rmt_ready = true;
+        }
+    }
+
+    size_t available(void) override
+    {
+        return m_serial.available();
+    }
+
+    size_t read(uint8_t *buf, size_t len) override
+    {
+        return m_serial.read(buf, len);
+    }
+
+    bool write(const uint8_t *buf, size_t len) override
+    {
+        if (!write_done() || len > MAX_WRITE)
+            return false;
+        return rmtWriteAsync(UART_TX_PIN, m_symbols, encode(buf, len));
+    }
+
+    bool write_done(void) override
+    {
+        return rmtTransmitCompleted(UART_TX_PIN);
+    }
+
+    void flush(void) override
+    {
+        while (!write_done())
+        {
+            delay(1);
+        }
+    }
+
+    bool pulse(uint32_t us) override
+    {
+        if (!write_done())
+            return false;
+        m_symbols[0].level0 = HIGH;
+        m_symbols[0].duration0 = us;
+        m_symbols[0].level1 = LOW;
+        m_symbols[0].duration1 = 0;
+        return rmtWriteAsync(UART_TX_PIN, m_symbols, 1);
+    }
+
+    bool line_busy(void) override
+    {
+        return digitalRead(UART_RX_PIN);
+    }
+
+    void enable_rx(bool on) override
+    {
+        m_serial.enableRx(on);
+    }
+
+    // on_receive() not supported, EspSoftwareSerial only calls its receive handler
+    // from perform_work(), which would need polling anyway
+
+private:
+    // RMT ticks are 1us
+    static const uint32_t RMT_HZ = 1000000;
+    static const size_t MAX_WRITE = 19;
+
+    SoftwareSerial m_serial;
+    bool m_rmt_ready = false;
+    uint32_t m_baud = 9600;
+    BusParity m_parity = BusParity::None;
+    // the RMT reads these while it sends, so they live here.  Worst case every bit
+    // differs from the next, two bits to a symbol.
+    rmt_data_t m_symbols[MAX_WRITE * 11 / 2 + 1];
+
+    uint32_t bits_per_byte(void) const
+    {
+        return (m_parity == BusParity::Even) ? 11 : 10;
+    }
+
+    // Level on the TX pin for bit k of the write, inverted
+    uint8_t tx_level(const uint8_t *buf, uint32_t k) const
+    {
+        uint32_t n = bits_per_byte();
+        uint32_t pos = k % n;
+        uint8_t byte = buf[k / n];
+        bool mark;
+        if (pos == 0)
+            mark = false; // start bit
+        else if (pos == n - 1)
+            mark = true; // stop bit
+        else if (pos == 9)
+            mark = __builtin_parity(byte); // even parity
+        else
+            mark = (byte >> (pos - 1)) & 1;
+        return mark ? LOW : HIGH;
+    }
+
+    // Start of bit k in RMT ticks, rounded so that bit times do not drift
+    uint32_t bit_edge(uint32_t k) const
+    {
+        return (uint32_t)(((uint64_t)k * RMT_HZ + m_baud / 2) / m_baud);
+    }
+
+    // Runs of one level, two to a symbol.  Returns symbols used.
+    size_t encode(const uint8_t *buf, size_t len)
+    {
+        uint32_t bits = len * bits_per_byte();
+        uint32_t run = 0;
+        size_t runs = 0;
+        for (uint32_t k = 1; k <= bits; k++)
+        {
+            if (k < bits && tx_level(buf, k) == tx_level(buf, run))
+                continue;
+            rmt_data_t &s = m_symbols[runs / 2];
+            if (runs % 2 == 0)
+            {
+                s.level0 = tx_level(buf, run);
+                s.duration0 = bit_edge(k) - bit_edge(run);
+                s.level1 = LOW;
+                s.duration1 = 0;
+            }
+            else
+            {
+                s.level1 = tx_level(buf, run);
+                s.duration1 = bit_edge(k) - bit_edge(run);
+            }
+            runs++;
+            run = k;
+        }
+        return (runs + 1) / 2;
+    }
+};
+
+static RmtBus rmt_bus;
+GdoBus &gdo_bus = rmt_bus;
+
+#else
+/****************************************************************************
+ * ESP32 hardware UART.  Receive is interrupt driven out of the UART FIFO and a
+ * write goes into the FIFO and returns, so neither costs any bit-banging.  For
+ * the wake pulse TX is handed from the UART to the GPIO and back.
+ */
+class UartBus : public GdoBus
+{
+public:
+    void begin(uint32_t baud, BusParity parity) override
+    {
+        m_port.begin(baud, (parity == BusParity::Even) ? SERIAL_8E1 : SERIAL_8N1, UART_RX_PIN, UART_TX_PIN, true);
+        // hand over each byte as it arrives, SECURITY1.0 packets are told apart by timing
+        m_port.setRxFIFOFull(1);
+        if (!m_release)
+        {
+            esp_timer_create_args_t args = {};
+            args.callback = [](void *arg)
+            { static_cast<UartBus *>(arg)->release(); };
+            args.arg = this;
+            args.name = "gdo_bus";
+            esp_timer_create(&args, &m_release);
+        }
+    }
+
+    size_t available(void) override
+    {
+        return m_port.available();
+    }
+
+    size_t read(uint8_t *buf, size_t len) override
+    {
+        return m_port.read(buf, len);
+    }
+
+    bool write(const uint8_t *buf, size_t len) override
+    {
+        if (!write_done())
+            return false;
+        // a frame fits in the FIFO, so this does not wait
+        return m_port.write(buf, len) == len;
+    }
+
+    bool write_done(void) override
+    {
+        return uart_wait_tx_done(UART_NUM, 0) == ESP_OK;
+    }
+
+    void flush(void) override
+    {
+        m_port.flush();
+    }
+
+    bool pulse(uint32_t us) override
+    {
+        // taking TX from the UART would cut a write short
+        if (!write_done())
+            return false;
+        // inverted, so this pulls the bus low to assert it
+        esp_rom_gpio_connect_out_signal(UART_TX_PIN, SIG_GPIO_OUT_IDX, false, false);
+        gpio_set_level(UART_TX_PIN, 1);
+        if (esp_timer_start_once(m_release, us) != ESP_OK)
+        {
+            // last pulse not yet released, or no timer
+            release();
+            return false;
+        }
+        return true;
+    }
+
+    bool line_busy(void) override
+    {
+        return gpio_get_level(UART_RX_PIN);
+    }
+
+    void enable_rx(bool on) override
+    {
+        // no receiver enable on the ESP32 UART, feed it an idle line instead
+        uint32_t signal = UART_PERIPH_SIGNAL(UART_NUM, SOC_UART_RX_PIN_IDX);
+        if (on)
+            esp_rom_gpio_connect_in_signal(UART_RX_PIN, signal, false);
+        else
+            esp_rom_gpio_connect_in_signal(GPIO_MATRIX_CONST_ZERO_INPUT, signal, false);
+    }
+
+    bool on_receive(void (*fn)(void *arg), void *arg) override
+    {
+        // runs in the UART driver's event task
+        m_port.onReceive([fn, arg]()
+                         { fn(arg); });
+        return true;
+    }
+
+private:
+    static const uart_port_t UART_NUM = UART_NUM_1;
+
+    HardwareSerial m_port = HardwareSerial(UART_NUM);
+    esp_timer_handle_t m_release = NULL;
+
+    void release(void)
+    {
+        gpio_set_level(UART_TX_PIN, 0);
+        esp_rom_gpio_connect_out_signal(UART_TX_PIN, UART_PERIPH_SIGNAL(UART_NUM, SOC_UART_TX_PIN_IDX), false, false);
+    }
+};
+
+static UartBus uart_bus;
+GdoBus &gdo_bus = uart_bus;
+#endif
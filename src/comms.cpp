@@ -21,32 +21,37 @@
 #include <Ticker.h>
 
 // RATGDO project includes
-#include "SoftwareSerial.h"
 #include "ratgdo.h"
 #include "homekit.h"
 #include "Reader.h"
+#include "FrameCache.h"
+#include "Capture.h"
+#include "Scheduler.h"
 #include "secplus2.h"
 #include "utilities.h"
 #include "comms.h"
 #include "config.h"
 #include "led.h"
 #include "drycontact.h"
+#include "vehicle.h"
 
 static const char *TAG = "ratgdo-comms";
 
 static bool comms_setup_done = false;
 
-/********************************** LOCAL STORAGE *****************************************/
+// comms task, see comms_task() below
+#define COMMS_TASK_CORE 1          // APP_CPU, WiFi and lwIP are on core 0
+#define COMMS_TASK_PRIORITY 5      // ahead of loop() and HomeSpan's poll task
+#define COMMS_TASK_STACK 6144
+#define COMMS_TASK_IDLE_MS 10      // nothing to send and bus notifies on receive
+#define COMMS_TASK_BUSY_MS 1       // sending, or bus must be polled
+static TaskHandle_t comms_task_handle = NULL;
+static bool bus_notifies = false;
 
-struct PacketAction
-{
-    Packet pkt;
-    bool inc_counter;
-    uint32_t delay;
-};
+/********************************** LOCAL STORAGE *****************************************/
 
-QueueHandle_t pkt_q;
-SoftwareSerial sw_serial;
+CommandScheduler<PacketAction, TX_LANE_DEPTH> tx_scheduler;
+SemaphoreHandle_t tx_mutex;
 
 extern struct GarageDoor garage_door;
 extern bool status_done;
@@ -64,33 +69,58 @@ struct ForceRecover force_recover;
 
 /******************************* OBSTRUCTION SENSOR *********************************/
 
-struct obstruction_sensor_t
-{
-    unsigned int low_count = 0;    // count obstruction low pulses
-    unsigned long last_asleep = 0; // count time between high pulses from the obst ISR
-} obstruction_sensor;
+// edges from the ISR, about two every 7ms, the comms loop takes them every few ms
+ObstructionEdgeRing<64> obstruction_edges;
+ObstructionClassifier obstruction_sensor;
 
 void IRAM_ATTR isr_obstruction()
 {
-    obstruction_sensor.low_count++;
+    obstruction_edges.push(micros(), gpio_get_level(INPUT_OBST_PIN));
 }
 
 /******************************* SECURITY 2.0 *********************************/
 
 SecPlus2Reader reader;
+// bytes drained from gdo_bus per read, at 9600 baud this is over three packets
+static const uint8_t SEC2_RX_LENGTH = 64;
 uint32_t id_code = 0;
 uint32_t rolling_code = 0;
 uint32_t last_saved_code = 0;
+uint32_t rejected_packets = 0;
+SecPlus2FrameCache<12> frame_cache;
+SecPlus2Transmitter sec2_tx(gdo_bus, sec2_tx_timer);
+SecPlus2Contention sec2_contention;
+StatusPoller status_poller;
+LinkMonitor link_monitor;
 #define MAX_CODES_WITHOUT_FLASH_WRITE 10
+// rolling code checkpoints, when the partition for it is there
+Journal rolling_journal(rolling_flash);
+uint32_t rolling_code_reserved = 0; // codes below this are covered by the journal
+#define ROLLING_CODE_LEASE 16       // codes reserved by each journal record
+#define ROLLING_CODE_LEASE_LOW 4    // reserve more when down to this many, while idle
+
+/*************************** PROTOCOL DETECTION *******************************/
+
+ProtocolDetector protocol_detector;
+static bool detecting = false; // first boot, see comms_loop_detect()
+
+/******************************* BUS CAPTURE **********************************/
+
+// recorded into by the comms task, started, stopped and downloaded from the web
+// server, capture_mutex keeps them apart
+static BusCapture bus_capture;
+static SemaphoreHandle_t capture_mutex;
 
 /******************************* SECURITY 1.0 *********************************/
 
-static const uint8_t RX_LENGTH = 2;
-typedef uint8_t RxPacket[RX_LENGTH * 4];
+SecPlus1Reader sec1_reader;
 unsigned long last_rx;
 unsigned long last_tx;
 
 #define MAX_COMMS_RETRY 10
+// waiting for the opener to act on a command, before sending it again
+#define COMMAND_ACK_TIMEOUT_MS 2000
+#define MAX_COMMAND_RETRY 1
 
 bool wallplateBooting = false;
 bool wallPanelDetected = false;
@@ -127,76 +157,360 @@ enum secplus1Codes : uint8_t
 
 void sync();
 bool process_PacketAction(PacketAction &pkt_ac);
+void process_Sec2Packet(Packet &pkt);
+void setup_frame_cache();
 void door_command(DoorAction action);
 void send_get_status();
+void send_ping();
 bool transmitSec1(byte toSend);
 bool transmitSec2(PacketAction &pkt_ac);
+bool start_transmitSec2(PacketAction &pkt_ac);
+bool end_transmitSec2(PacketAction &pkt_ac, SecPlus2Transmitter::Result result);
 void TTCdelayLoop();
+void comms_wake();
+void comms_task(void *arg);
 void manual_recovery();
 void obstruction_timer();
+void door_state_event(DoorState state);
+void setup_comms_sec1();
+void setup_comms_sec2();
+void setup_comms_drycontact();
+void comms_loop_detect();
+void detect_finished(GdoProtocol found);
 
 /****************************************************************************
- * Initialize communications with garage door.
+ * Transmit scheduling.  Commands are queued from the HomeKit and web tasks as
+ * well as this one, and the scheduler leaves locking to us.
  */
-void setup_comms()
+uint32_t queue_command(CommandLane lane, const PacketAction *pkt_ac, size_t count, const char *what, uint32_t coalesce_key = 0)
 {
-    // Create packet queue
-    pkt_q = xQueueCreate(5, sizeof(PacketAction));
+    xSemaphoreTake(tx_mutex, portMAX_DELAY);
+    uint32_t seq = tx_scheduler.push(lane, pkt_ac, count, coalesce_key);
+    xSemaphoreGive(tx_mutex);
+    if (!seq)
+    {
+        RERROR(TAG, "packet queue full, dropping %s", what);
+        return 0;
+    }
+    if (lane != CommandLane::Poll)
+    {
+        RINFO(TAG, "queued %s #%lu", what, seq);
+    }
+    comms_wake();
+    return seq;
+}
 
-    if (doorControlType == 0)
-        doorControlType = userConfig->getGDOSecurityType();
+size_t commands_waiting()
+{
+    xSemaphoreTake(tx_mutex, portMAX_DELAY);
+    size_t depth = tx_scheduler.depth();
+    xSemaphoreGive(tx_mutex);
+    return depth;
+}
 
-    if (doorControlType == 1)
+bool next_command(PacketAction &pkt_ac, uint32_t *seq = nullptr)
+{
+    xSemaphoreTake(tx_mutex, portMAX_DELAY);
+    bool found = tx_scheduler.pop(pkt_ac, seq);
+    xSemaphoreGive(tx_mutex);
+    // set_lock() is called from other tasks, so the target changes here instead
+    if (found && pkt_ac.ack == CommandAck::Lock)
     {
-        RINFO(TAG, "=== Setting up comms for Secuirty+1.0 protocol");
+        garage_door.target_lock = pkt_ac.ack_value ? TGT_LOCKED : TGT_UNLOCKED;
+    }
+    return found;
+}
 
-        sw_serial.begin(1200, SWSERIAL_8E1, UART_RX_PIN, UART_TX_PIN, true);
+// a poll, out of turn, while a button is held
+bool next_poll(PacketAction &pkt_ac)
+{
+    xSemaphoreTake(tx_mutex, portMAX_DELAY);
+    bool found = tx_scheduler.pop(CommandLane::Poll, pkt_ac);
+    xSemaphoreGive(tx_mutex);
+    return found;
+}
 
-        wallPanelDetected = false;
-        wallplateBooting = false;
-        doorState = DoorState::Unknown;
-        lightState = 2;
-        lockState = 2;
+void retry_command(const PacketAction &pkt_ac)
+{
+    xSemaphoreTake(tx_mutex, portMAX_DELAY);
+    bool queued = tx_scheduler.retry(pkt_ac);
+    xSemaphoreGive(tx_mutex);
+    if (!queued)
+    {
+        RERROR(TAG, "packet queue full, dropping retry");
     }
-    else if (doorControlType == 2)
+}
+
+/****************************************************************************
+ * Bus capture.  Recorded here and controlled from the web server, all under
+ * capture_mutex except the test for running, so it costs nothing while stopped.
+ */
+static void capture_record(const uint8_t *buf, size_t len, BusCaptureDir dir)
+{
+    if (!bus_capture.running())
+        return;
+    xSemaphoreTake(capture_mutex, portMAX_DELAY);
+    bus_capture.record(buf, len, dir, micros());
+    xSemaphoreGive(capture_mutex);
+}
+
+bool capture_start(size_t records)
+{
+    xSemaphoreTake(capture_mutex, portMAX_DELAY);
+    bool started = bus_capture.start(doorControlType, records);
+    xSemaphoreGive(capture_mutex);
+    return started;
+}
+
+// Returns how many bytes were seen
+uint32_t capture_stop()
+{
+    xSemaphoreTake(capture_mutex, portMAX_DELAY);
+    bus_capture.stop();
+    uint32_t total = bus_capture.total();
+    xSemaphoreGive(capture_mutex);
+    return total;
+}
+
+void capture_clear()
+{
+    xSemaphoreTake(capture_mutex, portMAX_DELAY);
+    bus_capture.clear();
+    xSemaphoreGive(capture_mutex);
+}
+
+// Stops the capture, so that what send() is given does not change under it
+void capture_download(void (*send)(const BusCapture &capture))
+{
+    xSemaphoreTake(capture_mutex, portMAX_DELAY);
+    bus_capture.stop();
+    send(bus_capture);
+    xSemaphoreGive(capture_mutex);
+}
+
+/****************************************************************************
+ * Command acknowledgement.  A command is done when the opener reports the
+ * status change it asked for (see CommandAck), not after a fixed delay.  If
+ * that has not shown up COMMAND_ACK_TIMEOUT_MS after the last of its packets
+ * went out (and any button hold), it is sent again.  Only the comms loop gets here.
+ */
+struct AwaitedAck
+{
+    bool waiting = false;
+    uint8_t value = 0; // ack_value, or for a door command its state when sent
+    uint32_t seq = 0;  // scheduler ID of the command
+    unsigned long sent_at = 0;
+    unsigned long last_tx = 0;
+    bool refused = false; // status without the change came in after a button release
+    uint8_t attempt = 0;
+    uint32_t retry_seq = 0; // ID it was sent again as
+    PacketAction group[3];  // press and releases, to send again
+    uint8_t count = 0;
+};
+
+static AwaitedAck awaited_ack[4]; // indexed by CommandAck
+static const char *ack_name[] = {"", "door command", "light", "lock"};
+uint32_t commands_acked = 0;
+uint32_t commands_unacked = 0;
+
+void command_sent(const PacketAction &pkt_ac, uint32_t seq)
+{
+    unsigned long now = millis();
+    if (pkt_ac.ack != CommandAck::None)
+    {
+        AwaitedAck &a = awaited_ack[static_cast<size_t>(pkt_ac.ack)];
+        a.attempt = (a.waiting || a.retry_seq != seq) ? 0 : a.attempt + 1;
+        a.waiting = true;
+        a.value = (pkt_ac.ack == CommandAck::Door) ? (uint8_t)garage_door.current_state : pkt_ac.ack_value;
+        a.seq = seq;
+        a.sent_at = a.last_tx = now;
+        a.refused = false;
+        a.group[0] = pkt_ac;
+        a.count = 1;
+        return;
+    }
+    // button releases, they go again with the press
+    for (AwaitedAck &a : awaited_ack)
+    {
+        if (a.waiting && a.seq == seq && a.count < 3)
+        {
+            a.group[a.count++] = pkt_ac;
+            a.last_tx = now;
+        }
+    }
+}
+
+// Opener has reported the state that ack looks at
+void command_status(CommandAck ack, uint8_t value)
+{
+    AwaitedAck &a = awaited_ack[static_cast<size_t>(ack)];
+    if (!a.waiting)
+        return;
+    if ((ack == CommandAck::Door) ? (value != a.value) : (value == a.value))
+    {
+        a.waiting = false;
+        commands_acked++;
+        RINFO(TAG, "%s acknowledged after %lu ms", ack_name[static_cast<size_t>(ack)], millis() - a.sent_at);
+    }
+    else if (a.count > 1)
     {
-        RINFO(TAG, "=== Setting up comms for Secuirty+2.0 protocol");
+        a.refused = true;
+    }
+}
 
-        sw_serial.begin(9600, SWSERIAL_8N1, UART_RX_PIN, UART_TX_PIN, true);
-        sw_serial.enableIntTx(false);
-        sw_serial.enableAutoBaud(true); // found in ratgdo/espsoftwareserial branch autobaud
+bool command_awaited(CommandAck ack)
+{
+    return awaited_ack[static_cast<size_t>(ack)].waiting;
+}
 
-        // read from flash, default of 0 if file not exist
-        id_code = nvRam->read(nvram_id_code);
-        if (!id_code)
+// SECURITY1.0 status query that would show an awaited ack, or 0
+uint8_t command_ack_poll()
+{
+    if (command_awaited(CommandAck::Door))
+        return secplus1Codes::DoorStatus;
+    if (command_awaited(CommandAck::Light) || command_awaited(CommandAck::Lock))
+        return secplus1Codes::LightLockStatus;
+    return 0;
+}
+
+void command_timeouts()
+{
+    unsigned long now = millis();
+    for (size_t i = 1; i < 4; i++)
+    {
+        AwaitedAck &a = awaited_ack[i];
+        // a button press may be held for its delay before being released
+        if (!a.waiting || now - a.last_tx < a.group[a.count - 1].delay + COMMAND_ACK_TIMEOUT_MS)
+            continue;
+        a.waiting = false;
+        commands_unacked++;
+
+        // SECURITY1.0 buttons toggle, so press again only once the opener has said
+        // nothing changed, and never the door
+        bool again = (doorControlType == 2) || (a.refused && i != static_cast<size_t>(CommandAck::Door));
+        if (!again || a.attempt >= MAX_COMMAND_RETRY)
+        {
+            RERROR(TAG, "no acknowledgement for %s after %lu ms", ack_name[i], now - a.sent_at);
+            continue;
+        }
+        RERROR(TAG, "no acknowledgement for %s after %lu ms, sending again", ack_name[i], now - a.sent_at);
+        CommandLane lane = (i == static_cast<size_t>(CommandAck::Door)) ? CommandLane::Door : CommandLane::Control;
+        a.retry_seq = queue_command(lane, a.group, a.count, ack_name[i]);
+        if (a.retry_seq)
         {
-            RINFO(TAG, "id code not found");
-            id_code = (random(0x1, 0xFFF) << 12) | 0x539;
-            nvRam->write(nvram_id_code, id_code);
+            send_get_status();
         }
-        RINFO(TAG, "id code %lu (0x%02lX)", id_code, id_code);
+    }
+}
+
+/****************************************************************************
+ * Initialize communications with garage door.
+ */
+void setup_comms_sec1()
+{
+    RINFO(TAG, "=== Setting up comms for Secuirty+1.0 protocol");
+
+    gdo_bus.begin(1200, BusParity::Even);
+
+    wallPanelDetected = false;
+    wallplateBooting = false;
+    doorState = DoorState::Unknown;
+    lightState = 2;
+    lockState = 2;
+}
+
+void setup_comms_sec2()
+{
+    RINFO(TAG, "=== Setting up comms for Secuirty+2.0 protocol");
+
+    gdo_bus.begin(9600, BusParity::None);
+
+    // read from flash, default of 0 if file not exist
+    id_code = nvRam->read(nvram_id_code);
+    if (!id_code)
+    {
+        RINFO(TAG, "id code not found");
+        id_code = (random(0x1, 0xFFF) << 12) | 0x539;
+        nvRam->write(nvram_id_code, id_code);
+    }
+    RINFO(TAG, "id code %lu (0x%02lX)", id_code, id_code);
 
+    if (rolling_journal.begin() && !rolling_journal.empty())
+    {
+        // journal is always at or ahead of the last code sent, no need to bump it
+        rolling_code = rolling_journal.last();
+    }
+    else
+    {
         // read from flash, default of 0 if file not exist
         rolling_code = nvRam->read(nvram_rolling, 0);
         // last saved rolling code may be behind what the GDO thinks, so bump it up so that it will
         // always be ahead of what the GDO thinks it should be, and save it.
         rolling_code = (rolling_code != 0) ? rolling_code + MAX_CODES_WITHOUT_FLASH_WRITE : 0;
-        save_rolling_code();
-        RINFO(TAG, "rolling code %lu (0x%02X)", rolling_code, rolling_code);
-        sync();
+    }
+    save_rolling_code();
+    RINFO(TAG, "rolling code %lu (0x%02X)", rolling_code, rolling_code);
+    setup_frame_cache();
+    sec2_tx.begin();
+    sync();
+
+    // Get the initial state of the door
+    if (!gdo_bus.line_busy())
+    {
+        send_get_status();
+    }
+    force_recover.push_count = 0;
+}
 
-        // Get the initial state of the door
-        if (!digitalRead(UART_RX_PIN))
-        {
-            send_get_status();
-        }
-        force_recover.push_count = 0;
+void setup_comms_drycontact()
+{
+    RINFO(TAG, "=== Setting up comms for dry contact protocol");
+    pinMode(UART_TX_PIN, OUTPUT);
+}
+
+// Whether the protocol is settled, by detection or by hand.  Devices set up
+// before detection have no protocol_set, but anything saved for an opener says
+// they are already talking to one, so mark them settled rather than listen.
+static bool protocol_known()
+{
+    if (nvRam->read(nvram_protocol_set))
+        return true;
+    if (nvRam->read(cfg_GDOSecurityType, -1) < 0 && !nvRam->read(nvram_id_code) && !nvRam->read(nvram_rolling))
+        return false;
+    RINFO(TAG, "Door opener set up before protocol detection, keeping GDOSecurityType");
+    nvRam->write(nvram_protocol_set, 1);
+    return true;
+}
+
+void setup_comms()
+{
+    // commands are queued from the HomeKit and web server tasks
+    tx_mutex = xSemaphoreCreateMutex();
+    capture_mutex = xSemaphoreCreateMutex();
+
+    if (doorControlType == 0)
+    {
+        doorControlType = userConfig->getGDOSecurityType();
+        // until an opener has been heard, or the user has chosen, find out what it speaks
+        detecting = !protocol_known();
     }
-    else
+
+    if (detecting)
     {
-        RINFO(TAG, "=== Setting up comms for dry contact protocol");
-        pinMode(UART_TX_PIN, OUTPUT);
+        RINFO(TAG, "=== Detecting door opener protocol, configured for %s", ProtocolDetector::name((GdoProtocol)doorControlType));
+        // as setup_drycontact(), which has not run yet
+        pinMode(DRY_CONTACT_OPEN_PIN, INPUT_PULLUP);
+        pinMode(DRY_CONTACT_CLOSE_PIN, INPUT_PULLUP);
+        protocol_detector.begin(millis());
+        doorControlType = 1;
+        setup_comms_sec1();
     }
+    else if (doorControlType == 1)
+        setup_comms_sec1();
+    else if (doorControlType == 2)
+        setup_comms_sec2();
+    else
+        setup_comms_drycontact();
 
     /* pin-based obstruction detection
     // FALLING from https://github.com/ratgdo/esphome-ratgdo/blob/e248c705c5342e99201de272cb3e6dc0607a0f84/components/ratgdo/ratgdo.cpp#L54C14-L54C14
@@ -204,9 +518,16 @@ void setup_comms()
     RINFO(TAG, "Initialize for obstruction detection");
     pinMode(INPUT_OBST_PIN, INPUT);
     pinMode(STATUS_OBST_PIN, OUTPUT);
-    attachInterrupt(INPUT_OBST_PIN, isr_obstruction, FALLING);
+    attachInterrupt(INPUT_OBST_PIN, isr_obstruction, CHANGE);
 
     comms_setup_done = true;
+
+    if (doorControlType != 3)
+    {
+        bus_notifies = gdo_bus.on_receive([](void *)
+                                          { comms_wake(); }, NULL);
+    }
+    xTaskCreatePinnedToCore(comms_task, "comms", COMMS_TASK_STACK, NULL, COMMS_TASK_PRIORITY, &comms_task_handle, COMMS_TASK_CORE);
 }
 
 /****************************************************************************
@@ -214,18 +535,117 @@ void setup_comms()
  */
 void save_rolling_code()
 {
+    if (rolling_journal.ready())
+    {
+        // exactly where we are, so a restart picks up without skipping any codes
+        if (rolling_journal.append(rolling_code))
+        {
+            rolling_code_reserved = rolling_code;
+            return;
+        }
+        RERROR(TAG, "Could not write rolling code journal");
+    }
     nvRam->write(nvram_rolling, rolling_code);
     last_saved_code = rolling_code;
 }
 
+// Journal a rolling code ahead of the one about to be used, so that if power is
+// lost we resume past every code sent.
+// Codes left before rolling_code reaches the reservation, in 28 bit arithmetic so
+// that it holds across the wrap.  None if rolling_code is past it, as at boot or
+// after a failed append, which shows as more than a lease.
+static uint32_t rolling_codes_left()
+{
+    uint32_t left = (rolling_code_reserved - rolling_code) & 0xfffffff;
+    return (left > ROLLING_CODE_LEASE) ? 0 : left;
+}
+
+void reserve_rolling_codes()
+{
+    uint32_t reserved = (rolling_code + ROLLING_CODE_LEASE) & 0xfffffff;
+    if (rolling_journal.append(reserved))
+    {
+        rolling_code_reserved = reserved;
+    }
+    else
+    {
+        RERROR(TAG, "Could not write rolling code journal");
+    }
+}
+
 void reset_door()
 {
     rolling_code = 0; // because sync_and_reboot writes this.
+    if (rolling_journal.ready() || rolling_journal.begin())
+    {
+        rolling_journal.clear();
+    }
     nvRam->erase(nvram_rolling);
     nvRam->erase(nvram_id_code);
     nvRam->erase(nvram_has_motion);
 }
 
+/****************************************************************************
+ * Door state from any protocol.  Only changes go to HomeKit, the web page
+ * (which follows garage_door) and vehicle presence.
+ */
+static_assert(DoorReducer::CURR_OPEN == CURR_OPEN && DoorReducer::CURR_CLOSED == CURR_CLOSED &&
+                  DoorReducer::CURR_OPENING == CURR_OPENING && DoorReducer::CURR_CLOSING == CURR_CLOSING &&
+                  DoorReducer::CURR_STOPPED == CURR_STOPPED,
+              "DoorReducer current states differ from HomeKit");
+static_assert(DoorReducer::TGT_OPEN == TGT_OPEN && DoorReducer::TGT_CLOSED == TGT_CLOSED,
+              "DoorReducer target states differ from HomeKit");
+
+void door_state_event(DoorState state)
+{
+    DoorView door = {garage_door.active, garage_door.current_state, garage_door.target_state};
+    DoorReducer::Result result = DoorReducer::reduce(door, state);
+    if (!result.changed)
+        return;
+
+    if (result.changed & DoorReducer::ACTIVATED)
+        RINFO(TAG, "activating door");
+    garage_door.active = result.door.active;
+    garage_door.current_state = (GarageDoorCurrentState)result.door.current;
+    garage_door.target_state = (GarageDoorTargetState)result.door.target;
+
+    if (result.changed & DoorReducer::CURRENT)
+    {
+        const char *l = "unknown door state";
+        switch (garage_door.current_state)
+        {
+        case GarageDoorCurrentState::CURR_STOPPED:
+            l = "Stopped";
+            break;
+        case GarageDoorCurrentState::CURR_OPEN:
+            l = "Open";
+            break;
+        case GarageDoorCurrentState::CURR_OPENING:
+            l = "Opening";
+            doorOpening();
+            break;
+        case GarageDoorCurrentState::CURR_CLOSED:
+            l = "Closed";
+            break;
+        case GarageDoorCurrentState::CURR_CLOSING:
+            l = "Closing";
+            doorClosing();
+            if (TTCcountdown > 0)
+            {
+                // We are in a time-to-close delay timeout, cancel the timeout
+                RINFO(TAG, "Canceling time-to-close delay timer");
+                TTCtimer.detach();
+                TTCcountdown = 0;
+            }
+            break;
+        }
+        RINFO(TAG, "status DOOR: %s", l);
+        notify_homekit_current_door_state_change();
+    }
+    if (result.changed & DoorReducer::TARGET)
+        notify_homekit_target_door_state_change();
+}
+
 /****************************************************************************
  * Sec+ 1.0 loop functions.
  */
@@ -243,7 +663,9 @@ void wallPlate_Emulation()
 
     if (!serialDetected)
     {
-        if (sw_serial.available())
+        // comms_loop_sec1() has already taken any byte that arrived, so look at
+        // whether it has seen one rather than whether one is waiting
+        if (last_rx)
         {
             serialDetected = currentMillis;
         }
@@ -276,12 +698,15 @@ void wallPlate_Emulation()
             RINFO(TAG, "No DIGITAL wall panel detected. Switching to emulation mode.");
         }
 
+        // waiting to see a command acted on, ask for just that status as often as the bus allows
+        byte ackPoll = command_ack_poll();
+
         // transmit every 250ms
-        if (emulateWallPanel && (currentMillis - lastRequestMillis) > 250)
+        if (emulateWallPanel && (currentMillis - lastRequestMillis) > (ackPoll ? 50 : 250))
         {
             lastRequestMillis = currentMillis;
 
-            byte secplus1ToSend = byte(secplus1States[stateIndex]);
+            byte secplus1ToSend = ackPoll ? ackPoll : byte(secplus1States[stateIndex]);
 
             // send through queue
             PacketData data;
@@ -289,350 +714,233 @@ void wallPlate_Emulation()
             data.value.cmd = secplus1ToSend;
             Packet pkt = Packet(PacketCommand::GetStatus, data, id_code);
             PacketAction pkt_ac = {pkt, true, 20}; // 20ms delay for SECURITY1.0 (which is minimum delay)
-            if (xQueueSendToBack(pkt_q, &pkt_ac, 0) == errQUEUE_FULL)
-            {
-                RERROR(TAG, "packet queue full");
-            }
+            // a poll still waiting to go out makes this one redundant
+            queue_command(CommandLane::Poll, &pkt_ac, 1, "poll", secplus1ToSend);
 
             // send direct
             // transmitSec1(secplus1ToSend);
 
-            stateIndex++;
-            if (stateIndex == sizeof(secplus1States))
+            if (!ackPoll)
             {
-                stateIndex = sizeof(secplus1States) - 3;
+                stateIndex++;
+                if (stateIndex == sizeof(secplus1States))
+                {
+                    stateIndex = sizeof(secplus1States) - 3;
+                }
             }
         }
     }
 }
 
-void comms_loop_sec1()
+/****************************************************************************
+ * Sec+ 1.0 received message handlers, by first byte.  val is the opener's reply
+ * to a status poll, 0 for a button.
+ */
+typedef void (*Sec1Handler)(uint8_t val);
+
+void sec1_door_press(uint8_t)
+{
+    RINFO(TAG, "0x30 RX (door press)");
+    manual_recovery();
+    if (motionTriggers.bit.doorKey)
+    {
+        garage_door.motion_timer = millis() + MOTION_TIMER_DURATION;
+        garage_door.motion = true;
+        notify_homekit_motion();
+    }
+}
+
+// wall panel is sending out 0x31 (Door Button Release) when it starts up
+// but also on release of door button
+void sec1_door_release(uint8_t)
 {
-    static bool reading_msg = false;
-    static uint16_t byte_count = 0;
-    static RxPacket rx_packet;
-    bool gotMessage = false;
+    RINFO(TAG, "0x31 RX (door release)");
 
-    if (sw_serial.available())
+    // Possible power up of 889LM
+    if ((DoorState)doorState == DoorState::Unknown)
     {
-        uint8_t ser_byte = sw_serial.read();
-        last_rx = millis();
+        wallplateBooting = true;
+    }
+}
 
-        if (!reading_msg)
-        {
-            // valid?
-            if (ser_byte >= 0x30 && ser_byte <= 0x3A)
-            {
-                byte_count = 0;
-                rx_packet[byte_count++] = ser_byte;
-                reading_msg = true;
-            }
-            // is it single byte command?
-            // really all commands are single byte
-            // is it a button push or release? (FROM WALL PANEL)
-            if (ser_byte >= 0x30 && ser_byte <= 0x37)
-            {
-                rx_packet[1] = 0;
-                reading_msg = false;
-                byte_count = 0;
+void sec1_light_press(uint8_t)
+{
+    RINFO(TAG, "0x32 RX (light press)");
+    manual_recovery();
+}
 
-                gotMessage = true;
-            }
-        }
-        else
-        {
-            // save next byte
-            rx_packet[byte_count++] = ser_byte;
+void sec1_light_release(uint8_t)
+{
+    RINFO(TAG, "0x33 RX (light release)");
+}
 
-            if (byte_count == RX_LENGTH)
-            {
-                reading_msg = false;
-                byte_count = 0;
+// 2 byte status messages (0x38 - 0x3A)
+// its the byte sent out by the wallplate + the byte transmitted by the opener
+void sec1_door_status(uint8_t val)
+{
+    // RINFO(TAG, "0x38 MSG: %02X",val);
 
-                gotMessage = true;
-            }
+    // 0x5X = stopped
+    // 0x0X = moving
+    // best attempt to trap invalid values (due to collisions)
+    if (((val & 0xF0) != 0x00) && ((val & 0xF0) != 0x50) && ((val & 0xF0) != 0xB0))
+    {
+        RINFO(TAG, "0x38 val upper nible not 0x0 or 0x5 or 0xB: %02X", val);
+        return;
+    }
 
-            if (gotMessage == false && (millis() - last_rx) > 100)
-            {
-                RINFO(TAG, "RX message timeout");
-                // if we have a partial packet and it's been over 100ms since last byte was read,
-                // the rest is not coming (a full packet should be received in ~20ms),
-                // discard it so we can read the following packet correctly
-                reading_msg = false;
-                byte_count = 0;
-            }
-        }
+    val = (val & 0x7);
+    // 000 0x0 stopped
+    // 001 0x1 opening
+    // 010 0x2 open
+    // 100 0x4 closing
+    // 101 0x5 closed
+    // 110 0x6 stopped
+
+    // sec+1 doors sometimes report wrong door status
+    // require two sequential matching door states
+    // I have not seen this to be the case on my unit (MJS)
+    static uint8_t prevDoor;
+    if (prevDoor != val)
+    {
+        prevDoor = val;
+        return;
     }
 
-    // got data?
-    if (gotMessage)
+    switch (val)
     {
-        gotMessage = false;
+    case 0x00:
+        doorState = DoorState::Stopped;
+        break;
+    case 0x01:
+        doorState = DoorState::Opening;
+        break;
+    case 0x02:
+        doorState = DoorState::Open;
+        break;
+    // no 0x03 known
+    case 0x04:
+        doorState = DoorState::Closing;
+        break;
+    case 0x05:
+        doorState = DoorState::Closed;
+        break;
+    case 0x06:
+        doorState = DoorState::Stopped;
+        break;
+    default:
+        doorState = DoorState::Unknown;
+        break;
+    }
 
-        // get kvp
-        // button press/release have no val, just a single byte
-        uint8_t key = rx_packet[0];
-        uint8_t val = rx_packet[1];
+    // RINFO(TAG, "doorstate: %d", doorState);
 
-        if (key == secplus1Codes::DoorButtonPress)
+    if (doorState == DoorState::Unknown)
+        RERROR(TAG, "Got door state unknown");
+    door_state_event(doorState);
+    command_status(CommandAck::Door, garage_door.current_state);
+}
+
+void sec1_light_lock_status(uint8_t val)
+{
+    // RINFO(TAG, "0x3A MSG: %X%02X",key,val);
+
+    // upper nibble must be 5
+    if ((val & 0xF0) != 0x50)
+    {
+        RINFO(TAG, "0x3A val upper nible not 5: %02X", val);
+        return;
+    }
+
+    lightState = bitRead(val, 2);
+    lockState = !bitRead(val, 3);
+    command_status(CommandAck::Light, lightState);
+    command_status(CommandAck::Lock, lockState);
+
+    // light status
+    static uint8_t lastLightState = 0xff;
+    // light state change?
+    if (lightState != lastLightState)
+    {
+        RINFO(TAG, "status LIGHT: %s", lightState ? "On" : "Off");
+        lastLightState = lightState;
+
+        garage_door.light = (bool)lightState;
+        notify_homekit_light();
+        if (motionTriggers.bit.lightKey)
         {
-            RINFO(TAG, "0x30 RX (door press)");
-            manual_recovery();
-            if (motionTriggers.bit.doorKey)
-            {
-                garage_door.motion_timer = millis() + MOTION_TIMER_DURATION;
-                garage_door.motion = true;
-                notify_homekit_motion();
-            }
+            garage_door.motion_timer = millis() + MOTION_TIMER_DURATION;
+            garage_door.motion = true;
+            notify_homekit_motion();
         }
-        // wall panel is sending out 0x31 (Door Button Release) when it starts up
-        // but also on release of door button
-        else if (key == secplus1Codes::DoorButtonRelease)
-        {
-            RINFO(TAG, "0x31 RX (door release)");
+    }
 
-            // Possible power up of 889LM
-            if ((DoorState)doorState == DoorState::Unknown)
-            {
-                wallplateBooting = true;
-            }
-        }
-        else if (key == secplus1Codes::LightButtonPress)
+    // lock status
+    static uint8_t lastLockState = 0xff;
+    // lock state change?
+    if (lockState != lastLockState)
+    {
+        RINFO(TAG, "status LOCK: %s", lockState ? "Secured" : "Unsecured");
+        lastLockState = lockState;
+
+        if (lockState)
         {
-            RINFO(TAG, "0x32 RX (light press)");
-            manual_recovery();
+            garage_door.current_lock = CURR_LOCKED;
+            garage_door.target_lock = TGT_LOCKED;
         }
-        else if (key == secplus1Codes::LightButtonRelease)
+        else
         {
-            RINFO(TAG, "0x33 RX (light release)");
+            garage_door.current_lock = CURR_UNLOCKED;
+            garage_door.target_lock = TGT_UNLOCKED;
         }
-
-        // 2 byte status messages (0x38 - 0x3A)
-        // its the byte sent out by the wallplate + the byte transmitted by the opener
-        if (key == secplus1Codes::DoorStatus || key == secplus1Codes::ObstructionStatus || key == secplus1Codes::LightLockStatus)
+        notify_homekit_target_lock();
+        notify_homekit_current_lock();
+        if (motionTriggers.bit.lockKey)
         {
+            garage_door.motion_timer = millis() + MOTION_TIMER_DURATION;
+            garage_door.motion = true;
+            notify_homekit_motion();
+        }
+    }
+}
 
-            // RINFO(TAG, "SEC1 STATUS MSG: %X%02X",key,val);
-
-            switch (key)
-            {
-            // door status
-            case secplus1Codes::DoorStatus:
-
-                // RINFO(TAG, "0x38 MSG: %02X",val);
-
-                // 0x5X = stopped
-                // 0x0X = moving
-                // best attempt to trap invalid values (due to collisions)
-                if (((val & 0xF0) != 0x00) && ((val & 0xF0) != 0x50) && ((val & 0xF0) != 0xB0))
-                {
-                    RINFO(TAG, "0x38 val upper nible not 0x0 or 0x5 or 0xB: %02X", val);
-                    break;
-                }
-
-                val = (val & 0x7);
-                // 000 0x0 stopped
-                // 001 0x1 opening
-                // 010 0x2 open
-                // 100 0x4 closing
-                // 101 0x5 closed
-                // 110 0x6 stopped
-
-                // sec+1 doors sometimes report wrong door status
-                // require two sequential matching door states
-                // I have not seen this to be the case on my unit (MJS)
-                static uint8_t prevDoor;
-                if (prevDoor != val)
-                {
-                    prevDoor = val;
-                    break;
-                }
-
-                switch (val)
-                {
-                case 0x00:
-                    doorState = DoorState::Stopped;
-                    break;
-                case 0x01:
-                    doorState = DoorState::Opening;
-                    break;
-                case 0x02:
-                    doorState = DoorState::Open;
-                    break;
-                // no 0x03 known
-                case 0x04:
-                    doorState = DoorState::Closing;
-                    break;
-                case 0x05:
-                    doorState = DoorState::Closed;
-                    break;
-                case 0x06:
-                    doorState = DoorState::Stopped;
-                    break;
-                default:
-                    doorState = DoorState::Unknown;
-                    break;
-                }
-
-                // RINFO(TAG, "doorstate: %d", doorState);
-
-                switch (doorState)
-                {
-                case DoorState::Open:
-                    garage_door.current_state = CURR_OPEN;
-                    garage_door.target_state = TGT_OPEN;
-                    break;
-                case DoorState::Closed:
-                    garage_door.current_state = CURR_CLOSED;
-                    garage_door.target_state = TGT_CLOSED;
-                    break;
-                case DoorState::Stopped:
-                    garage_door.current_state = CURR_STOPPED;
-                    garage_door.target_state = TGT_OPEN;
-                    break;
-                case DoorState::Opening:
-                    garage_door.current_state = CURR_OPENING;
-                    garage_door.target_state = TGT_OPEN;
-                    break;
-                case DoorState::Closing:
-                    garage_door.current_state = CURR_CLOSING;
-                    garage_door.target_state = TGT_CLOSED;
-                    break;
-                case DoorState::Unknown:
-                    RERROR(TAG, "Got door state unknown");
-                    break;
-                }
-
-                if ((garage_door.current_state == CURR_CLOSING) && (TTCcountdown > 0))
-                {
-                    // We are in a time-to-close delay timeout, cancel the timeout
-                    RINFO(TAG, "Canceling time-to-close delay timer");
-                    TTCtimer.detach();
-                    TTCcountdown = 0;
-                }
-
-                if (!garage_door.active)
-                {
-                    RINFO(TAG, "activating door");
-                    garage_door.active = true;
-                    if (garage_door.current_state == CURR_OPENING || garage_door.current_state == CURR_OPEN)
-                    {
-                        garage_door.target_state = TGT_OPEN;
-                    }
-                    else
-                    {
-                        garage_door.target_state = TGT_CLOSED;
-                    }
-                }
-
-                static GarageDoorCurrentState gd_currentstate;
-                if (garage_door.current_state != gd_currentstate)
-                {
-                    gd_currentstate = garage_door.current_state;
-
-                    const char *l = "unknown door state";
-                    switch (gd_currentstate)
-                    {
-                    case GarageDoorCurrentState::CURR_STOPPED:
-                        l = "Stopped";
-                        break;
-                    case GarageDoorCurrentState::CURR_OPEN:
-                        l = "Open";
-                        break;
-                    case GarageDoorCurrentState::CURR_OPENING:
-                        l = "Opening";
-                        break;
-                    case GarageDoorCurrentState::CURR_CLOSED:
-                        l = "Closed";
-                        break;
-                    case GarageDoorCurrentState::CURR_CLOSING:
-                        l = "Closing";
-                        break;
-                    }
-                    RINFO(TAG, "status DOOR: %s", l);
-
-                    notify_homekit_current_door_state_change();
-                }
-
-                static GarageDoorTargetState gd_TargetState;
-                if (garage_door.target_state != gd_TargetState)
-                {
-                    gd_TargetState = garage_door.target_state;
-                    notify_homekit_target_door_state_change();
-                }
-
-                break;
-
-            // objstruction states (not confirmed)
-            case secplus1Codes::ObstructionStatus:
-                // currently not using
-                break;
-
-            // light & lock
-            case secplus1Codes::LightLockStatus:
-
-                // RINFO(TAG, "0x3A MSG: %X%02X",key,val);
-
-                // upper nibble must be 5
-                if ((val & 0xF0) != 0x50)
-                {
-                    RINFO(TAG, "0x3A val upper nible not 5: %02X", val);
-                    break;
-                }
-
-                lightState = bitRead(val, 2);
-                lockState = !bitRead(val, 3);
-
-                // light status
-                static uint8_t lastLightState = 0xff;
-                // light state change?
-                if (lightState != lastLightState)
-                {
-                    RINFO(TAG, "status LIGHT: %s", lightState ? "On" : "Off");
-                    lastLightState = lightState;
-
-                    garage_door.light = (bool)lightState;
-                    notify_homekit_light();
-                    if (motionTriggers.bit.lightKey)
-                    {
-                        garage_door.motion_timer = millis() + MOTION_TIMER_DURATION;
-                        garage_door.motion = true;
-                        notify_homekit_motion();
-                    }
-                }
-
-                // lock status
-                static uint8_t lastLockState = 0xff;
-                // lock state change?
-                if (lockState != lastLockState)
-                {
-                    RINFO(TAG, "status LOCK: %s", lockState ? "Secured" : "Unsecured");
-                    lastLockState = lockState;
-
-                    if (lockState)
-                    {
-                        garage_door.current_lock = CURR_LOCKED;
-                        garage_door.target_lock = TGT_LOCKED;
-                    }
-                    else
-                    {
-                        garage_door.current_lock = CURR_UNLOCKED;
-                        garage_door.target_lock = TGT_UNLOCKED;
-                    }
-                    notify_homekit_target_lock();
-                    notify_homekit_current_lock();
-                    if (motionTriggers.bit.lockKey)
-                    {
-                        garage_door.motion_timer = millis() + MOTION_TIMER_DURATION;
-                        garage_door.motion = true;
-                        notify_homekit_motion();
-                    }
-                }
+// Indexed from SECPLUS1_FIRST_CODE, as SECPLUS1_FRAME_LEN.  NULL for lock
+// buttons, the unknown codes and obstruction status (not confirmed), which are
+// not used.
+static constexpr Sec1Handler sec1_handlers[] = {
+    sec1_door_press,        // 0x30
+    sec1_door_release,      // 0x31
+    sec1_light_press,       // 0x32
+    sec1_light_release,     // 0x33
+    NULL,                   // 0x34 lock press
+    NULL,                   // 0x35 lock release
+    NULL,                   // 0x36
+    NULL,                   // 0x37
+    sec1_door_status,       // 0x38
+    NULL,                   // 0x39 obstruction
+    sec1_light_lock_status, // 0x3A
+};
+static_assert(sizeof(sec1_handlers) / sizeof(sec1_handlers[0]) == sizeof(SECPLUS1_FRAME_LEN),
+              "a handler slot for every Security+1.0 code");
 
-                break;
-            }
+void comms_loop_sec1()
+{
+    // everything buffered, so that a poll and its reply are handled together
+    while (gdo_bus.available())
+    {
+        uint8_t ser_byte = gdo_bus.read();
+        last_rx = millis();
+        capture_record(&ser_byte, 1, BUS_CAPTURE_RX);
+        if (sec1_reader.push_byte(ser_byte, last_rx))
+        {
+            const uint8_t *msg = sec1_reader.fetch_buf();
+            Sec1Handler handler = sec1_handlers[msg[0] - SECPLUS1_FIRST_CODE];
+            if (handler)
+                handler(msg[1]);
         }
     }
+    // a poll whose reply never came is dropped now, not when the next byte arrives
+    sec1_reader.expire(millis());
 
     //
     // PROCESS TRANSMIT QUEUE
@@ -642,8 +950,18 @@ void comms_loop_sec1()
     unsigned long now;
     bool okToSend = false;
     static uint16_t retryCount = 0;
+    // button held down until the opener is seen to act on it, or for as long as
+    // the command allows
+    static CommandAck held = CommandAck::None;
+    static unsigned long heldSince = 0;
+    static unsigned long holdLimit = 0;
+
+    if (held != CommandAck::None && (!command_awaited(held) || millis() - heldSince > holdLimit))
+    {
+        held = CommandAck::None;
+    }
 
-    if (uxQueueMessagesWaiting(pkt_q) > 0)
+    if (commands_waiting() > 0)
     {
         now = millis();
 
@@ -669,22 +987,39 @@ void comms_loop_sec1()
         if (okToSend)
         {
 
-            if (uxQueueMessagesWaiting(pkt_q) > 0)
+            uint32_t seq = 0;
+            // while a button is held only polls go out, they are how we see it acted on
+            bool found = (held == CommandAck::None) ? next_command(pkt_ac, &seq) : next_poll(pkt_ac);
+            if (found)
             {
                 ESP_LOGD(TAG, "packet ready for tx");
-                xQueueReceive(pkt_q, &pkt_ac, 0); // ignore errors
                 if (process_PacketAction(pkt_ac))
                 {
                     // get next delay "between" transmits
                     cmdDelay = pkt_ac.delay;
+                    // retries are counted per command
+                    retryCount = 0;
+                    if (seq)
+                    {
+                        command_sent(pkt_ac, seq);
+                    }
+                    if (pkt_ac.ack != CommandAck::None)
+                    {
+                        // delay is how long to hold the button if no ack comes
+                        held = pkt_ac.ack;
+                        heldSince = now;
+                        holdLimit = pkt_ac.delay;
+                        cmdDelay = 0;
+                    }
                 }
-                else
+                // out of turn polls are not retried, another will follow
+                else if (held == CommandAck::None)
                 {
                     cmdDelay = 0;
                     if (retryCount++ < MAX_COMMS_RETRY)
                     {
                         RERROR(TAG, "transmit failed, will retry");
-                        xQueueSendToFront(pkt_q, &pkt_ac, 0); // ignore errors
+                        retry_command(pkt_ac);
                     }
                     else
                     {
@@ -701,272 +1036,333 @@ void comms_loop_sec1()
 }
 
 /****************************************************************************
- * Sec+ 2.0 loop functions.
+ * Sec+ 2.0 received packet handler.
  */
-void comms_loop_sec2()
+void process_Sec2Packet(Packet &pkt)
 {
-    static uint16_t retryCount = 0;
-
-    // no incoming data, check if we have command queued
-    if (!sw_serial.available())
+    switch (pkt.m_pkt_cmd)
     {
-        PacketAction pkt_ac;
-
-        if (uxQueueMessagesWaiting(pkt_q) > 0)
+    case PacketCommand::Status:
+    {
+        status_poller.status(millis());
+        if (pkt.m_data.value.status.door == DoorState::Unknown)
+            RERROR(TAG, "Got door state unknown");
+        door_state_event(pkt.m_data.value.status.door);
+        command_status(CommandAck::Door, garage_door.current_state);
+        command_status(CommandAck::Light, pkt.m_data.value.status.light);
+        command_status(CommandAck::Lock, pkt.m_data.value.status.lock);
+
+        if (pkt.m_data.value.status.light != garage_door.light)
         {
-            ESP_LOGD(TAG, "packet ready for tx");
-            xQueueReceive(pkt_q, &pkt_ac, 0); // ignore errors
-            if (!process_PacketAction(pkt_ac))
-            {
+            RINFO(TAG, "Light Status %s", pkt.m_data.value.status.light ? "On" : "Off");
+            garage_door.light = pkt.m_data.value.status.light;
+            notify_homekit_light();
+        }
 
-                if (retryCount++ < MAX_COMMS_RETRY)
-                {
-                    RERROR(TAG, "transmit failed, will retry");
-                    xQueueSendToFront(pkt_q, &pkt_ac, 0); // ignore errors
-                }
-                else
-                {
-                    RERROR(TAG, "transmit failed, exceeded max retry, aborting");
-                    retryCount = 0;
-                }
-            }
+        LockCurrentState current_lock;
+        LockTargetState target_lock;
+        if (pkt.m_data.value.status.lock)
+        {
+            current_lock = CURR_LOCKED;
+            target_lock = TGT_LOCKED;
         }
+        else
+        {
+            current_lock = CURR_UNLOCKED;
+            target_lock = TGT_UNLOCKED;
+        }
+        if (current_lock != garage_door.current_lock)
+        {
+            garage_door.target_lock = target_lock;
+            garage_door.current_lock = current_lock;
+            notify_homekit_target_lock();
+            notify_homekit_current_lock();
+        }
+
+        status_done = true;
+        break;
     }
-    else
+
+    case PacketCommand::Lock:
     {
-        // spin on receiving data until the whole packet has arrived
-        uint8_t ser_data = sw_serial.read();
-        if (reader.push_byte(ser_data))
+        LockTargetState lock = garage_door.target_lock;
+        switch (pkt.m_data.value.lock.lock)
         {
-            Packet pkt = Packet(reader.fetch_buf());
-            pkt.print();
-
-            switch (pkt.m_pkt_cmd)
+        case LockState::Off:
+            lock = TGT_UNLOCKED;
+            break;
+        case LockState::On:
+            lock = TGT_LOCKED;
+            break;
+        case LockState::Toggle:
+            if (lock == TGT_LOCKED)
             {
-            case PacketCommand::Status:
+                lock = TGT_UNLOCKED;
+            }
+            else
             {
-                GarageDoorCurrentState current_state = garage_door.current_state;
-                GarageDoorTargetState target_state = garage_door.target_state;
-                switch (pkt.m_data.value.status.door)
-                {
-                case DoorState::Open:
-                    current_state = CURR_OPEN;
-                    target_state = TGT_OPEN;
-                    break;
-                case DoorState::Closed:
-                    current_state = CURR_CLOSED;
-                    target_state = TGT_CLOSED;
-                    break;
-                case DoorState::Stopped:
-                    current_state = CURR_STOPPED;
-                    target_state = TGT_OPEN;
-                    break;
-                case DoorState::Opening:
-                    current_state = CURR_OPENING;
-                    target_state = TGT_OPEN;
-                    break;
-                case DoorState::Closing:
-                    current_state = CURR_CLOSING;
-                    target_state = TGT_CLOSED;
-                    break;
-                case DoorState::Unknown:
-                    RERROR(TAG, "Got door state unknown");
-                    break;
-                }
-
-                if ((current_state == CURR_CLOSING) && (TTCcountdown > 0))
-                {
-                    // We are in a time-to-close delay timeout, cancel the timeout
-                    RINFO(TAG, "Canceling time-to-close delay timer");
-                    TTCtimer.detach();
-                    TTCcountdown = 0;
-                }
-
-                if (!garage_door.active)
-                {
-                    RINFO(TAG, "activating door");
-                    garage_door.active = true;
-                    if (current_state == CURR_OPENING || current_state == CURR_OPEN)
-                    {
-                        target_state = TGT_OPEN;
-                    }
-                    else
-                    {
-                        target_state = TGT_CLOSED;
-                    }
-                }
+                lock = TGT_LOCKED;
+            }
+            break;
+        }
+        if (lock != garage_door.target_lock)
+        {
+            RINFO(TAG, "Lock Cmd %d", lock);
+            garage_door.target_lock = lock;
+            notify_homekit_target_lock();
+            if (motionTriggers.bit.lockKey)
+            {
+                garage_door.motion_timer = millis() + MOTION_TIMER_DURATION;
+                garage_door.motion = true;
+                notify_homekit_motion();
+            }
+        }
+        // Send a get status to make sure we are in sync
+        send_get_status();
+        break;
+    }
 
-                RINFO(TAG, "tgt %d curr %d", target_state, current_state);
+    case PacketCommand::Light:
+    {
+        bool l = garage_door.light;
+        manual_recovery();
+        switch (pkt.m_data.value.light.light)
+        {
+        case LightState::Off:
+            l = false;
+            break;
+        case LightState::On:
+            l = true;
+            break;
+        case LightState::Toggle:
+        case LightState::Toggle2:
+            l = !garage_door.light;
+            break;
+        }
+        if (l != garage_door.light)
+        {
+            RINFO(TAG, "Light Cmd %s", l ? "On" : "Off");
+            garage_door.light = l;
+            notify_homekit_light();
+            if (motionTriggers.bit.lightKey)
+            {
+                garage_door.motion_timer = millis() + MOTION_TIMER_DURATION;
+                garage_door.motion = true;
+                notify_homekit_motion();
+            }
+        }
+        // Send a get status to make sure we are in sync
+        // Should really only need to do this on a toggle,
+        // But safer to do it always
+        send_get_status();
+        break;
+    }
 
-                if ((target_state != garage_door.target_state) ||
-                    (current_state != garage_door.current_state))
-                {
-                    garage_door.target_state = target_state;
-                    garage_door.current_state = current_state;
+    case PacketCommand::Motion:
+    {
+        RINFO(TAG, "Motion Detected");
+        // We got a motion message, so we know we have a motion sensor
+        // If it's not yet enabled, add the service
+        if (!garage_door.has_motion_sensor)
+        {
+            RINFO(TAG, "Detected new Motion Sensor. Enabling Service");
+            garage_door.has_motion_sensor = true;
+            motionTriggers.bit.motion = 1;
+            userConfig->set(cfg_motionTriggers, motionTriggers.asInt);
+            enable_service_homekit_motion();
+        }
 
-                    notify_homekit_current_door_state_change();
-                    notify_homekit_target_door_state_change();
-                }
+        /* When we get the motion detect message, notify HomeKit. Motion sensor
+            will continue to send motion messages every 5s until motion stops.
+            set a timer for 5 seconds to disable motion after the last message */
+        garage_door.motion_timer = millis() + MOTION_TIMER_DURATION;
+        if (!garage_door.motion)
+        {
+            garage_door.motion = true;
+            notify_homekit_motion();
+        }
+        // Update status because things like light may have changed states
+        send_get_status();
+        break;
+    }
 
-                if (pkt.m_data.value.status.light != garage_door.light)
-                {
-                    RINFO(TAG, "Light Status %s", pkt.m_data.value.status.light ? "On" : "Off");
-                    garage_door.light = pkt.m_data.value.status.light;
-                    notify_homekit_light();
-                }
+    case PacketCommand::DoorAction:
+    {
+        RINFO(TAG, "Door Action");
+        if (pkt.m_data.value.door_action.pressed)
+        {
+            manual_recovery();
+        }
+        if (pkt.m_data.value.door_action.pressed && motionTriggers.bit.doorKey)
+        {
+            garage_door.motion_timer = millis() + MOTION_TIMER_DURATION;
+            garage_door.motion = true;
+            notify_homekit_motion();
+        }
+        break;
+    }
 
-                LockCurrentState current_lock;
-                LockTargetState target_lock;
-                if (pkt.m_data.value.status.lock)
-                {
-                    current_lock = CURR_LOCKED;
-                    target_lock = TGT_LOCKED;
-                }
-                else
-                {
-                    current_lock = CURR_UNLOCKED;
-                    target_lock = TGT_UNLOCKED;
-                }
-                if (current_lock != garage_door.current_lock)
-                {
-                    garage_door.target_lock = target_lock;
-                    garage_door.current_lock = current_lock;
-                    notify_homekit_target_lock();
-                    notify_homekit_current_lock();
-                }
+    case PacketCommand::PingResp:
+    {
+        if (link_monitor.response(micros()))
+        {
+            RINFO(TAG, "Link to door opener %s, ping %lu ms", LinkMonitor::name(link_monitor.health()),
+                  link_monitor.rtt_last_us() / 1000);
+        }
+        break;
+    }
 
-                status_done = true;
-                break;
-            }
+    default:
+        RINFO(TAG, "Support for %s packet unimplemented. Ignoring.", PacketCommand::to_string(pkt.m_pkt_cmd));
+        break;
+    }
+}
+
+/****************************************************************************
+ * Sec+ 2.0 loop functions.
+ */
+// Nothing went out, try again later unless this command has had enough goes
+static void transmit_failed_sec2(const PacketAction &tx_ac)
+{
+    // retries are counted per command, and spaced out by sec2_contention
+    sec2_contention.collided(micros(), random(0, 0x7FFFFFFF));
+    if (sec2_contention.attempts() <= MAX_COMMS_RETRY)
+    {
+        RERROR(TAG, "transmit failed, will retry");
+        retry_command(tx_ac);
+    }
+    else
+    {
+        RERROR(TAG, "transmit failed, exceeded max retry, aborting");
+        sec2_contention.gave_up();
+        if (tx_ac.pkt.m_pkt_cmd == PacketCommand::Ping)
+        {
+            link_monitor.dropped();
+        }
+    }
+}
+
+void comms_loop_sec2()
+{
+    static bool sending = false;
+    static PacketAction tx_ac;
+    static uint32_t tx_seq = 0;
 
-            case PacketCommand::Lock:
+    // a transmit started on an earlier pass, see if it is done
+    if (sending)
+    {
+        SecPlus2Transmitter::Result result = sec2_tx.poll();
+        if (result != SecPlus2Transmitter::Result::Busy)
+        {
+            sending = false;
+            if (end_transmitSec2(tx_ac, result))
             {
-                LockTargetState lock = garage_door.target_lock;
-                switch (pkt.m_data.value.lock.lock)
-                {
-                case LockState::Off:
-                    lock = TGT_UNLOCKED;
-                    break;
-                case LockState::On:
-                    lock = TGT_LOCKED;
-                    break;
-                case LockState::Toggle:
-                    if (lock == TGT_LOCKED)
-                    {
-                        lock = TGT_UNLOCKED;
-                    }
-                    else
-                    {
-                        lock = TGT_LOCKED;
-                    }
-                    break;
-                }
-                if (lock != garage_door.target_lock)
+                sec2_contention.sent(micros());
+                command_sent(tx_ac, tx_seq);
+                if (tx_ac.pkt.m_pkt_cmd == PacketCommand::Ping)
                 {
-                    RINFO(TAG, "Lock Cmd %d", lock);
-                    garage_door.target_lock = lock;
-                    notify_homekit_target_lock();
-                    if (motionTriggers.bit.lockKey)
-                    {
-                        garage_door.motion_timer = millis() + MOTION_TIMER_DURATION;
-                        garage_door.motion = true;
-                        notify_homekit_motion();
-                    }
+                    link_monitor.sent(micros());
                 }
-                // Send a get status to make sure we are in sync
-                send_get_status();
-                break;
             }
-
-            case PacketCommand::Light:
+            else
             {
-                bool l = garage_door.light;
-                manual_recovery();
-                switch (pkt.m_data.value.light.light)
-                {
-                case LightState::Off:
-                    l = false;
-                    break;
-                case LightState::On:
-                    l = true;
-                    break;
-                case LightState::Toggle:
-                case LightState::Toggle2:
-                    l = !garage_door.light;
-                    break;
-                }
-                if (l != garage_door.light)
-                {
-                    RINFO(TAG, "Light Cmd %s", l ? "On" : "Off");
-                    garage_door.light = l;
-                    notify_homekit_light();
-                    if (motionTriggers.bit.lightKey)
-                    {
-                        garage_door.motion_timer = millis() + MOTION_TIMER_DURATION;
-                        garage_door.motion = true;
-                        notify_homekit_motion();
-                    }
-                }
-                // Send a get status to make sure we are in sync
-                // Should really only need to do this on a toggle,
-                // But safer to do it always
-                send_get_status();
-                break;
+                transmit_failed_sec2(tx_ac);
             }
+        }
+    }
 
-            case PacketCommand::Motion:
-            {
-                RINFO(TAG, "Motion Detected");
-                // We got a motion message, so we know we have a motion sensor
-                // If it's not yet enabled, add the service
-                if (!garage_door.has_motion_sensor)
-                {
-                    RINFO(TAG, "Detected new Motion Sensor. Enabling Service");
-                    garage_door.has_motion_sensor = true;
-                    motionTriggers.bit.motion = 1;
-                    userConfig->set(cfg_motionTriggers, motionTriggers.asInt);
-                    enable_service_homekit_motion();
-                }
+    uint32_t now = micros();
+    if (gdo_bus.line_busy())
+    {
+        sec2_contention.heard(now);
+    }
+    // ask for status while the door moves or a command waits on the opener
+    bool door_busy = garage_door.current_state == CURR_OPENING || garage_door.current_state == CURR_CLOSING ||
+                     command_awaited(CommandAck::Door) || command_awaited(CommandAck::Light) ||
+                     command_awaited(CommandAck::Lock);
+    if (garage_door.active && status_poller.due(millis(), door_busy))
+    {
+        send_get_status();
+    }
 
-                /* When we get the motion detect message, notify HomeKit. Motion sensor
-                    will continue to send motion messages every 5s until motion stops.
-                    set a timer for 5 seconds to disable motion after the last message */
-                garage_door.motion_timer = millis() + MOTION_TIMER_DURATION;
-                if (!garage_door.motion)
-                {
-                    garage_door.motion = true;
-                    notify_homekit_motion();
-                }
-                // Update status because things like light may have changed states
-                send_get_status();
-                break;
-            }
+    // ping the opener while otherwise idle, to know the link is there
+    if (link_monitor.poll(now))
+    {
+        RERROR(TAG, "Link to door opener %s, %lu pings lost", LinkMonitor::name(link_monitor.health()),
+               link_monitor.pings_lost());
+    }
+    if (garage_door.active && !door_busy && !sending && commands_waiting() == 0 && link_monitor.due(now))
+    {
+        send_ping();
+    }
+
+    bool waiting = !sending && commands_waiting() > 0;
+    if (waiting)
+    {
+        sec2_contention.ready(now);
+    }
 
-            case PacketCommand::DoorAction:
+    // no incoming data and not still sending, check if we have command queued
+    if (!gdo_bus.available())
+    {
+        if (sending)
+        {
+            // nothing to do until poll() says it has gone
+        }
+        else if (waiting && sec2_contention.clear(now))
+        {
+            ESP_LOGD(TAG, "packet ready for tx");
+            next_command(tx_ac, &tx_seq);
+            // Use LED to signal activity
+            led.flash(FLASH_MS);
+            sending = start_transmitSec2(tx_ac);
+            if (!sending)
             {
-                RINFO(TAG, "Door Action");
-                if (pkt.m_data.value.door_action.pressed)
+                // could not encode it or wake the bus
+                transmit_failed_sec2(tx_ac);
+            }
+        }
+        else if (rolling_journal.ready() && rolling_codes_left() < ROLLING_CODE_LEASE_LOW)
+        {
+            // bus idle and nothing to send, journal codes before they are needed
+            reserve_rolling_codes();
+        }
+        else
+        {
+            // bus idle and nothing to send, get the next likely packets ready
+            frame_cache.set_rolling(rolling_code);
+            frame_cache.fill_one();
+        }
+    }
+    else
+    {
+        // drain everything buffered so that back-to-back packets are all handled this pass
+        uint8_t rx_buf[SEC2_RX_LENGTH];
+        sec2_contention.heard(now);
+        while (gdo_bus.available())
+        {
+            size_t len = gdo_bus.read(rx_buf, sizeof(rx_buf));
+            capture_record(rx_buf, len, BUS_CAPTURE_RX);
+            reader.push_bytes(rx_buf, len, millis(), [](const uint8_t *frame)
+                              {
+                Packet pkt = Packet(frame);
+                if (!pkt.valid())
                 {
-                    manual_recovery();
+                    RDEBUG(TAG, "Rejected corrupt packet (%s)", pkt.m_decoded ? "parity" : "decode");
+                    rejected_packets++;
+                    return;
                 }
-                if (pkt.m_data.value.door_action.pressed && motionTriggers.bit.doorKey)
+                if (pkt.m_remote_id != (id_code & 0xFFFFFF))
                 {
-                    garage_door.motion_timer = millis() + MOTION_TIMER_DURATION;
-                    garage_door.motion = true;
-                    notify_homekit_motion();
+                    sec2_contention.frame(micros(), pkt.m_remote_id);
                 }
-                break;
-            }
-
-            default:
-                RINFO(TAG, "Support for %s packet unimplemented. Ignoring.", PacketCommand::to_string(pkt.m_pkt_cmd));
-                break;
-            }
+                pkt.print();
+                process_Sec2Packet(pkt); });
         }
     }
 
-    // Save rolling code if we have exceeded max limit.
-    if (rolling_code >= (last_saved_code + MAX_CODES_WITHOUT_FLASH_WRITE))
+    // Save rolling code if we have exceeded max limit, the journal keeps ahead of it instead
+    if (!rolling_journal.ready() && rolling_code >= (last_saved_code + MAX_CODES_WITHOUT_FLASH_WRITE))
     {
         save_rolling_code();
     }
@@ -974,42 +1370,156 @@ void comms_loop_sec2()
 
 void comms_loop_drycontact()
 {
-    static DoorState previousDoorState = DoorState::Unknown;
+    // drycontact_loop() sets doorState from the limit switches
+    door_state_event(doorState);
+}
 
-    // Notify HomeKit when the door state changes
-    if (doorState != previousDoorState)
+/****************************************************************************
+ * Protocol detection, on first boot.  Listens at the speed ProtocolDetector
+ * says and never transmits, so door commands are refused until done.
+ */
+void comms_loop_detect()
+{
+    protocol_detector.dry_contact(!digitalRead(DRY_CONTACT_OPEN_PIN) || !digitalRead(DRY_CONTACT_CLOSE_PIN));
+    if (protocol_detector.poll(millis()))
     {
-        switch (doorState)
+        if (protocol_detector.done())
         {
-        case DoorState::Open:
-            garage_door.current_state = GarageDoorCurrentState::CURR_OPEN;
-            garage_door.target_state = GarageDoorTargetState::TGT_OPEN;
-            break;
-        case DoorState::Closed:
-            garage_door.current_state = GarageDoorCurrentState::CURR_CLOSED;
-            garage_door.target_state = GarageDoorTargetState::TGT_CLOSED;
-            break;
-        case DoorState::Opening:
-            garage_door.current_state = GarageDoorCurrentState::CURR_OPENING;
-            garage_door.target_state = GarageDoorTargetState::TGT_OPEN;
-            break;
-        case DoorState::Closing:
-            garage_door.current_state = GarageDoorCurrentState::CURR_CLOSING;
-            garage_door.target_state = GarageDoorTargetState::TGT_CLOSED;
-            break;
-        default:
-            garage_door.current_state = GarageDoorCurrentState::CURR_STOPPED;
-            break;
+            detect_finished(protocol_detector.result());
+            return;
+        }
+        if (protocol_detector.listening() == GdoProtocol::SecPlus2)
+        {
+            doorControlType = 2;
+            gdo_bus.begin(9600, BusParity::None);
+            reader = SecPlus2Reader();
+        }
+        else
+        {
+            if (protocol_detector.rounds() == ProtocolDetector::ROUNDS)
+            {
+                RERROR(TAG, "No door opener heard in %lums, still listening. Move the door, or choose the protocol",
+                       protocol_detector.elapsed_ms());
+            }
+            doorControlType = 1;
+            gdo_bus.begin(1200, BusParity::Even);
+            sec1_reader = SecPlus1Reader();
         }
+    }
 
-        notify_homekit_current_door_state_change();
-        notify_homekit_target_door_state_change();
+    uint8_t rx_buf[SEC2_RX_LENGTH];
+    while (gdo_bus.available())
+    {
+        size_t len = gdo_bus.read(rx_buf, sizeof(rx_buf));
+        capture_record(rx_buf, len, BUS_CAPTURE_RX);
+        if (doorControlType == 2)
+        {
+            protocol_detector.sec2_bytes();
+            reader.push_bytes(rx_buf, len, millis(), [](const uint8_t *frame)
+                              {
+                // anyone's, we have not sent any
+                Packet pkt = Packet(frame);
+                if (pkt.m_decoded && pkt.m_parity_ok)
+                    protocol_detector.sec2_frame(); });
+            continue;
+        }
+        for (size_t i = 0; i < len; i++)
+        {
+            protocol_detector.sec1_byte(rx_buf[i], millis());
+            if (sec1_reader.push_byte(rx_buf[i], millis()))
+            {
+                protocol_detector.sec1_message(sec1_reader.fetch_buf()[0], sec1_reader.fetch_buf()[1]);
+            }
+        }
+    }
+    sec1_reader.expire(millis());
+}
+
+void detect_finished(GdoProtocol found)
+{
+    detecting = false;
+    uint32_t configured = userConfig->getGDOSecurityType();
+    RINFO(TAG, "Door opener detected in %lums: %s", protocol_detector.elapsed_ms(), ProtocolDetector::name(found));
+    nvRam->write(nvram_protocol_set, 1);
 
-        previousDoorState = doorState;
+    if (static_cast<uint32_t>(found) != configured)
+    {
+        if (nvRam->read(cfg_GDOSecurityType, -1) >= 0)
+        {
+            // chosen by hand, which wins
+            RERROR(TAG, "Door opener sounds like %s, but GDOSecurityType is set to %s, keeping it",
+                   ProtocolDetector::name(found), ProtocolDetector::name((GdoProtocol)configured));
+        }
+        else
+        {
+            // HomeKit services depend on it, so as if chosen in the web page.  Nothing
+            // was sent while detecting, so there is no id or rolling code to reset.
+            RINFO(TAG, "Changing GDOSecurityType from %s, restarting", ProtocolDetector::name((GdoProtocol)configured));
+            userConfig->set(cfg_GDOSecurityType, static_cast<int>(found));
+            sync_and_restart();
+            return;
+        }
+    }
 
-        // Log the state change for debugging
-        RINFO(TAG, "Door state updated: Current: %d, Target: %d", garage_door.current_state, garage_door.target_state);
+    if (configured == 1)
+    {
+        doorControlType = 1;
+        setup_comms_sec1();
     }
+    else if (configured == 2)
+    {
+        doorControlType = 2;
+        setup_comms_sec2();
+    }
+    else
+    {
+        doorControlType = 3;
+        setup_comms_drycontact();
+    }
+}
+
+/****************************************************************************
+ * Status page counters.  Only this task touches the counters, the web server
+ * reads a copy taken each pass, under tx_mutex.
+ */
+static CommsStats comms_stats_copy = {};
+
+static void publish_comms_stats()
+{
+    CommsStats st;
+    st.packets_lost = reader.lost_count();
+    st.packets_resynced = reader.resync_count();
+    st.packets_rejected = rejected_packets;
+    st.packets_pre_encoded = frame_cache.hits();
+    st.transmit_collisions = sec2_contention.collisions();
+    st.transmit_gave_up = sec2_contention.given_up();
+    st.transmit_wait_avg_us = sec2_contention.wait_avg_us();
+    st.transmit_wait_max_us = sec2_contention.wait_max_us();
+    st.status_polls = status_poller.polls();
+    st.link_health = link_monitor.health();
+    st.pings_sent = link_monitor.pings_sent();
+    st.pings_lost = link_monitor.pings_lost();
+    st.ping_rtt_min_us = link_monitor.rtt_min_us();
+    st.ping_rtt_avg_us = link_monitor.rtt_avg_us();
+    st.ping_rtt_max_us = link_monitor.rtt_max_us();
+    for (size_t i = 0; i < LinkMonitor::BUCKETS; i++)
+        st.ping_rtt_histogram[i] = link_monitor.histogram(i);
+    st.commands_unacked = commands_unacked;
+
+    xSemaphoreTake(tx_mutex, portMAX_DELAY);
+    // the scheduler is also changed from other tasks, under the same lock
+    st.command_queue_peak = tx_scheduler.high_water();
+    st.commands_dropped = tx_scheduler.dropped();
+    st.commands_coalesced = tx_scheduler.coalesced();
+    comms_stats_copy = st;
+    xSemaphoreGive(tx_mutex);
+}
+
+void comms_stats(CommsStats &stats)
+{
+    xSemaphoreTake(tx_mutex, portMAX_DELAY);
+    stats = comms_stats_copy;
+    xSemaphoreGive(tx_mutex);
 }
 
 void comms_loop()
@@ -1017,13 +1527,19 @@ void comms_loop()
     if (!comms_setup_done)
         return;
 
-    if (doorControlType == 1)
+    if (detecting)
+        comms_loop_detect();
+    else if (doorControlType == 1)
         comms_loop_sec1();
     else if (doorControlType == 2)
         comms_loop_sec2();
     else
         comms_loop_drycontact();
 
+    // Commands the opener has not acted on
+    if (doorControlType != 3)
+        command_timeouts();
+
     // Motion Clear Timer
     if (garage_door.motion && (millis() > garage_door.motion_timer))
     {
@@ -1034,6 +1550,56 @@ void comms_loop()
 
     // Service the Obstruction Timer
     obstruction_timer();
+
+    publish_comms_stats();
+}
+
+/****************************************************************************
+ * Comms task.  comms_loop() runs in its own task, pinned and at a priority above
+ * loop(), so that web, vehicle and the rest cannot hold up the bus.  It sleeps
+ * until woken by bytes arriving (if the bus can say so), a command being queued,
+ * or the longest it can go before its timers need a look.
+ *
+ * Handing state between tasks:
+ * - garage_door is written here, other tasks only read it.  The exceptions are
+ *   the has_*_sensor flags, set at startup and when a sensor is first seen.
+ *   set_lock() runs in other tasks, so it leaves target_lock to next_command().
+ *   Each field is a word or less, so a reader sees the old value or the new,
+ *   never part of one, but two fields read together may be from either side of
+ *   an update.
+ * - HomeKit learns of changes through notify_homekit_*(), which queue a copy of
+ *   the new value to the HomeSpan task.
+ * - doorOpening() and doorClosing() only set a flag, vehicle_loop() acts on it.
+ * - Commands come in through queue_command(), under tx_mutex, which wakes us.
+ * - The web server's status counters are copied out each pass, under tx_mutex,
+ *   see comms_stats().
+ * - The bus capture is recorded here and controlled from the web server, under
+ *   capture_mutex.
+ */
+void comms_wake()
+{
+    if (comms_task_handle)
+        xTaskNotifyGive(comms_task_handle);
+}
+
+// One pass, returns how long in ms until the next is needed
+uint32_t comms_task_step()
+{
+    comms_loop();
+    if (doorControlType != 3 && !bus_notifies)
+        return COMMS_TASK_BUSY_MS;
+    if (sec2_tx.busy() || commands_waiting() > 0)
+        return COMMS_TASK_BUSY_MS;
+    return COMMS_TASK_IDLE_MS;
+}
+
+void comms_task(void *arg)
+{
+    for (;;)
+    {
+        uint32_t wait_ms = comms_task_step();
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms));
+    }
 }
 
 /**************************** CONTROLLER CODE *******************************
@@ -1043,7 +1609,7 @@ bool transmitSec1(byte toSend)
 {
 
     // safety
-    if (digitalRead(UART_RX_PIN) || sw_serial.available())
+    if (gdo_bus.line_busy() || gdo_bus.available())
     {
         return false;
     }
@@ -1054,18 +1620,20 @@ bool transmitSec1(byte toSend)
     // disable disable rx (allows for cleaner tx, and no echo)
     if (!poll_cmd)
     {
-        sw_serial.enableRx(false);
+        gdo_bus.enable_rx(false);
     }
 
-    sw_serial.write(toSend);
+    gdo_bus.write(&toSend, 1);
+    gdo_bus.flush();
     last_tx = millis();
+    capture_record(&toSend, 1, BUS_CAPTURE_TX);
 
     // RINFO(TAG, "SEC1 SEND BYTE: %02X",toSend);
 
     // re-enable rx
     if (!poll_cmd)
     {
-        sw_serial.enableRx(true);
+        gdo_bus.enable_rx(true);
     }
 
     return true;
@@ -1074,44 +1642,66 @@ bool transmitSec1(byte toSend)
 /**************************** CONTROLLER CODE *******************************
  * SECURITY+2.0
  */
-bool transmitSec2(PacketAction &pkt_ac)
+bool start_transmitSec2(PacketAction &pkt_ac)
 {
-
-    // inverted logic, so this pulls the bus low to assert it
-    digitalWrite(UART_TX_PIN, HIGH);
-    delayMicroseconds(1300);
-    digitalWrite(UART_TX_PIN, LOW);
-    delayMicroseconds(130);
-
-    // check to see if anyone else is continuing to assert the bus after we have released it
-    if (digitalRead(UART_RX_PIN))
+    // usually reserved ahead of time by comms_loop_sec2(), but not if a burst of
+    // commands used them all up
+    if (rolling_journal.ready() && pkt_ac.inc_counter && rolling_codes_left() == 0)
     {
-        RINFO(TAG, "Collision detected, waiting to send packet");
-        return false;
+        reserve_rolling_codes();
     }
-    else
-    {
-        uint8_t buf[SECPLUS2_CODE_LEN];
-        if (pkt_ac.pkt.encode(rolling_code, buf) != 0)
-        {
-            RERROR(TAG, "Could not encode packet");
-            pkt_ac.pkt.print();
-        }
-        else
-        {
-            sw_serial.write(buf, SECPLUS2_CODE_LEN);
-            delayMicroseconds(100);
-        }
 
+    // usually this is a copy of a pre-encoded frame
+    uint8_t buf[SECPLUS2_CODE_LEN];
+    if (frame_cache.encode(pkt_ac.pkt, rolling_code, buf) != 0)
+    {
+        RERROR(TAG, "Could not encode packet");
+        pkt_ac.pkt.print();
         if (pkt_ac.inc_counter)
         {
             rolling_code = (rolling_code + 1) & 0xfffffff;
         }
+        return false;
+    }
+    // wakes the bus and sends the frame in the background, see SecPlus2Transmitter
+    return sec2_tx.start(buf);
+}
+
+// result is what sec2_tx.poll() returned once it was no longer Busy
+bool end_transmitSec2(PacketAction &pkt_ac, SecPlus2Transmitter::Result result)
+{
+    if (result == SecPlus2Transmitter::Result::Failed)
+    {
+        RERROR(TAG, "Bus would not take packet, waiting to send it");
+        return false;
+    }
+    if (result != SecPlus2Transmitter::Result::Sent)
+    {
+        RINFO(TAG, "Collision detected, waiting to send packet");
+        return false;
     }
 
+    capture_record(sec2_tx.frame(), SECPLUS2_CODE_LEN, BUS_CAPTURE_TX);
+    if (pkt_ac.inc_counter)
+    {
+        rolling_code = (rolling_code + 1) & 0xfffffff;
+    }
     return true;
 }
 
+// Send and wait for it, for sync() where nothing else is going on
+bool transmitSec2(PacketAction &pkt_ac)
+{
+    if (!start_transmitSec2(pkt_ac))
+        return false;
+    SecPlus2Transmitter::Result result;
+    while ((result = sec2_tx.poll()) == SecPlus2Transmitter::Result::Busy)
+    {
+        delay(1);
+    }
+    return end_transmitSec2(pkt_ac, result);
+}
+
 bool process_PacketAction(PacketAction &pkt_ac)
 {
 
@@ -1228,6 +1818,43 @@ bool process_PacketAction(PacketAction &pkt_ac)
     return success;
 }
 
+/****************************************************************************
+ * Register the packets worth keeping pre-encoded, see SecPlus2FrameCache.  They
+ * must be built exactly as door_command(), set_light() and send_get_status()
+ * build them or they will never match.
+ */
+void setup_frame_cache()
+{
+    // door button press and release share a rolling code
+    PacketData data = {};
+    data.type = PacketDataType::DoorAction;
+    data.value.door_action.id = 1;
+    for (DoorAction action : {DoorAction::Open, DoorAction::Close, DoorAction::Toggle})
+    {
+        data.value.door_action.action = action;
+        data.value.door_action.pressed = true;
+        frame_cache.add(Packet(PacketCommand::DoorAction, data, id_code));
+        data.value.door_action.pressed = false;
+        frame_cache.add(Packet(PacketCommand::DoorAction, data, id_code));
+    }
+
+    data = {};
+    data.type = PacketDataType::Light;
+    data.value.light.light = LightState::On;
+    frame_cache.add(Packet(PacketCommand::Light, data, id_code));
+    data.value.light.light = LightState::Off;
+    frame_cache.add(Packet(PacketCommand::Light, data, id_code));
+
+    // get status is sent on its own, and again after every command
+    data = {};
+    data.type = PacketDataType::NoData;
+    data.value.no_data = NoData();
+    frame_cache.add(Packet(PacketCommand::GetStatus, data, id_code), 0);
+    frame_cache.add(Packet(PacketCommand::GetStatus, data, id_code), 1);
+    // and ping while idle
+    frame_cache.add(Packet(PacketCommand::Ping, data, id_code));
+}
+
 void sync()
 {
     // only for SECURITY2.0
@@ -1237,7 +1864,7 @@ void sync()
     d.type = PacketDataType::NoData;
     d.value.no_data = NoData();
     Packet pkt = Packet(PacketCommand::GetOpenings, d, id_code);
-    PacketAction pkt_ac = {pkt, true};
+    PacketAction pkt_ac = {pkt, true, 0, CommandAck::None, 0};
     process_PacketAction(pkt_ac);
     delay(100);
     pkt = Packet(PacketCommand::GetStatus, d, id_code);
@@ -1247,42 +1874,39 @@ void sync()
 
 void door_command(DoorAction action)
 {
+    if (detecting)
+    {
+        RINFO(TAG, "Door command ignored, still detecting the door opener protocol");
+        return;
+    }
     if (doorControlType != 3)
     {
         // SECURITY1.0/2.0 commands
-        PacketData data;
+        PacketData data = {}; // unset fields zero, as setup_frame_cache() expects
         data.type = PacketDataType::DoorAction;
         data.value.door_action.action = action;
         data.value.door_action.pressed = true;
         data.value.door_action.id = 1;
 
         Packet pkt = Packet(PacketCommand::DoorAction, data, id_code);
-        PacketAction pkt_ac = {pkt, false, 250}; // 250ms delay for SECURITY1.0
-
-        if (xQueueSendToBack(pkt_q, &pkt_ac, 0) == errQUEUE_FULL)
-        {
-            RERROR(TAG, "packet queue full, dropping door command pressed pkt");
-        }
+        PacketAction pkt_ac[3];
+        pkt_ac[0] = {pkt, false, 250, CommandAck::Door}; // held up to 250ms for SECURITY1.0
 
         // do button release
-        pkt_ac.pkt.m_data.value.door_action.pressed = false;
-        pkt_ac.inc_counter = true;
-        pkt_ac.delay = 40; // 40ms delay for SECURITY1.0
+        pkt_ac[1] = pkt_ac[0];
+        pkt_ac[1].pkt.m_data.value.door_action.pressed = false;
+        pkt_ac[1].inc_counter = true;
+        pkt_ac[1].delay = 40; // 40ms delay for SECURITY1.0
+        pkt_ac[1].ack = CommandAck::None;
 
-        if (xQueueSendToBack(pkt_q, &pkt_ac, 0) == errQUEUE_FULL)
-        {
-            RERROR(TAG, "packet queue full, dropping door command release pkt");
-        }
         // when observing wall panel 2 releases happen, so we do the same
-        if (doorControlType == 1)
+        pkt_ac[2] = pkt_ac[1];
+
+        // press and releases go together, or not at all
+        if (queue_command(CommandLane::Door, pkt_ac, (doorControlType == 1) ? 3 : 2, "door command"))
         {
-            if (xQueueSendToBack(pkt_q, &pkt_ac, 0) == errQUEUE_FULL)
-            {
-                RERROR(TAG, "packet queue full, dropping door command release pkt");
-            }
+            send_get_status();
         }
-
-        send_get_status();
     }
     else
     {
@@ -1409,11 +2033,23 @@ void send_get_status()
         d.type = PacketDataType::NoData;
         d.value.no_data = NoData();
         Packet pkt = Packet(PacketCommand::GetStatus, d, id_code);
-        PacketAction pkt_ac = {pkt, true};
-        if (xQueueSendToBack(pkt_q, &pkt_ac, 0) == errQUEUE_FULL)
-        {
-            RERROR(TAG, "packet queue full, dropping get status pkt");
-        }
+        PacketAction pkt_ac = {pkt, true, 0, CommandAck::None, 0};
+        // one get status waiting is as good as several
+        queue_command(CommandLane::Poll, &pkt_ac, 1, "get status", static_cast<uint32_t>(PacketCommand::GetStatus));
+    }
+}
+
+void send_ping()
+{
+    // only used with SECURITY2.0, see LinkMonitor
+    PacketData d;
+    d.type = PacketDataType::NoData;
+    d.value.no_data = NoData();
+    Packet pkt = Packet(PacketCommand::Ping, d, id_code);
+    PacketAction pkt_ac = {pkt, true, 0, CommandAck::None, 0};
+    if (queue_command(CommandLane::Poll, &pkt_ac, 1, "ping", static_cast<uint32_t>(PacketCommand::Ping)))
+    {
+        link_monitor.queued(micros());
     }
 }
 
@@ -1424,12 +2060,10 @@ void set_lock(uint8_t value)
     if (value)
     {
         data.value.lock.lock = LockState::On;
-        garage_door.target_lock = TGT_LOCKED;
     }
     else
     {
         data.value.lock.lock = LockState::Off;
-        garage_door.target_lock = TGT_UNLOCKED;
     }
 
     // SECUIRTY1.0
@@ -1457,42 +2091,35 @@ void set_lock(uint8_t value)
 
         data.value.lock.pressed = true;
         Packet pkt = Packet(PacketCommand::Lock, data, id_code);
-        PacketAction pkt_ac = {pkt, true, 3000}; // 3000ms delay for SECURITY1.0
+        PacketAction pkt_ac[3];
+        pkt_ac[0] = {pkt, true, 3000, CommandAck::Lock, static_cast<uint8_t>(value ? 1 : 0)}; // held up to 3000ms for SECURITY1.0
 
-        if (xQueueSendToBack(pkt_q, &pkt_ac, 0) == errQUEUE_FULL)
-        {
-            RERROR(TAG, "packet queue full, dropping lock pkt");
-        }
         // button release
-        pkt_ac.pkt.m_data.value.lock.pressed = false;
-        pkt_ac.delay = 40; // 40ms delay for SECURITY1.0
-                           // observed the wall plate does 2 releases, so we will too
-        if (xQueueSendToBack(pkt_q, &pkt_ac, 0) == errQUEUE_FULL)
-        {
-            RERROR(TAG, "packet queue full, dropping lock pkt");
-        }
-        if (xQueueSendToBack(pkt_q, &pkt_ac, 0) == errQUEUE_FULL)
-        {
-            RERROR(TAG, "packet queue full, dropping lock pkt");
-        }
+        pkt_ac[1] = pkt_ac[0];
+        pkt_ac[1].pkt.m_data.value.lock.pressed = false;
+        pkt_ac[1].delay = 40; // 40ms delay for SECURITY1.0
+        pkt_ac[1].ack = CommandAck::None;
+        // observed the wall plate does 2 releases, so we will too
+        pkt_ac[2] = pkt_ac[1];
+
+        queue_command(CommandLane::Control, pkt_ac, 3, "lock");
     }
     // SECURITY2.0
     else
     {
         Packet pkt = Packet(PacketCommand::Lock, data, id_code);
-        PacketAction pkt_ac = {pkt, true};
+        PacketAction pkt_ac = {pkt, true, 0, CommandAck::Lock, static_cast<uint8_t>(value ? 1 : 0)};
 
-        if (xQueueSendToBack(pkt_q, &pkt_ac, 0) == errQUEUE_FULL)
+        if (queue_command(CommandLane::Control, &pkt_ac, 1, "lock"))
         {
-            RERROR(TAG, "packet queue full, dropping lock pkt");
+            send_get_status();
         }
-        send_get_status();
     }
 }
 
 void set_light(bool value)
 {
-    PacketData data;
+    PacketData data = {}; // unset fields zero, as setup_frame_cache() expects
     data.type = PacketDataType::Light;
     if (value)
     {
@@ -1528,36 +2155,29 @@ void set_light(bool value)
         data.value.light.pressed = true;
 
         Packet pkt = Packet(PacketCommand::Light, data, id_code);
-        PacketAction pkt_ac = {pkt, true, 250}; // 250ms delay for SECURITY1.0
+        PacketAction pkt_ac[3];
+        pkt_ac[0] = {pkt, true, 250, CommandAck::Light, value}; // held up to 250ms for SECURITY1.0
 
-        if (xQueueSendToBack(pkt_q, &pkt_ac, 0) == errQUEUE_FULL)
-        {
-            RERROR(TAG, "packet queue full, dropping light pkt");
-        }
         // button release
-        pkt_ac.pkt.m_data.value.light.pressed = false;
-        pkt_ac.delay = 40; // 40ms delay for SECURITY1.0
-                           // observed the wall plate does 2 releases, so we will too
-        if (xQueueSendToBack(pkt_q, &pkt_ac, 0) == errQUEUE_FULL)
-        {
-            RERROR(TAG, "packet queue full, dropping light pkt");
-        }
-        if (xQueueSendToBack(pkt_q, &pkt_ac, 0) == errQUEUE_FULL)
-        {
-            RERROR(TAG, "packet queue full, dropping light pkt");
-        }
+        pkt_ac[1] = pkt_ac[0];
+        pkt_ac[1].pkt.m_data.value.light.pressed = false;
+        pkt_ac[1].delay = 40; // 40ms delay for SECURITY1.0
+        pkt_ac[1].ack = CommandAck::None;
+        // observed the wall plate does 2 releases, so we will too
+        pkt_ac[2] = pkt_ac[1];
+
+        queue_command(CommandLane::Control, pkt_ac, 3, "light");
     }
     // SECURITY+2.0
     else
     {
         Packet pkt = Packet(PacketCommand::Light, data, id_code);
-        PacketAction pkt_ac = {pkt, true};
+        PacketAction pkt_ac = {pkt, true, 0, CommandAck::Light, value};
 
-        if (xQueueSendToBack(pkt_q, &pkt_ac, 0) == errQUEUE_FULL)
+        if (queue_command(CommandLane::Control, &pkt_ac, 1, "light"))
         {
-            RERROR(TAG, "packet queue full, dropping light pkt");
+            send_get_status();
         }
-        send_get_status();
     }
 }
 
@@ -1595,67 +2215,51 @@ void manual_recovery()
  */
 void obstruction_timer()
 {
-    unsigned long current_millis = millis();
-    static unsigned long last_millis = 0;
+    static ObstructionState last_state = ObstructionState::Unknown;
 
     // the obstruction sensor has 3 states: clear (HIGH with LOW pulse every 7ms), obstructed (HIGH), asleep (LOW)
-    // the transitions between awake and asleep are tricky because the voltage drops slowly when falling asleep
-    // and is high without pulses when waking up
-
-    // If at least 3 low pulses are counted within 50ms, the door is awake, not obstructed and we don't have to check anything else
+    // see ObstructionClassifier for how they are told apart
+    ObstructionEdge edge;
+    while (obstruction_edges.pop(edge))
+    {
+        obstruction_sensor.edge(edge.micros, edge.level);
+    }
+    ObstructionState state = obstruction_sensor.poll(micros(), digitalRead(INPUT_OBST_PIN));
+    if (state == last_state)
+        return;
+    last_state = state;
 
-    const long CHECK_PERIOD = 50;
-    const long PULSES_LOWER_LIMIT = 3;
-    if (current_millis - last_millis > CHECK_PERIOD)
+    if (state == ObstructionState::Clear)
     {
-        // check to see if we got more then PULSES_LOWER_LIMIT pulses
-        if (obstruction_sensor.low_count > PULSES_LOWER_LIMIT)
+        // Only update if we are changing state
+        if (garage_door.obstructed)
         {
-            // Only update if we are changing state
-            if (garage_door.obstructed)
+            RINFO(TAG, "Obstruction Clear (pulse every %lu us, %lu%% low)",
+                  obstruction_sensor.period_us(), obstruction_sensor.duty());
+            garage_door.obstructed = false;
+            notify_homekit_obstruction();
+            digitalWrite(STATUS_OBST_PIN, garage_door.obstructed);
+            if (motionTriggers.bit.obstruction)
             {
-                RINFO(TAG, "Obstruction Clear");
-                garage_door.obstructed = false;
-                notify_homekit_obstruction();
-                digitalWrite(STATUS_OBST_PIN, garage_door.obstructed);
-                if (motionTriggers.bit.obstruction)
-                {
-                    garage_door.motion = false;
-                    notify_homekit_motion();
-                }
+                garage_door.motion = false;
+                notify_homekit_motion();
             }
         }
-        else if (obstruction_sensor.low_count == 0)
+    }
+    else if (state == ObstructionState::Obstructed)
+    {
+        // Only update if we are changing state
+        if (!garage_door.obstructed)
         {
-            // if there have been no pulses the line is steady high or low
-            if (!digitalRead(INPUT_OBST_PIN))
-            {
-                // asleep
-                obstruction_sensor.last_asleep = current_millis;
-            }
-            else
+            RINFO(TAG, "Obstruction Detected");
+            garage_door.obstructed = true;
+            notify_homekit_obstruction();
+            digitalWrite(STATUS_OBST_PIN, garage_door.obstructed);
+            if (motionTriggers.bit.obstruction)
             {
-                // if the line is high and was last asleep more than 700ms ago, then there is an obstruction present
-                if (current_millis - obstruction_sensor.last_asleep > 700)
-                {
-                    // Only update if we are changing state
-                    if (!garage_door.obstructed)
-                    {
-                        RINFO(TAG, "Obstruction Detected");
-                        garage_door.obstructed = true;
-                        notify_homekit_obstruction();
-                        digitalWrite(STATUS_OBST_PIN, garage_door.obstructed);
-                        if (motionTriggers.bit.obstruction)
-                        {
-                            garage_door.motion = true;
-                            notify_homekit_motion();
-                        }
-                    }
-                }
+                garage_door.motion = true;
+                notify_homekit_motion();
             }
         }
-
-        last_millis = current_millis;
-        obstruction_sensor.low_count = 0;
     }
 }
\ No newline at end of file
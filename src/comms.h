@@ -22,9 +22,71 @@
 
 // RATGDO project includes
 #include "Packet.h"
+#include "Reader.h"
+#include "FrameCache.h"
+#include "Capture.h"
+#include "Scheduler.h"
+#include "Bus.h"
+#include "Transmit.h"
+#include "Journal.h"
+#include "Contention.h"
+#include "Obstruction.h"
+#include "DoorReducer.h"
+#include "StatusPoller.h"
+#include "LinkMonitor.h"
+#include "ProtocolDetect.h"
+
+// Status change that shows the opener has acted on a command
+enum class CommandAck : uint8_t
+{
+    None,
+    Door,  // door state moves away from what it was when the command went out
+    Light, // light reaches ack_value
+    Lock,  // lock reaches ack_value
+};
+
+// A packet waiting to go to the door opener
+struct PacketAction
+{
+    Packet pkt;
+    bool inc_counter;
+    uint32_t delay; // SECURITY1.0, ms to wait before the next transmit, or to hold a button for its ack
+    CommandAck ack = CommandAck::None;
+    uint8_t ack_value = 0;
+};
+
+// Counters for the web server's status page.  The comms task owns the counters
+// themselves and copies them out each pass, comms_stats() returns that copy.
+struct CommsStats
+{
+    uint32_t packets_lost;
+    uint32_t packets_resynced;
+    uint32_t packets_rejected;
+    uint32_t packets_pre_encoded;
+    uint32_t transmit_collisions;
+    uint32_t transmit_gave_up;
+    uint32_t transmit_wait_avg_us;
+    uint32_t transmit_wait_max_us;
+    uint32_t status_polls;
+    LinkHealth link_health;
+    uint32_t pings_sent;
+    uint32_t pings_lost;
+    uint32_t ping_rtt_min_us;
+    uint32_t ping_rtt_avg_us;
+    uint32_t ping_rtt_max_us;
+    uint32_t ping_rtt_histogram[LinkMonitor::BUCKETS];
+    size_t command_queue_peak;
+    uint32_t commands_dropped;
+    uint32_t commands_coalesced;
+    uint32_t commands_unacked;
+};
+
+// Room in each transmit lane, enough for two SECURITY1.0 button commands
+const size_t TX_LANE_DEPTH = 6;
 
 extern void setup_comms();
 extern void comms_loop();
+extern uint32_t comms_task_step();
 
 extern void open_door();
 extern void close_door();
@@ -35,5 +97,30 @@ extern void set_light(bool value);
 extern void save_rolling_code();
 extern void reset_door();
 
+extern bool capture_start(size_t records);
+extern uint32_t capture_stop();
+extern void capture_clear();
+extern void capture_download(void (*send)(const BusCapture &capture));
+
+extern void comms_stats(CommsStats &stats);
+
 extern uint32_t doorControlType;
+extern SecPlus2Reader reader;
+extern uint32_t rejected_packets;
+extern SecPlus2FrameCache<12> frame_cache;
+extern CommandScheduler<PacketAction, TX_LANE_DEPTH> tx_scheduler;
+// The wire to the door opener, src/bus.cpp (or the simulator's on the host)
+extern GdoBus &gdo_bus;
+// SECURITY2.0 transmit timer, src/transmit.cpp (or the simulator's on the host)
+extern SecPlus2TxTimer &sec2_tx_timer;
+// rolling code journal flash, src/journal.cpp (or the simulator's on the host)
+extern JournalFlash &rolling_flash;
+extern Journal rolling_journal;
+extern SecPlus2Transmitter sec2_tx;
+extern SecPlus2Contention sec2_contention;
+extern StatusPoller status_poller;
+extern LinkMonitor link_monitor;
+extern ProtocolDetector protocol_detector;
+extern uint32_t commands_acked;
+extern uint32_t commands_unacked;
 extern DoorState doorState;
@@ -103,6 +103,8 @@ bool helperGDOSecurityType(const std::string &key, const std::string &value, con
     // Call fn to reset door
     userConfig->set(key, value);
     reset_door();
+    // chosen by hand, so no need to detect it on boot
+    nvRam->write(nvram_protocol_set, 1);
     return true;
 }
 
@@ -73,6 +73,7 @@ constexpr char nvram_rolling[] = "rolling";
 constexpr char nvram_has_motion[] = "has_motion";
 constexpr char nvram_ratgdo_pw[] = "ratgdo_pw";
 constexpr char nvram_has_distance[] = "has_distance";
+constexpr char nvram_protocol_set[] = "protocol_set";
 
 struct configSetting
 {
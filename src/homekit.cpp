@@ -346,12 +346,6 @@ void notify_homekit_target_door_state_change()
 
 void notify_homekit_current_door_state_change()
 {
-    // Notify the vehicle presence code that door state is changing
-    if (garage_door.current_state == GarageDoorCurrentState::CURR_OPENING)
-        doorOpening();
-    if (garage_door.current_state == GarageDoorCurrentState::CURR_CLOSING)
-        doorClosing();
-
     if (!isPaired)
         return;
 
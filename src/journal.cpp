@@ -0,0 +1,73 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+
+// C/C++ language includes
+// none
+
+// Arduino includes
+// none
+
+// ESP system includes
+#include <esp_partition.h>
+
+// RATGDO project includes
+#include "log.h"
+#include "Journal.h"
+
+// Logger tag
+static const char *TAG = "ratgdo-journal";
+
+// Flash for the rolling code Journal, the "rolling" partition in partitions.csv.
+// Devices updated over the air keep the partition table they were flashed with,
+// so it may not be there, in which case comms stays with NVS.
+class PartitionFlash : public JournalFlash
+{
+public:
+    bool begin(void) override
+    {
+        if (!m_part)
+            m_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, PARTITION_SUBTYPE, "rolling");
+        if (!m_part)
+        {
+            RINFO(TAG, "No rolling code partition, flash with a serial cable to add it");
+        }
+        return m_part != NULL;
+    }
+
+    size_t sectors(void) override
+    {
+        return m_part->size / SECTOR_SIZE;
+    }
+
+    bool read(size_t offset, void *buf, size_t len) override
+    {
+        return esp_partition_read(m_part, offset, buf, len) == ESP_OK;
+    }
+
+    bool write(size_t offset, const void *buf, size_t len) override
+    {
+        return esp_partition_write(m_part, offset, buf, len) == ESP_OK;
+    }
+
+    bool erase(size_t sector) override
+    {
+        return esp_partition_erase_range(m_part, sector * SECTOR_SIZE, SECTOR_SIZE) == ESP_OK;
+    }
+
+private:
+    // first of the subtypes left for applications
+    static const esp_partition_subtype_t PARTITION_SUBTYPE = (esp_partition_subtype_t)0x40;
+
+    const esp_partition_t *m_part = NULL;
+};
+
+static PartitionFlash partition_flash;
+JournalFlash &rolling_flash = partition_flash;
@@ -108,7 +108,7 @@ void setup()
  */
 void loop()
 {
-    comms_loop();
+    // comms_loop() has its own task, see comms.cpp
     drycontact_loop();
     web_loop();
     soft_ap_loop();
@@ -86,6 +86,7 @@ enum LockTargetState : uint8_t
 
 #define MOTION_TIMER_DURATION 5000      // how long to keep HomeKit motion sensor active for
 
+// Written by the comms task, see comms.cpp for how other tasks may use it
 struct GarageDoor
 {
     bool active;
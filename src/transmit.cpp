@@ -0,0 +1,51 @@
+/****************************************************************************
+ * RATGDO HomeKit for ESP32
+ * https://ratcloud.llc
+ * https://github.com/PaulWieland/ratgdo
+ *
+ * Copyright (c) 2023-24 David A Kerr... https://github.com/dkerr64/
+ * All Rights Reserved.
+ * Licensed under terms of the GPL-3.0 License.
+ *
+ */
+
+// C/C++ language includes
+// none
+
+// Arduino includes
+// none
+
+// ESP system includes
+#include <esp_timer.h>
+
+// RATGDO project includes
+#include "Transmit.h"
+
+// Security+2.0 transmit timer for SecPlus2Transmitter, marks the end of the wake
+// pulse and settle time so that nothing busy-waits on the bus.
+class EspTxTimer : public SecPlus2TxTimer
+{
+public:
+    void begin(SecPlus2Transmitter *owner) override
+    {
+        if (m_timer)
+            return;
+        esp_timer_create_args_t args = {};
+        args.callback = [](void *arg)
+        { static_cast<SecPlus2Transmitter *>(arg)->on_timer(); };
+        args.arg = owner;
+        args.name = "sec2_tx";
+        esp_timer_create(&args, &m_timer);
+    }
+
+    void start(uint32_t us) override
+    {
+        esp_timer_start_once(m_timer, us);
+    }
+
+private:
+    esp_timer_handle_t m_timer = NULL;
+};
+
+static EspTxTimer esp_tx_timer;
+SecPlus2TxTimer &sec2_tx_timer = esp_tx_timer;
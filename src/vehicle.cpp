@@ -10,7 +10,7 @@
  */
 
 // C/C++ language includes
-// None
+#include <atomic>
 
 // Arduino includes
 #include <Wire.h>
@@ -44,8 +44,13 @@ static unsigned long lastChangeAt = 0;
 static unsigned long presence_timer = 0; // to be set by door open action
 static unsigned long vehicle_motion_timer = 0;
 static std::vector<int16_t> distanceMeasurement(20, -1);
+// door state changes come from the comms task and are handled in vehicle_loop()
+static std::atomic<bool> doorOpened(false);
+static std::atomic<bool> doorClosed(false);
 
 void calculatePresence(int16_t distance);
+static void handleDoorOpening();
+static void handleDoorClosing();
 
 void setup_vehicle()
 {
@@ -83,6 +88,11 @@ void vehicle_loop()
     if (!vehicle_setup_done)
         return;
 
+    if (doorOpened.exchange(false))
+        handleDoorOpening();
+    if (doorClosed.exchange(false))
+        handleDoorClosing();
+
     uint8_t dataReady = 0;
     if ((distanceSensor.VL53L4CX_GetMeasurementDataReady(&dataReady) == 0) && (dataReady > 0))
     {
@@ -200,21 +210,32 @@ void calculatePresence(int16_t distance)
     }
 }
 
-// if notified of door opening, set timeout during which we check for arriving/departing vehicle (looking forward)
+// Called from the comms task, only leave word for vehicle_loop()
 void doorOpening()
 {
     if (!vehicle_setup_done)
         return;
 
-    presence_timer = millis() + PRESENCE_DETECT_DURATION;
+    doorOpened = true;
 }
 
-// if notified of door closing, check for arrived/departed vehicle within time window (looking back)
 void doorClosing()
 {
     if (!vehicle_setup_done)
         return;
 
+    doorClosed = true;
+}
+
+// if notified of door opening, set timeout during which we check for arriving/departing vehicle (looking forward)
+static void handleDoorOpening()
+{
+    presence_timer = millis() + PRESENCE_DETECT_DURATION;
+}
+
+// if notified of door closing, check for arrived/departed vehicle within time window (looking back)
+static void handleDoorClosing()
+{
     if ((millis() > PRESENCE_DETECT_DURATION) && ((millis() - lastChangeAt) < PRESENCE_DETECT_DURATION))
     {
         setArriveDepart(vehicleDetected);
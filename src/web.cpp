@@ -69,6 +69,7 @@ void handle_showlog();
 void handle_showrebootlog();
 void handle_crashlog();
 void handle_clearcrashlog();
+void handle_capture();
 #ifdef CRASH_DEBUG
 void handle_forcecrash();
 void handle_crash_oom();
@@ -96,6 +97,7 @@ const std::unordered_map<std::string, std::pair<const HTTPMethod, void (*)()>> b
     {"/rescan", {HTTP_POST, handle_rescan}},
     {"/crashlog", {HTTP_GET, handle_crashlog}},
     {"/clearcrashlog", {HTTP_GET, handle_clearcrashlog}},
+    {"/capture.bin", {HTTP_GET, handle_capture}},
 #ifdef CRASH_DEBUG
     {"/forcecrash", {HTTP_POST, handle_forcecrash}},
     {"/crashoom", {HTTP_POST, handle_crash_oom}},
@@ -152,7 +154,7 @@ uint8_t subscriptionCount = 0;
 
 SemaphoreHandle_t jsonMutex = NULL;
 
-#define JSON_BUFFER_SIZE 1280
+#define JSON_BUFFER_SIZE 2048 // status with all the SECURITY2.0 link and queue counters
 char *json = NULL;
 
 #define DOOR_STATE(s) (s == 0) ? "Open" : (s == 1) ? "Closed"  \
@@ -469,6 +471,45 @@ void handle_status()
     ADD_INT(json, "minHeap", min_heap);
     // TODO monitor stack... ADD_INT(json, "minStack", 0);
     ADD_INT(json, "crashCount", crashCount);
+    // owned by the comms task, this is its last copy
+    CommsStats comms;
+    comms_stats(comms);
+    if (doorControlType == 2)
+    {
+        ADD_INT(json, "packetsLost", comms.packets_lost);
+        ADD_INT(json, "packetsResynced", comms.packets_resynced);
+        ADD_INT(json, "packetsRejected", comms.packets_rejected);
+        ADD_INT(json, "packetsPreEncoded", comms.packets_pre_encoded);
+        ADD_INT(json, "transmitCollisions", comms.transmit_collisions);
+        ADD_INT(json, "transmitGaveUp", comms.transmit_gave_up);
+        ADD_INT(json, "transmitWaitAvgUs", comms.transmit_wait_avg_us);
+        ADD_INT(json, "transmitWaitMaxUs", comms.transmit_wait_max_us);
+        ADD_INT(json, "statusPolls", comms.status_polls);
+        ADD_STR(json, "linkHealth", LinkMonitor::name(comms.link_health));
+        ADD_INT(json, "pingsSent", comms.pings_sent);
+        ADD_INT(json, "pingsLost", comms.pings_lost);
+        ADD_INT(json, "pingRttMinUs", comms.ping_rtt_min_us);
+        ADD_INT(json, "pingRttAvgUs", comms.ping_rtt_avg_us);
+        ADD_INT(json, "pingRttMaxUs", comms.ping_rtt_max_us);
+        {
+            // counts below 8, 16, 32 ... ms, the last is everything longer
+            char hist[LinkMonitor::BUCKETS * 11] = "";
+            for (size_t i = 0; i < LinkMonitor::BUCKETS; i++)
+            {
+                char n[12];
+                snprintf(n, sizeof(n), i ? ",%lu" : "%lu", (unsigned long)comms.ping_rtt_histogram[i]);
+                strlcat(hist, n, sizeof(hist));
+            }
+            ADD_STR(json, "pingRttHistogram", hist);
+        }
+    }
+    if (doorControlType != 3)
+    {
+        ADD_INT(json, "commandQueuePeak", comms.command_queue_peak);
+        ADD_INT(json, "commandsDropped", comms.commands_dropped);
+        ADD_INT(json, "commandsCoalesced", comms.commands_coalesced);
+        ADD_INT(json, "commandsUnacknowledged", comms.commands_unacked);
+    }
     // TODO support WiFi PhyMode... ADD_INT(json, cfg_wifiPhyMode, userConfig->getWifiPhyMode());
     // TODO support WiFi TX Power... ADD_INT(json, cfg_wifiPower, userConfig->getWifiPower());
     ADD_BOOL(json, cfg_staticIP, userConfig->getStaticIP());
@@ -631,6 +672,52 @@ bool helperAssistLaser(const std::string &key, const std::string &value, configS
     return true;
 }
 
+bool helperLogLevel(const std::string &key, const std::string &value, configSetting *action)
+{
+    // Value is either "level", to set the default threshold, or "tag:level" to override
+    // threshold for one logger tag.  Not saved, reverts to default on reboot.
+    size_t pos = value.rfind(':');
+    const char *num = value.c_str() + ((pos == std::string::npos) ? 0 : pos + 1);
+    char *end;
+    long level = strtol(num, &end, 10);
+    if (end == num || *end || level < RATGDO_LOG_NONE || level > RATGDO_LOG_DEBUG)
+        return false;
+
+    if (pos == std::string::npos)
+    {
+        RINFO(TAG, "Set log level: %ld", level);
+        return ratgdoLogLevels.set(NULL, level);
+    }
+    RINFO(TAG, "Set log level for %s: %ld", value.substr(0, pos).c_str(), level);
+    return ratgdoLogLevels.set(value.substr(0, pos).c_str(), level);
+}
+
+bool helperBusCapture(const std::string &key, const std::string &value, configSetting *action)
+{
+    // Value is "0" to stop (capture kept for download), "clear" to stop and free the
+    // memory, otherwise start a new capture of that many records ("1" for default size).
+    // Not saved, capture is lost on reboot.
+    if (value == "clear")
+    {
+        RINFO(TAG, "Bus capture cleared");
+        capture_clear();
+        return true;
+    }
+    int records = atoi(value.c_str());
+    if (records == 0)
+    {
+        uint32_t total = capture_stop();
+        RINFO(TAG, "Bus capture stopped, %lu bytes seen", total);
+        return true;
+    }
+    if (records == 1)
+        records = BUS_CAPTURE_DEFAULT_RECORDS;
+    if (records < 0 || (size_t)records > free_heap / 2 / sizeof(BusCaptureRecord))
+        return false;
+    RINFO(TAG, "Bus capture started, %d records", records);
+    return capture_start(records);
+}
+
 void handle_setgdo()
 {
     // Build-in handlers that do not set a configuration value, or if they do they set multiple values.
@@ -644,6 +731,8 @@ void handle_setgdo()
         {"updateUnderway", {false, false, 0, helperUpdateUnderway}},
         {"factoryReset", {true, false, 0, helperFactoryReset}},
         {"assistLaser", {false, false, 0, helperAssistLaser}},
+        {"logLevel", {false, false, 0, helperLogLevel}},
+        {"busCapture", {false, false, 0, helperBusCapture}},
     };
     bool reboot = false;
     bool error = false;
@@ -950,6 +1039,23 @@ void handle_showrebootlog()
     client.stop();
 }
 
+void handle_capture()
+{
+    AUTHENTICATE();
+    // stopped first, or the ring would grow past the length we give
+    capture_download([](const BusCapture &capture)
+                     {
+        BusCaptureHeader hdr = capture.header();
+        RINFO(TAG, "Sending bus capture of %lu records (%lu dropped)", hdr.count, hdr.dropped);
+        server.sendHeader(F("Cache-Control"), F("no-cache, no-store"));
+        server.sendHeader(F("Content-Disposition"), F("attachment; filename=\"capture.bin\""));
+        server.setContentLength(sizeof(hdr) + hdr.count * sizeof(BusCaptureRecord));
+        server.send(200, "application/octet-stream", "");
+        server.sendContent((const char *)&hdr, sizeof(hdr));
+        capture.for_each_span([](const uint8_t *buf, size_t len)
+                              { server.sendContent((const char *)buf, len); }); });
+}
+
 void handle_clearcrashlog()
 {
     AUTHENTICATE();
@@ -13,6 +13,8 @@ do
             ;;
         test) pio test -e native $VERBOSE
             ;;
+        bench) pio run -e native $VERBOSE && .pio/build/native/program
+            ;;
         release)
             git tag $2
             ./x.sh run
@@ -25,7 +27,7 @@ do
             git push
             git push --tag
             ;;
-        *) echo "usage: x.sh [-v] <upload|monitor|run|test>"
+        *) echo "usage: x.sh [-v] <upload|monitor|run|test|bench>"
             exit 1
             ;;
     esac